@@ -0,0 +1,183 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "raw_io.hpp"
+
+using namespace std;
+
+// Builds the final 4D dataset from the b0 and the per-slice,
+// per-direction results of stejskal_clustered, writing each of them
+// once, directly at its final offset:
+//
+//   [b0][direction 0: slice 0 .. slice n-1][direction 1: ...]...
+//
+// The manifest has one entry per line ('#' starts a comment):
+//
+//   slices     <number of slices>
+//   directions <number of directions>
+//   b0         <file name>
+//   chunk      <direction index> <slice index> <file name>
+//   chunk_size <bytes>   (optional, when no chunk is listed)
+//
+// The output is updated in place if it already exists, so a manifest
+// listing only some chunks patches just those, and a manifest with no
+// chunks just writes the b0 into a file that stejskal_clustered fills
+// directly.
+int main (int argc, char** argv)
+{
+  copy_block         block;
+  ifstream           manifest_file;
+  int                direction;
+  int                number_of_directions;
+  int                number_of_slices;
+  int                output_fd;
+  int                slice;
+  offset_t           b0_size;
+  offset_t           chunk_size;
+  offset_t           output_size;
+  string             b0_file_name;
+  string             keyword;
+  string             line;
+  string             manifest_file_name;
+  string             output_file_name;
+  stringstream       line_stream;
+  vector<copy_block> blocks;
+  vector<int>        chunk_directions;
+  vector<int>        chunk_slices;
+
+  if ( argc < 3 )
+    {
+      cout << "ERROR: too few arguments." << endl;
+      cout << "USAGE: " << argv[0] << " manifest_file_name output_file_name" << endl;
+      exit (1);
+    }
+  manifest_file_name = argv[1];
+  output_file_name   = argv[2];
+
+  manifest_file.open ( manifest_file_name.c_str () );
+  if ( ! manifest_file )
+    {
+      cout << "ERROR: cannot open " << manifest_file_name << "." << endl;
+      exit (1);
+    }
+  number_of_directions = 0;
+  number_of_slices     = 0;
+  chunk_size           = -1;
+  while ( getline ( manifest_file, line ) )
+    {
+      line_stream.clear ();
+      line_stream.str ( line );
+      keyword = "";
+      line_stream >> keyword;
+      if ( keyword == "" || keyword[0] == '#' )
+	continue;
+      if ( keyword == "slices" )
+	line_stream >> number_of_slices;
+      else if ( keyword == "directions" )
+	line_stream >> number_of_directions;
+      else if ( keyword == "chunk_size" )
+	line_stream >> chunk_size;
+      else if ( keyword == "b0" )
+	line_stream >> b0_file_name;
+      else if ( keyword == "chunk" )
+	{
+	  line_stream >> direction >> slice >> block.file_name;
+	  chunk_directions.push_back ( direction );
+	  chunk_slices.push_back ( slice );
+	  blocks.push_back ( block );
+	}
+      else
+	{
+	  cout << "ERROR: unknown manifest entry \"" << keyword << "\"." << endl;
+	  exit (1);
+	}
+      if ( line_stream.fail () )
+	{
+	  cout << "ERROR: malformed manifest line \"" << line << "\"." << endl;
+	  exit (1);
+	}
+    }
+  manifest_file.close ();
+  if ( b0_file_name == "" || number_of_slices <= 0 || number_of_directions <= 0 )
+    {
+      cout << "ERROR: manifest must give slices, directions and b0." << endl;
+      exit (1);
+    }
+
+  // every chunk has the same size, which fixes all the offsets
+  b0_size = file_size ( b0_file_name.c_str () );
+  if ( b0_size < 0 )
+    {
+      cout << "ERROR: cannot stat " << b0_file_name << "." << endl;
+      exit (1);
+    }
+  for ( unsigned int i = 0; i < blocks.size (); i++ )
+    {
+      if ( chunk_directions[i] < 0 || chunk_directions[i] >= number_of_directions ||
+	   chunk_slices[i]     < 0 || chunk_slices[i]     >= number_of_slices )
+	{
+	  cout << "ERROR: chunk " << blocks[i].file_name << " is outside the dataset." << endl;
+	  exit (1);
+	}
+      blocks[i].file_size = file_size ( blocks[i].file_name.c_str () );
+      if ( chunk_size < 0 )
+	chunk_size = blocks[i].file_size;
+      if ( blocks[i].file_size < 0 || blocks[i].file_size != chunk_size )
+	{
+	  cout << "ERROR: chunk " << blocks[i].file_name << " is missing or has the wrong size." << endl;
+	  exit (1);
+	}
+      blocks[i].output_offset = b0_size + ( static_cast<offset_t> ( chunk_directions[i] ) * number_of_slices + chunk_slices[i] ) * chunk_size;
+    }
+  if ( blocks.size () > 0 && blocks.size () < static_cast<unsigned int> ( number_of_slices * number_of_directions ) )
+    cout << "WARNING: manifest lists " << blocks.size () << " of " << number_of_slices * number_of_directions << " chunks." << endl;
+
+  block.file_name     = b0_file_name;
+  block.file_size     = b0_size;
+  block.output_offset = 0;
+  blocks.push_back ( block );
+  // without a chunk size the final size is unknown: never shrink then
+  output_size = b0_size;
+  if ( chunk_size >= 0 )
+    output_size += chunk_size * number_of_slices * number_of_directions;
+
+  output_fd = open ( output_file_name.c_str (), O_WRONLY | O_CREAT, 0644 );
+  if ( output_fd < 0 || ! preallocate ( output_fd, output_size ) ||
+       ( chunk_size >= 0 && ftruncate ( output_fd, output_size ) != 0 ) )
+    {
+      cout << "ERROR: cannot create " << output_file_name << "." << endl;
+      exit (1);
+    }
+  close ( output_fd );
+
+  cout << "Assembling " << blocks.size () << " blocks into " << output_file_name << " (" << output_size << " bytes)." << endl;
+  if ( ! parallel_copy ( output_file_name, &blocks[0], blocks.size () ) )
+    exit (1);
+  return 0;
+}
@@ -21,23 +21,68 @@
 usage=$(
 cat <<EOF 
 USAGE: $0 <PARAMETERS>
-PARAMETERS (all are obligatory):
-\t -e experiment name 
-\t -s number of slices
-\t -t number of steps per second
+PARAMETERS:
+\t -a number of attempts for each chunk
+\t -b size of the b0 in bytes, to write directly into the final 4D file
+\t -d number of gradient directions (obligatory with -b)
+\t -e experiment name (*)
+\t -g shell table: every task synthesizes all of its shells
+\t -k directory of the results cache shared by experiments (none to disable)
+\t -l lease in seconds: a worker silent for this long is taken as dead
+\t -m memory budget in MB for each process
+\t -p gradient waveform file
+\t -s number of slices (*)
+\t -t number of steps per second (*)
+\t -w number of workers to submit (default: one per slice)
+\t -x diffusion model: principal, tensor or compartments (all but principal need -b)
+(*) Indicates an obligatory option.
 EOF
 )
 
-while getopts "e:s:t:" OPTION; do
+attempts=3
+lease=120
+memory_budget=64
+
+while getopts "a:b:d:e:g:k:l:m:p:s:t:w:x:" OPTION; do
     case $OPTION in
+	a)
+	    attempts=$OPTARG
+	    ;;
+	b)
+	    b0_size=$OPTARG
+	    ;;
+	d)
+	    directions=$OPTARG
+	    ;;
 	e)
 	    experiment_name=$OPTARG
 	    ;;
+	g)
+	    shell_table=$OPTARG
+	    ;;
+	k)
+	    cache_directory=$OPTARG
+	    ;;
+	l)
+	    lease=$OPTARG
+	    ;;
+	m)
+	    memory_budget=$OPTARG
+	    ;;
+	p)
+	    waveform=$OPTARG
+	    ;;
 	s)
 	    slices=$OPTARG
 	    ;;
 	t)  steps_per_second=$OPTARG
 	    ;;
+	w)
+	    workers=$OPTARG
+	    ;;
+	x)
+	    model=$OPTARG
+	    ;;
 	*) 
 	    echo "Unrecognized option."
 	    echo -e "$usage"
@@ -46,25 +91,59 @@ while getopts "e:s:t:" OPTION; do
     esac
 done
 
+if [ -z "$workers" ]; then
+    workers=$slices
+fi
+
 cd ~/latest/$experiment_name
 
+# every slice and direction is a task in the queue; the jobs are only
+# workers, each leasing tasks until none is left, so a job that dies
+# has its tasks retried by the others
+direct_options=""
+if [ -n "$b0_size" ]; then
+    direct_options="-b $b0_size -d $directions -s $slices"
+fi
+shells=1
+if [ -n "$shell_table" ]; then
+    shells=`grep -c -E '^[[:space:]]*(b|gradient)[[:space:]]' $shell_table`
+    direct_options="$direct_options -g $shell_table"
+fi
+# the tasks write into the 4D file, which must exist whole before the
+# first of them starts (see prepare_4d.sh)
+if [ -n "$b0_size" ]; then
+    ./prepare_4d.sh -d $(($directions * $shells)) -s $slices -o ${experiment_name}_synthetic.raw || exit 1
+fi
+if [ -n "$waveform" ]; then
+    direct_options="$direct_options -p $waveform"
+fi
+if [ -n "$model" ]; then
+    direct_options="$direct_options -x $model"
+fi
+./write_task_list.sh -e $experiment_name -t $steps_per_second -m $memory_budget -o tasks.txt $direct_options
+rm -rf queue
+cache_options=""
+if [ -n "$cache_directory" ] && [ ! "$cache_directory" == "none" ]; then
+    cache_options="-cache $cache_directory"
+fi
+# chunks done by an earlier, interrupted run are not submitted again,
+# nor those any experiment left in the cache
+./queue_coordinator.exe submit queue tasks.txt -attempts $attempts -lease $lease -manifest chunks.manifest $cache_options -program ./stejskal_clustered.exe
+if [ ! $? -eq 0 ]; then
+    exit 1
+fi
+
 i=1
-while [ $i -le $slices ]; do
-    echo -n "($i/$slices) "
-    ./job_wrapper.sh $(($i-1)) $experiment_name $steps_per_second
+while [ $i -le $workers ]; do
+    echo -n "($i/$workers) "
+    ./job_wrapper.sh $i $experiment_name
     i=$(($i+1))
 done
 
-all_done=1
-while [ ! $all_done -eq 0 ]; do
-    sleep 29
-    files=`ls -1 --color=never ~/latest/$experiment_name/job.sh.* 2>/dev/null | wc -l | cut -d" " -f 1`
-    echo "files=$files"
-    expected_files=$(($slices*2))
-    if [ "$files" == "$expected_files" ]; then
-	all_done=0
-    fi
-done
+# returns as soon as the last task is done
+./queue_coordinator.exe wait queue
+status=$?
+rm tasks.txt
 
 # How long did it take?                                                                                                                         
 first_job=`head -n 1 qsub_output.txt | sed 's/\..*$//'`
@@ -72,3 +151,5 @@ last_job=`tail -n 1 qsub_output.txt | sed 's/\..*$//'`
 echo "Batch started at $first_job and ended at $last_job." >> qsub_output.txt
 echo "tracejob $first_job 2>/dev/null | grep enqueuing | awk '{ print \$2 }'" >> qsub_output.txt
 echo "tracejob $last_job  2>/dev/null | grep dequeuing | awk '{ print \$2 }'" >> qsub_output.txt
+
+exit $status
@@ -0,0 +1,183 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "chunk_manifest.hpp"
+#include "raw_io.hpp"
+
+using namespace std;
+
+chunk_manifest::chunk_manifest ()
+{
+  program_hash = FNV_OFFSET_BASIS;
+  pthread_mutex_init ( &lock, NULL );
+}
+
+chunk_manifest::~chunk_manifest ()
+{
+  pthread_mutex_destroy ( &lock );
+}
+
+bool chunk_manifest::load ( const string& manifest_file_name, const string& program )
+{
+  ifstream manifest_file;
+  string   line;
+  string   kind;
+  hash_t   key;
+  hash_t   output;
+
+  file_name = manifest_file_name;
+  if ( ! hash_file ( program, &program_hash ) )
+    return false;
+  chunks.clear ();
+  manifest_file.open ( file_name.c_str () );
+  // no manifest yet: nothing is done
+  if ( ! manifest_file )
+    return true;
+  while ( getline ( manifest_file, line ) )
+    {
+      istringstream fields ( line );
+
+      // a line cut short by a crash does not parse, and is ignored
+      if ( fields >> kind >> hex >> key >> output && kind == "chunk" )
+	chunks[key] = output;
+    }
+  return true;
+}
+
+bool chunk_manifest::task_key ( const synthesis_task& task, hash_t* key )
+{
+  istringstream options ( task.options );
+  string        option;
+  hash_t        sample_hash;
+  hash_t        table_hash;
+
+  pthread_mutex_lock ( &lock );
+  if ( sample_hashes.find ( task.sample_file ) == sample_hashes.end () )
+    {
+      pthread_mutex_unlock ( &lock );
+      if ( ! hash_file ( task.sample_file, &sample_hash ) )
+	return false;
+      pthread_mutex_lock ( &lock );
+      sample_hashes[task.sample_file] = sample_hash;
+    }
+  sample_hash = sample_hashes[task.sample_file];
+  pthread_mutex_unlock ( &lock );
+
+  *key = fnv1a ( &program_hash, sizeof ( program_hash ) );
+  *key = fnv1a ( &sample_hash, sizeof ( sample_hash ), *key );
+  *key = fnv1a ( task.output_prefix, *key );
+  for ( int i = 0; i < 3; i++ )
+    *key = fnv1a ( task.gradient[i], *key );
+  // not the steps: the integration is exact (see hash_sequence)
+  while ( options >> option )
+    {
+      // neither the memory budget nor where results are cached
+      // change the result
+      if ( option == "-memory" || option == "-cache" )
+	{
+	  options >> option;
+	  continue;
+	}
+      *key = fnv1a ( option, *key );
+      // nor do the names of the shell, waveform and gradient tables
+      // and of the compartments file, but what they hold
+      if ( ( option == "-shells" || option == "-waveform" || option == "-gradients" || option == "-compartments" ) && options >> option )
+	{
+	  if ( ! hash_file ( option, &table_hash ) )
+	    return false;
+	  *key = fnv1a ( &table_hash, sizeof ( table_hash ), *key );
+	}
+    }
+  return true;
+}
+
+bool chunk_manifest::output_hash ( const synthesis_task& task, bool whole_files, hash_t* output )
+{
+  vector<task_output_region> outputs;
+  hash_t                     region_hash;
+
+  if ( ! task_output ( task, outputs ) )
+    return false;
+  // the hash of a single output is that of its bytes, so that
+  // manifests written before there were shells stay valid
+  for ( unsigned int shell = 0; shell < outputs.size (); shell++ )
+    {
+      // a file of its own must hold nothing else
+      if ( whole_files && outputs[shell].own_file &&
+	   file_size ( outputs[shell].file_name.c_str () ) != outputs[shell].length )
+	return false;
+      if ( ! hash_file_range ( outputs[shell].file_name, outputs[shell].offset, outputs[shell].length, &region_hash ) )
+	return false;
+      if ( shell == 0 )
+	*output = region_hash;
+      else
+	*output = fnv1a ( &region_hash, sizeof ( region_hash ), *output );
+    }
+  return true;
+}
+
+bool chunk_manifest::is_complete ( const synthesis_task& task )
+{
+  hash_t   key;
+  hash_t   output;
+
+  if ( ! task_key ( task, &key ) || chunks.find ( key ) == chunks.end () )
+    return false;
+  return output_hash ( task, true, &output ) && output == chunks[key];
+}
+
+bool chunk_manifest::record ( const synthesis_task& task )
+{
+  char     line[512];
+  hash_t   key;
+  hash_t   output;
+  int      fd;
+  int      line_length;
+  bool     result;
+
+  if ( ! task_key ( task, &key ) || ! output_hash ( task, false, &output ) )
+    return false;
+  line_length = snprintf ( line, sizeof ( line ), "chunk %016llx %016llx %u %s\n", key, output, task.id, task.output_prefix.c_str () );
+  if ( line_length >= static_cast<int> ( sizeof ( line ) ) )
+    line_length = snprintf ( line, sizeof ( line ), "chunk %016llx %016llx %u\n", key, output, task.id );
+
+  // one write of a whole line, under a lock that other processes
+  // writing to the same manifest respect
+  pthread_mutex_lock ( &lock );
+  chunks[key] = output;
+  fd = open ( file_name.c_str (), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+  result = fd >= 0;
+  if ( result )
+    {
+      flock ( fd, LOCK_EX );
+      result = write ( fd, line, line_length ) == line_length;
+      flock ( fd, LOCK_UN );
+      close ( fd );
+    }
+  pthread_mutex_unlock ( &lock );
+  return result;
+}
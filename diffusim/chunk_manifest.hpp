@@ -0,0 +1,64 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef CHUNK_MANIFEST
+#define CHUNK_MANIFEST
+
+#include <map>
+#include <pthread.h>
+#include <string>
+
+#include "content_hash.hpp"
+#include "task_list.hpp"
+
+// The chunks of a run that are done, so that an interrupted run can be
+// started again and compute only what is missing. Each line records a
+// chunk that completed:
+//
+//   chunk <key> <output hash> <task id> <output prefix>
+//
+// where the key hashes everything the result depends on: the contents
+// of the sample file, of its compartments file and of the shell,
+// waveform and gradient tables, the gradient, the other options of
+// the task (but the memory budget and the cache) and the program
+// itself; not the steps, which set only the time step of an exact
+// integration. A chunk is taken as done only if its key is
+// recorded and its outputs, one per shell and gradient, read back,
+// still have the recorded hash; anything else is computed again. Lines
+// are appended under a lock, by as many processes as there are, and the
+// last line for a key wins.
+class chunk_manifest
+{
+ public:
+  chunk_manifest  ();
+  ~chunk_manifest ();
+  bool load        ( const std::string& manifest_file_name, const std::string& program );
+  bool is_complete ( const synthesis_task& task );
+  bool record      ( const synthesis_task& task );
+ private:
+  std::string                   file_name;
+  hash_t                        program_hash;
+  std::map<hash_t, hash_t>      chunks;
+  std::map<std::string, hash_t> sample_hashes;
+  pthread_mutex_t               lock;
+  bool                          task_key    ( const synthesis_task& task, hash_t* key );
+  bool                          output_hash ( const synthesis_task& task, bool whole_files, hash_t* output );
+};
+
+#endif
@@ -17,5 +17,11 @@
 # Author can be reached at rborges@if.usp.br
 
 g++ -Wall -lmxml pretty.cpp b-value_calculation.cpp -o b-value_calculation.exe
-g++ -Wall -lmxml pretty.cpp mask_generator.cpp -o mask_generator.exe
-g++ -Wall pretty.cpp stejskal_clustered.cpp -o stejskal_clustered.exe
+g++ -Wall -I../processing -lmxml pretty.cpp volume.cpp ../processing/byte_order.cpp raw_io.cpp content_hash.cpp diffusion_model.cpp mask_generator.cpp -lpthread -o mask_generator.exe
+g++ -Wall -O2 pretty.cpp raw_io.cpp content_hash.cpp sequence.cpp waveform.cpp diffusion_model.cpp result_cache.cpp factor_table.cpp stejskal_clustered.cpp -lpthread -o stejskal_clustered.exe
+g++ -Wall raw_io.cpp merge_clustered.cpp -lpthread -o merge_clustered.exe
+g++ -Wall raw_io.cpp assemble_4d.cpp -lpthread -o assemble_4d.exe
+g++ -Wall -O2 raw_io.cpp content_hash.cpp sequence.cpp waveform.cpp diffusion_model.cpp result_cache.cpp task_list.cpp chunk_manifest.cpp local_scheduler.cpp -lpthread -o local_scheduler.exe
+g++ -Wall -O2 raw_io.cpp content_hash.cpp sequence.cpp waveform.cpp diffusion_model.cpp result_cache.cpp task_list.cpp chunk_manifest.cpp work_queue.cpp queue_coordinator.cpp -lpthread -o queue_coordinator.exe
+g++ -Wall -O2 raw_io.cpp content_hash.cpp sequence.cpp waveform.cpp diffusion_model.cpp result_cache.cpp task_list.cpp chunk_manifest.cpp work_queue.cpp queue_worker.cpp -lpthread -o queue_worker.exe
+g++ -Wall -O2 -I../processing ../processing/byte_order.cpp ../processing/block_io.cpp ../processing/pixel_conversion.cpp ../processing/nifti_writer.cpp ../processing/raw_to_nifti.cpp -lz -lpthread -o raw_to_nifti.exe
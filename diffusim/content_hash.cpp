@@ -0,0 +1,85 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "content_hash.hpp"
+#include "raw_io.hpp"
+
+using namespace std;
+
+hash_t fnv1a ( const void* data, offset_t length, hash_t hash )
+{
+  const unsigned char* bytes = static_cast<const unsigned char*> ( data );
+
+  for ( offset_t i = 0; i < length; i++ )
+    {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+    }
+  return hash;
+}
+
+hash_t fnv1a ( const string& text, hash_t hash )
+{
+  // the terminator too, so that "ab" "c" and "a" "bc" differ
+  return fnv1a ( text.c_str (), text.size () + 1, hash );
+}
+
+bool hash_file_range ( const string& file_name, offset_t offset, offset_t length, hash_t* hash )
+{
+  char*    buffer;
+  int      fd;
+  offset_t piece;
+  bool     result;
+
+  fd = open ( file_name.c_str (), O_RDONLY );
+  if ( fd < 0 )
+    return false;
+  if ( file_size ( fd ) < offset + length )
+    {
+      close ( fd );
+      return false;
+    }
+  buffer = new char[RAW_IO_BUFFER_SIZE];
+  result = true;
+  *hash  = FNV_OFFSET_BASIS;
+  for ( offset_t done = 0; done < length && result; done += piece )
+    {
+      piece = length - done < RAW_IO_BUFFER_SIZE ? length - done : RAW_IO_BUFFER_SIZE;
+      if ( read_at ( fd, buffer, piece, offset + done ) )
+	*hash = fnv1a ( buffer, piece, *hash );
+      else
+	result = false;
+    }
+  delete[] buffer;
+  close ( fd );
+  return result;
+}
+
+bool hash_file ( const string& file_name, hash_t* hash )
+{
+  offset_t size;
+
+  size = file_size ( file_name.c_str () );
+  if ( size < 0 )
+    return false;
+  return hash_file_range ( file_name, 0, size, hash );
+}
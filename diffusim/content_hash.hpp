@@ -0,0 +1,39 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef CONTENT_HASH
+#define CONTENT_HASH
+
+#include <string>
+
+#include "data_structures.hpp"
+
+typedef unsigned long long hash_t;
+
+// 64 bit FNV-1a; pass the result of one call as the start of the next
+// to hash data in pieces.
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+
+hash_t fnv1a           ( const void* data, offset_t length, hash_t hash = FNV_OFFSET_BASIS );
+hash_t fnv1a           ( const std::string& text, hash_t hash = FNV_OFFSET_BASIS );
+bool   hash_file_range ( const std::string& file_name, offset_t offset, offset_t length, hash_t* hash );
+bool   hash_file       ( const std::string& file_name, hash_t* hash );
+
+#endif
@@ -37,6 +37,9 @@ typedef struct
 
 typedef int signal_t;
 
+// byte offsets and sizes: 4D datasets easily go past 2 GiB
+typedef long long int offset_t;
+
 typedef struct
 {
   double    iso_adc;
@@ -0,0 +1,249 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cmath>
+#include <vector>
+
+#include "diffusion_model.hpp"
+
+using namespace std;
+
+bool diffusion_model_from_name ( const string& name, diffusion_model_type* model )
+{
+  if ( name == "principal" )
+    *model = principal_model;
+  else if ( name == "tensor" )
+    *model = tensor_model;
+  else if ( name == "compartments" )
+    *model = compartment_model;
+  else
+    return false;
+  return true;
+}
+
+void voxel_tensor ( const attributes& voxel, double* tensor )
+{
+  double    modulus;
+  double    axial;
+  double    radial;
+  double_3d p;
+
+  modulus = sqrt ( voxel.principal_direction.x * voxel.principal_direction.x +
+		   voxel.principal_direction.y * voxel.principal_direction.y +
+		   voxel.principal_direction.z * voxel.principal_direction.z );
+  if ( modulus == 0 || modulus != modulus )
+    {
+      for ( int i = 0; i < TENSOR_COMPONENTS; i++ )
+	tensor[i] = 0;
+      tensor[0] = voxel.iso_adc;
+      tensor[3] = voxel.iso_adc;
+      tensor[5] = voxel.iso_adc;
+      return;
+    }
+  p.x    = voxel.principal_direction.x / modulus;
+  p.y    = voxel.principal_direction.y / modulus;
+  p.z    = voxel.principal_direction.z / modulus;
+  axial  = 3 * voxel.iso_adc / ( 1 + 2 * voxel.transverse_ratio );
+  radial = voxel.transverse_ratio * axial;
+
+  tensor[0] = radial + ( axial - radial ) * p.x * p.x;
+  tensor[1] =          ( axial - radial ) * p.x * p.y;
+  tensor[2] =          ( axial - radial ) * p.x * p.z;
+  tensor[3] = radial + ( axial - radial ) * p.y * p.y;
+  tensor[4] =          ( axial - radial ) * p.y * p.z;
+  tensor[5] = radial + ( axial - radial ) * p.z * p.z;
+}
+
+void gradient_terms ( const double_3d& gradient, double* terms )
+{
+  double    modulus;
+  double_3d g;
+
+  modulus = sqrt ( gradient.x * gradient.x + gradient.y * gradient.y + gradient.z * gradient.z );
+  if ( modulus == 0 )
+    {
+      for ( int i = 0; i < TENSOR_COMPONENTS; i++ )
+	terms[i] = 0;
+      return;
+    }
+  g.x = gradient.x / modulus;
+  g.y = gradient.y / modulus;
+  g.z = gradient.z / modulus;
+
+  terms[0] = g.x * g.x;
+  terms[1] = 2 * g.x * g.y;
+  terms[2] = 2 * g.x * g.z;
+  terms[3] = g.y * g.y;
+  terms[4] = 2 * g.y * g.z;
+  terms[5] = g.z * g.z;
+}
+
+void tensor_diffusivities ( const double* tensors, offset_t voxels, const double* terms, int directions, double* diffusivities )
+{
+  double* row;
+
+  for ( int d = 0; d < directions; d++ )
+    {
+      row = diffusivities + d * voxels;
+      for ( offset_t v = 0; v < voxels; v++ )
+	row[v] = 0;
+      for ( int c = 0; c < TENSOR_COMPONENTS; c++ )
+	for ( offset_t v = 0; v < voxels; v++ )
+	  row[v] += terms[d * TENSOR_COMPONENTS + c] * tensors[c * voxels + v];
+    }
+}
+
+bool compartment_type_from_name ( const string& name, compartment_type* type )
+{
+  if ( name == "stick" )
+    *type = stick_compartment;
+  else if ( name == "zeppelin" )
+    *type = zeppelin_compartment;
+  else if ( name == "ball" )
+    *type = ball_compartment;
+  else
+    return false;
+  return true;
+}
+
+compartment make_compartment ( compartment_type type, double weight, const attributes& voxel )
+{
+  compartment result;
+  double      modulus;
+
+  modulus = sqrt ( voxel.principal_direction.x * voxel.principal_direction.x +
+		   voxel.principal_direction.y * voxel.principal_direction.y +
+		   voxel.principal_direction.z * voxel.principal_direction.z );
+  result.weight = weight;
+  // without a direction, only a ball makes sense
+  if ( modulus == 0 || modulus != modulus )
+    type = ball_compartment;
+  if ( type == ball_compartment )
+    {
+      result.direction.x = 0;
+      result.direction.y = 0;
+      result.direction.z = 1;
+      result.axial       = voxel.iso_adc;
+      result.radial      = voxel.iso_adc;
+      return result;
+    }
+  result.direction.x = voxel.principal_direction.x / modulus;
+  result.direction.y = voxel.principal_direction.y / modulus;
+  result.direction.z = voxel.principal_direction.z / modulus;
+  if ( type == stick_compartment )
+    {
+      result.axial  = 3 * voxel.iso_adc;
+      result.radial = 0;
+    }
+  else
+    {
+      result.axial  = 3 * voxel.iso_adc / ( 1 + 2 * voxel.transverse_ratio );
+      result.radial = voxel.transverse_ratio * result.axial;
+    }
+  return result;
+}
+
+void compartment_attenuations ( const compartment* pool, const unsigned char* counts, offset_t voxels, const double_3d* gradients, int directions, const double* coefficients, int shells, double* attenuations )
+{
+  double         modulus;
+  double         sum;
+  double         total;
+  double_3d      g;
+  offset_t       c;
+  offset_t       number_of_compartments;
+  double*        row;
+  vector<double> x;
+  vector<double> y;
+  vector<double> z;
+  vector<double> weight;
+  vector<double> radial;
+  vector<double> anisotropy;
+  vector<double> diffusivity;
+  vector<double> term;
+
+  number_of_compartments = 0;
+  for ( offset_t v = 0; v < voxels; v++ )
+    number_of_compartments += counts[v];
+  x.resize ( number_of_compartments + 1 );
+  y.resize ( number_of_compartments + 1 );
+  z.resize ( number_of_compartments + 1 );
+  weight.resize ( number_of_compartments + 1 );
+  radial.resize ( number_of_compartments + 1 );
+  anisotropy.resize ( number_of_compartments + 1 );
+  diffusivity.resize ( number_of_compartments + 1 );
+  term.resize ( number_of_compartments + 1 );
+
+  // component by component, with the weights of each voxel adding up
+  // to one
+  c = 0;
+  for ( offset_t v = 0; v < voxels; v++ )
+    {
+      total = 0;
+      for ( int k = 0; k < counts[v]; k++ )
+	total += pool[c + k].weight;
+      for ( int k = 0; k < counts[v]; k++, c++ )
+	{
+	  x[c]          = pool[c].direction.x;
+	  y[c]          = pool[c].direction.y;
+	  z[c]          = pool[c].direction.z;
+	  weight[c]     = total > 0 ? pool[c].weight / total : 1.0 / counts[v];
+	  radial[c]     = pool[c].radial;
+	  anisotropy[c] = pool[c].axial - pool[c].radial;
+	}
+    }
+
+  for ( int d = 0; d < directions; d++ )
+    {
+      modulus = sqrt ( gradients[d].x * gradients[d].x + gradients[d].y * gradients[d].y + gradients[d].z * gradients[d].z );
+      g.x = 0;
+      g.y = 0;
+      g.z = 0;
+      if ( modulus > 0 )
+	{
+	  g.x = gradients[d].x / modulus;
+	  g.y = gradients[d].y / modulus;
+	  g.z = gradients[d].z / modulus;
+	}
+      // g^T D g of a compartment: radial + ( axial - radial ) ( g . p )^2
+      for ( c = 0; c < number_of_compartments; c++ )
+	{
+	  sum            = g.x * x[c] + g.y * y[c] + g.z * z[c];
+	  diffusivity[c] = radial[c] + anisotropy[c] * sum * sum;
+	}
+      for ( int s = 0; s < shells; s++ )
+	{
+	  for ( c = 0; c < number_of_compartments; c++ )
+	    term[c] = weight[c] * exp ( coefficients[s] * diffusivity[c] );
+	  row = attenuations + ( static_cast<offset_t> ( s ) * directions + d ) * voxels;
+	  c = 0;
+	  for ( offset_t v = 0; v < voxels; v++ )
+	    {
+	      if ( counts[v] == 0 )
+		{
+		  row[v] = 1;
+		  continue;
+		}
+	      sum = 0;
+	      for ( int k = 0; k < counts[v]; k++, c++ )
+		sum += term[c];
+	      row[v] = sum;
+	    }
+	}
+    }
+}
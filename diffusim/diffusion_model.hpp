@@ -0,0 +1,107 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef DIFFUSION_MODEL
+#define DIFFUSION_MODEL
+
+#include <string>
+
+#include "data_structures.hpp"
+
+// How the effective diffusion coefficient of a voxel along a gradient
+// follows from its attributes:
+//
+//   principal  E . P + |E| |P| transverse_ratio sin ( angle ( E, P ) ),
+//              one gradient at a time (the original model);
+//   tensor     g^T D g, for the unit gradient g, with the tensor
+//
+//     D = radial I + ( axial - radial ) p p^T
+//
+//   of the unit principal direction p, where radial = transverse_ratio
+//   * axial and the mean diffusivity, ( axial + 2 radial ) / 3, is
+//   iso_adc. Voxels without a principal direction are isotropic;
+//   compartments  the weighted sum of the attenuations of the
+//   compartments of the voxel, each a tensor of its own, read from the
+//   compartments file of the sample (see below).
+enum diffusion_model_type { principal_model = 0,
+			    tensor_model,
+			    compartment_model };
+
+bool diffusion_model_from_name ( const std::string& name, diffusion_model_type* model );
+
+// The six unique components of a symmetric tensor, in the order
+//   xx xy xz yy yz zz
+#define TENSOR_COMPONENTS 6
+
+void voxel_tensor         ( const attributes& voxel, double* tensor );
+
+// g^T D g = terms . tensor, where the terms of the unit gradient are
+//   gx^2 2gxgy 2gxgz gy^2 2gygz gz^2
+void gradient_terms       ( const double_3d& gradient, double* terms );
+
+// The diffusivities of a block of voxels along a set of gradients, in
+// one product of the ( directions x 6 ) terms by the ( 6 x voxels )
+// tensors, tensors[component * voxels + voxel], into
+// diffusivities[direction * voxels + voxel]. The inner loop runs along
+// the voxels, so that it vectorizes.
+void tensor_diffusivities ( const double* tensors, offset_t voxels, const double* terms, int directions, double* diffusivities );
+
+// A voxel can hold up to COMPARTMENT_CAPACITY compartments, one for
+// each object that overlaps there (see mask_generator -compartments):
+//
+//   stick     diffusion along the direction only;
+//   zeppelin  the tensor of the tensor model;
+//   ball      isotropic, iso_adc in every direction.
+//
+// All of them have iso_adc as mean diffusivity. The compartments file of
+// a plane holds a count per voxel, then the compartments of every voxel
+// in turn, packed:
+//
+//   [unsigned char count x voxels][compartment x sum of the counts]
+//
+// The attenuation of a voxel is the sum of those of its compartments,
+// weighted by their volume fractions; a voxel without compartments is
+// not attenuated.
+#define COMPARTMENT_CAPACITY 4
+
+enum compartment_type { stick_compartment = 0,
+			zeppelin_compartment,
+			ball_compartment };
+
+typedef struct
+{
+  double_3d direction;          // unit
+  double    weight;             // volume fraction, relative to the others in the voxel
+  double    axial;              // m^2/second, along the direction
+  double    radial;             // m^2/second, across it
+} compartment;
+
+bool        compartment_type_from_name ( const std::string& name, compartment_type* type );
+compartment make_compartment           ( compartment_type type, double weight, const attributes& voxel );
+
+// The attenuations of a block of voxels from their compartments, for
+// every shell and gradient, into
+// attenuations[( shell * directions + direction ) * voxels + voxel],
+// where the coefficient of a shell is - gamma^2 times its integral (so
+// that a compartment attenuates by exp ( coefficient * g^T D g )). The
+// compartments are laid out component by component first, and every
+// loop over them then runs along a plain array, so that it vectorizes.
+void compartment_attenuations ( const compartment* pool, const unsigned char* counts, offset_t voxels, const double_3d* gradients, int directions, const double* coefficients, int shells, double* attenuations );
+
+#endif
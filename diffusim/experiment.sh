@@ -27,16 +27,30 @@ PARAMETERS:
 \t -c name of file containg cluster information for computing slices in parallel
 \t -d number of gradient directions (*)
 \t -e experiment_name (*)
+\t -f write results directly into the final 4D file, without a merge stage
+\t -g shell table: synthesize every shell it lists in one pass (see sequence.hpp; implies -f)
+\t -i incremental: update the last run of this experiment, redoing only the planes the scene changes touch (implies -f)
+\t -k directory of the results cache shared by experiments (default: ~/diffusim_cache, none to disable)
+\t -m memory budget in MB for each process
+\t -p gradient waveform file (see waveform.hpp; default: the pulse pair of sequence.cpp)
+\t -r resume an interrupted run, computing only the chunks it had not done
 \t -s number of slices (*)
 \t -t number of steps per second (*)
 \t -u direction uncertainty percentage
+\t -w number of processes to run at once in local mode (default: one per core)
+\t -x diffusion model: principal (default), or tensor or compartments, all the directions of a slice at once (see diffusion_model.hpp; implies -f)
 (*) Indicates an obligatory option.
 EOF
 )
 
 direction_uncertainty_percentage=0
+memory_budget=512
+direct_output=0
+resume=0
+incremental=0
+cache_directory=~/diffusim_cache
 
-while getopts "c:d:e:s:t:u:" OPTION; do
+while getopts "c:d:e:fg:ik:m:p:rs:t:u:w:x:" OPTION; do
     case $OPTION in
 	c)  cluster_info=$OPTARG
 	    ;;
@@ -44,12 +58,36 @@ while getopts "c:d:e:s:t:u:" OPTION; do
 	    ;;
 	e)  experiment_name=$OPTARG
 	    ;;
+	f)  direct_output=1
+	    ;;
+	g)  shell_table=`readlink -f $OPTARG`
+	    direct_output=1
+	    ;;
+	i)  incremental=1
+	    resume=1
+	    direct_output=1
+	    ;;
+	k)  cache_directory=$OPTARG
+	    ;;
+	m)  memory_budget=$OPTARG
+	    ;;
+	p)  waveform=`readlink -f $OPTARG`
+	    ;;
+	r)  resume=1
+	    ;;
 	s)  slices=$OPTARG
 	    ;;
 	t)  steps_per_second=$OPTARG
 	    ;;
 	u)  direction_uncertainty_percentage=$OPTARG
 	    ;;
+	w)  workers=$OPTARG
+	    ;;
+	x)  model=$OPTARG
+	    if [ ! "$model" == "principal" ]; then
+		direct_output=1
+	    fi
+	    ;;
 	*) 
 	    echo "Unrecognized option."
 	    echo -e "$usage"
@@ -74,26 +112,90 @@ if [ ! "$cluster_info" == "" ]; then
     cluster_host=`grep cluster_host $cluster_info | sed 's/^.*cluster_host.*=//'`
 fi
 
-if [ -e ~/latest/$experiment_name ]; then
+if [ $resume -eq 0 ] && [ -e ~/latest/$experiment_name ]; then
     rm -rf ~/latest/$experiment_name
 fi
+# an incremental run starts from the results of the last one
+if [ $incremental -eq 1 ] && [ ! -e ~/latest/$experiment_name ] && [ -e $source/$experiment_name ]; then
+    mkdir -p ~/latest
+    mv $source/$experiment_name ~/latest/
+fi
 
 mkdir -p ~/latest/$experiment_name
 cd ~/latest/$experiment_name
 
-cp $source/$experiment_name.xml .
-cp $source/b0.raw .
-cp $source/mask_generator.exe .
+# when resuming, the sample is kept if it was generated from the same
+# inputs; every chunk recorded in chunks.manifest (see chunk_manifest.hpp)
+# whose output is intact is then skipped. An incremental run generates
+# only the planes that the changes in the scene reach (see
+# compiled_scene.txt), and keeps the manifest: chunks whose planes did
+# not change are skipped, the others patched into the 4D file.
+# the compartment model needs the compartments of the objects that
+# overlap in each voxel, written next to the sample
+compartment_options=""
+if [ "$model" == "compartments" ]; then
+    compartment_options="-compartments"
+fi
+mask_inputs="`cat $source/$experiment_name.xml $source/b0.raw | cksum` $direction_uncertainty_percentage $compartment_options"
+if [ $resume -eq 1 ] && [ -e mask_generator.done ] && [ "`cat mask_generator.done`" == "$mask_inputs" ]; then
+    echo "Resuming with the sample generated before."
+else
+    rm -f mask_generator.done
+    incremental_options=""
+    if [ $incremental -eq 1 ]; then
+	incremental_options="-incremental"
+    else
+	rm -f chunks.manifest
+    fi
+
+    cp $source/$experiment_name.xml .
+    cp $source/b0.raw .
+    cp $source/mask_generator.exe .
+
+    ./mask_generator.exe b0.raw $experiment_name.xml $direction_uncertainty_percentage -memory $memory_budget $incremental_options $compartment_options
+    if [ ! $? -eq 0 ]; then
+	echo "ERROR: mask_generator failed."
+	exit 1
+    fi
+    echo "$mask_inputs" > mask_generator.done
+
+    rm $experiment_name.xml
+    rm b0.raw
+    rm mask_generator.exe
+    rm -f mask_x.raw
+    rm -f mask_y.raw
+    rm -f mask_z.raw
+fi
 
-./mask_generator.exe b0.raw $experiment_name.xml $direction_uncertainty_percentage
+# in direct mode every chunk is written at its offset in this file:
+# [b0][direction 0: slice 0 .. slice n-1][direction 1: ...]...
+# and with a shell table, the directions of each shell in turn
+synthetic_file=${experiment_name}_synthetic.raw
+b0_size=`stat -c %s $source/000_merged.raw`
+direct_options=""
+if [ $direct_output -eq 1 ]; then
+    direct_options="-b $b0_size -d $gradient_directions"
+fi
+shells=1
+if [ -n "$shell_table" ]; then
+    cp $shell_table shells.txt
+    shells=`grep -c -E '^[[:space:]]*(b|gradient)[[:space:]]' shells.txt`
+    direct_options="$direct_options -g shells.txt"
+fi
+if [ -n "$waveform" ]; then
+    cp $waveform waveform.txt
+    direct_options="$direct_options -p waveform.txt"
+fi
+if [ -n "$model" ]; then
+    direct_options="$direct_options -x $model"
+fi
 
-rm $experiment_name.xml
-rm b0.raw
-rm buffer.raw
-rm mask_generator.exe
-rm mask_x.raw
-rm mask_y.raw
-rm mask_z.raw
+# slices computed by earlier experiments, with the same gradient and
+# sequence, are copied from the cache (see result_cache.hpp)
+cache_options=""
+if [ ! "$cache_directory" == "none" ]; then
+    cache_options="-cache $cache_directory"
+fi
 
 cp $source/batch_wrapper.sh .
 cp $source/directions.txt .
@@ -101,10 +203,26 @@ cp $source/job.sh .
 cp $source/job_wrapper.sh .
 cp $source/stejskal_clustered.exe .
 cp $source/stejskal_clustered.sh .
+cp $source/write_task_list.sh .
+
+# in direct mode the 4D file is created whole, b0 included, before any
+# task runs (see prepare_4d.sh); on the cluster, by batch_wrapper.sh
+if [ $direct_output -eq 1 ]; then
+    cp $source/000_merged.raw .
+    cp $source/assemble_4d.exe .
+    cp $source/prepare_4d.sh .
+fi
 
 if [ $clusterize -eq 1 ]; then
     echo "Running in clusterized mode."
-    echo -e "#!/bin/bash\ncd ~/latest/$experiment_name\n./batch_wrapper.sh -e $experiment_name -s $slices -t $steps_per_second \necho 'Press enter after all jobs have run.'\nread\nmv ~/latest/*.raw ~/latest/$experiment_name/\ncat job.sh.e*\necho 'Press enter if no errors or no important errors.'\nread\nrm job.sh.*" > run_me_on_cluster.sh
+    cp $source/queue_coordinator.exe .
+    cp $source/queue_worker.exe .
+    # on the cluster, the default cache is in the home directory there
+    cluster_cache_directory=$cache_directory
+    if [ "$cache_directory" == ~/diffusim_cache ]; then
+	cluster_cache_directory='$HOME/diffusim_cache'
+    fi
+    echo -e "#!/bin/bash\ncd ~/latest/$experiment_name\n./batch_wrapper.sh -e $experiment_name -s $slices -t $steps_per_second -m $memory_budget -k $cluster_cache_directory $direct_options\ncat job.sh.e*\necho 'Press enter if no errors or no important errors.'\nread\nrm job.sh.*" > run_me_on_cluster.sh
     chmod 700 run_me_on_cluster.sh
     
     rsync -avz ~/latest/$experiment_name/ $cluster_host:latest/$experiment_name/
@@ -117,55 +235,57 @@ if [ $clusterize -eq 1 ]; then
     rm stejskal_clustered.exe
     rm stejskal_clustered.sh
     rm run_me_on_cluster.sh
+    rm queue_coordinator.exe
+    rm queue_worker.exe
+    rm -rf queue
 else
-    echo "Running in local, single mode."
-    slice0_time_start=`date +"%s"`
-    slice0_time_end=0
-    slices_times_dirs_to_go=$(($gradient_directions * $slices))
-    sample_files=`ls -1 --color=never sample_adc*.bin | sed 's/^.*\///'`
-    for sample in $sample_files; do
-	number=`echo $sample | sed 's/sample_adc_z//' | sed 's/.bin//'`
-	while read line; do
-	    if [ ! $slice0_time_end -eq 0 ]; then
-		seconds_to_go=$(($slices_times_dirs_to_go * $time_cost))
-		hours_to_go=$(($seconds_to_go / 3600))
-		seconds_to_go=$(($seconds_to_go % 3600))
-		minutes_to_go=$(($seconds_to_go / 60))
-		seconds_to_go=$(($seconds_to_go % 60))
-		printf "ETA for $slices_times_dirs_to_go chunks: %02d:%02d:%02d. " $hours_to_go $minutes_to_go $seconds_to_go
-	    fi
-	    grad_x=`echo $line | awk '{ print $1 }'`
-	    grad_y=`echo $line | awk '{ print $2 }'`
-	    grad_z=`echo $line | awk '{ print $3 }'`
-	    echo "Synthesizing slice $number of direction $grad_x $grad_y $grad_z."
-	    ./stejskal_clustered.sh -i $sample -o ${experiment_name}_${number}_${grad_x}_${grad_y}_${grad_z} -x $grad_x -y $grad_y -z $grad_z -s $steps_per_second
-	    if [ $slice0_time_end -eq 0 ]; then
-		slice0_time_end=`date +"%s"`
-		time_cost=$(($slice0_time_end - $slice0_time_start))
-		if [ $time_cost -eq 0 ]; then
-		    time_cost=1
-		fi
-	    fi
-	    slices_times_dirs_to_go=$(($slices_times_dirs_to_go - 1))
-	done < directions.txt
-    done
+    echo "Running in local mode."
+    # one task per slice and direction, run by local_scheduler.exe on
+    # all cores, heaviest slices first
+    cp $source/local_scheduler.exe .
+    if [ $direct_output -eq 1 ]; then
+	./prepare_4d.sh -d $(($gradient_directions * $shells)) -s $slices -o $synthetic_file || exit 1
+    fi
+    ./write_task_list.sh -e $experiment_name -t $steps_per_second -m $memory_budget -o tasks.txt $direct_options -s $slices
+    worker_options=""
+    if [ -n "$workers" ]; then
+	worker_options="-workers $workers"
+    fi
+    ./local_scheduler.exe tasks.txt $worker_options -log synthesis.log -manifest chunks.manifest $cache_options
+    if [ ! $? -eq 0 ]; then
+	echo "ERROR: some chunks failed, see synthesis.log."
+	exit 1
+    fi
+    rm local_scheduler.exe
+    rm tasks.txt
 fi
 
 cp $source/000_merged.raw .
 cp $source/directions.dat .
-cp $source/merge_clustered.exe .
+cp $source/assemble_4d.exe .
 cp $source/merge_wrapper.sh .
+cp $source/raw_to_nifti.exe .
+
+# the sample planes stay with the results: the next incremental run
+# compares its planes with these
+if [ $direct_output -eq 0 ]; then
+    ./merge_wrapper.sh -d $gradient_directions -n $experiment_name -s $slices
+fi
 
-./merge_wrapper.sh -d $gradient_directions -n $experiment_name -s $slices
+# the same data with a NIfTI header: signal_t voxels, b0 volumes first
+size_x=`awk '/^size_x/ { print $2 }' sample_dimensions.txt`
+size_y=`awk '/^size_y/ { print $2 }' sample_dimensions.txt`
+b0_volumes=$(($b0_size / ($size_x * $size_y * $slices * 4)))
+./raw_to_nifti.exe $synthetic_file ${experiment_name}_synthetic.nii.gz $size_x $size_y $slices $(($b0_volumes + $shells * $gradient_directions)) int32
 
 echo "Press ENTER to cleanup local temporary directory."
 read
 rm 000_merged.raw
-rm 001_merged.raw
-rm -rf adc_files
-rm -rf components
-rm -rf dir_files
-rm merge_clustered.exe
+rm -f ${experiment_name}_???_*_att.raw
+rm assemble_4d.exe
+rm raw_to_nifti.exe
+rm -f manifest.txt
+rm -f prepare_4d.sh
 rm merge_wrapper.sh
 
 if [ -e $source/$experiment_name ]; then
@@ -0,0 +1,272 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "factor_table.hpp"
+#include "raw_io.hpp"
+
+using namespace std;
+
+#define FACTOR_TABLE_HEADER 32
+#define FACTOR_TABLE_SIZE   ( FACTOR_TABLE_HEADER + FACTOR_TABLE_SLOTS * sizeof ( factor_entry ) )
+
+// the attributes a factor depends on, compared bit by bit so that NaN
+// attributes find themselves too
+static void voxel_entry ( const attributes& voxel, factor_entry* entry )
+{
+  entry->principal_direction[0] = voxel.principal_direction.x;
+  entry->principal_direction[1] = voxel.principal_direction.y;
+  entry->principal_direction[2] = voxel.principal_direction.z;
+  entry->transverse_ratio       = voxel.transverse_ratio;
+}
+
+static bool same_attributes ( const factor_entry& left, const factor_entry& right )
+{
+  return memcmp ( left.principal_direction, right.principal_direction, sizeof ( left.principal_direction ) ) == 0 &&
+    memcmp ( &left.transverse_ratio, &right.transverse_ratio, sizeof ( left.transverse_ratio ) ) == 0;
+}
+
+static hash_t attributes_hash ( const factor_entry& entry )
+{
+  hash_t hash;
+
+  hash = fnv1a ( entry.principal_direction, sizeof ( entry.principal_direction ) );
+  return fnv1a ( &entry.transverse_ratio, sizeof ( entry.transverse_ratio ), hash );
+}
+
+// the first of the slots an entry can go in
+static offset_t home_slot ( const factor_entry& entry )
+{
+  return attributes_hash ( entry ) % ( FACTOR_TABLE_SLOTS - FACTOR_TABLE_PROBES + 1 );
+}
+
+// never 0, so that an empty slot never checks
+static hash_t entry_check ( const factor_entry& entry )
+{
+  hash_t check;
+
+  check = fnv1a ( &entry, offsetof ( factor_entry, check ) );
+  return check == 0 ? 1 : check;
+}
+
+void recurring_voxels ( const attributes* voxels, offset_t number_of_voxels, vector<bool>* recurring )
+{
+  factor_entry                    left;
+  factor_entry                    right;
+  vector<pair<hash_t, offset_t> > order;
+
+  // voxels with the same attributes end up next to one another; two
+  // sets of attributes with the same hash may interleave, which only
+  // leaves some of their voxels out
+  recurring->assign ( number_of_voxels, false );
+  for ( offset_t voxel = 0; voxel < number_of_voxels; voxel++ )
+    {
+      voxel_entry ( voxels[voxel], &left );
+      order.push_back ( make_pair ( attributes_hash ( left ), voxel ) );
+    }
+  sort ( order.begin (), order.end () );
+  for ( offset_t i = 1; i < number_of_voxels; i++ )
+    {
+      if ( order[i].first != order[i - 1].first )
+	continue;
+      voxel_entry ( voxels[order[i - 1].second], &left );
+      voxel_entry ( voxels[order[i].second], &right );
+      if ( same_attributes ( left, right ) )
+	{
+	  ( *recurring )[order[i - 1].second] = true;
+	  ( *recurring )[order[i].second]     = true;
+	}
+    }
+}
+
+factor_table::factor_table ()
+{
+  fd       = -1;
+  slots    = NULL;
+  inserted = 0;
+}
+
+factor_table::~factor_table ()
+{
+  if ( slots != NULL )
+    munmap ( reinterpret_cast<char*> ( slots ) - FACTOR_TABLE_HEADER, FACTOR_TABLE_SIZE );
+  if ( fd >= 0 )
+    close ( fd );
+}
+
+bool factor_table::open ( const string& table_directory, hash_t key )
+{
+  char         header[FACTOR_TABLE_HEADER];
+  char         name[32];
+  bool         result;
+  unsigned int number_of_slots;
+  offset_t     size;
+
+  if ( mkdir ( table_directory.c_str (), 0755 ) != 0 && errno != EEXIST )
+    return false;
+  snprintf ( name, sizeof ( name ), "%016llx", key );
+  file_name = table_directory + "/" + name + ".factors";
+  fd = ::open ( file_name.c_str (), O_RDWR | O_CREAT, 0644 );
+  if ( fd < 0 )
+    return false;
+
+  // the first process to get here creates the whole table
+  memset ( header, 0, sizeof ( header ) );
+  memcpy ( header, FACTOR_TABLE_MAGIC, 8 );
+  memcpy ( header + 8, &key, sizeof ( key ) );
+  number_of_slots = FACTOR_TABLE_SLOTS;
+  memcpy ( header + 16, &number_of_slots, sizeof ( number_of_slots ) );
+  flock ( fd, LOCK_EX );
+  size = file_size ( fd );
+  if ( size == 0 )
+    result = write_at ( fd, header, sizeof ( header ), 0 ) && ftruncate ( fd, FACTOR_TABLE_SIZE ) == 0;
+  else
+    {
+      char existing[FACTOR_TABLE_HEADER];
+
+      result = size == static_cast<offset_t> ( FACTOR_TABLE_SIZE ) &&
+	read_at ( fd, existing, sizeof ( existing ), 0 ) && memcmp ( existing, header, sizeof ( header ) ) == 0;
+    }
+  flock ( fd, LOCK_UN );
+  if ( ! result || ! map () )
+    {
+      close ( fd );
+      fd = -1;
+      return false;
+    }
+  return true;
+}
+
+// the table file, read only, or without one memory of this process
+bool factor_table::map ( void )
+{
+  void* mapping;
+
+  if ( fd >= 0 )
+    mapping = mmap ( NULL, FACTOR_TABLE_SIZE, PROT_READ, MAP_SHARED, fd, 0 );
+  else
+    mapping = mmap ( NULL, FACTOR_TABLE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if ( mapping == MAP_FAILED )
+    return false;
+  slots = reinterpret_cast<factor_entry*> ( static_cast<char*> ( mapping ) + FACTOR_TABLE_HEADER );
+  return true;
+}
+
+bool factor_table::lookup ( const attributes& voxel, double* factor )
+{
+  factor_entry entry;
+  factor_entry found;
+  offset_t     home;
+
+  if ( slots == NULL )
+    return false;
+  voxel_entry ( voxel, &entry );
+  home = home_slot ( entry );
+  for ( offset_t slot = home; slot < home + FACTOR_TABLE_PROBES; slot++ )
+    {
+      found = slots[slot];
+      if ( same_attributes ( found, entry ) && found.check == entry_check ( found ) )
+	{
+	  *factor = found.factor;
+	  return true;
+	}
+    }
+  return false;
+}
+
+bool factor_table::insert ( const attributes& voxel, double factor )
+{
+  factor_entry probed[FACTOR_TABLE_PROBES];
+  factor_entry entry;
+  offset_t     home;
+  offset_t     slot;
+  bool         result;
+
+  if ( slots == NULL && ! map () )
+    return false;
+  voxel_entry ( voxel, &entry );
+  entry.factor = factor;
+  entry.check  = entry_check ( entry );
+  home = home_slot ( entry );
+
+  // the slots are probed again in the file, where the writes of the
+  // other processes have all landed
+  if ( fd >= 0 )
+    {
+      flock ( fd, LOCK_EX );
+      result = read_at ( fd, probed, sizeof ( probed ), FACTOR_TABLE_HEADER + home * sizeof ( factor_entry ) );
+    }
+  else
+    {
+      memcpy ( probed, slots + home, sizeof ( probed ) );
+      result = true;
+    }
+  for ( slot = 0; result && slot < FACTOR_TABLE_PROBES; slot++ )
+    if ( probed[slot].check != entry_check ( probed[slot] ) || same_attributes ( probed[slot], entry ) )
+      break;
+  // when every slot is taken the factor is just not kept
+  if ( result && slot < FACTOR_TABLE_PROBES && probed[slot].check != entry_check ( probed[slot] ) )
+    {
+      if ( fd >= 0 )
+	result = write_at ( fd, &entry, sizeof ( entry ), FACTOR_TABLE_HEADER + ( home + slot ) * sizeof ( entry ) );
+      else
+	slots[home + slot] = entry;
+      if ( result )
+	inserted++;
+    }
+  if ( fd >= 0 )
+    flock ( fd, LOCK_UN );
+  // from then on, the factors are kept for this process only
+  if ( ! result )
+    {
+      munmap ( reinterpret_cast<char*> ( slots ) - FACTOR_TABLE_HEADER, FACTOR_TABLE_SIZE );
+      slots = NULL;
+      close ( fd );
+      fd = -1;
+    }
+  return result;
+}
+
+offset_t factor_table::size ( void )
+{
+  offset_t used;
+
+  used = 0;
+  if ( slots != NULL )
+    for ( offset_t slot = 0; slot < FACTOR_TABLE_SLOTS; slot++ )
+      if ( slots[slot].check == entry_check ( slots[slot] ) )
+	used++;
+  return used;
+}
+
+offset_t factor_table::added ( void )
+{
+  return inserted;
+}
@@ -0,0 +1,84 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef FACTOR_TABLE
+#define FACTOR_TABLE
+
+#include <string>
+#include <vector>
+
+#include "content_hash.hpp"
+#include "data_structures.hpp"
+
+// The attenuation factor, exp ( attenuation ), depends only on the
+// diffusion of a voxel once the sequence and the gradient are fixed,
+// and tissues repeat the same few diffusion attributes over and over.
+// A factor table keeps those factors in a file, one per sequence and
+// gradient (see hash_sequence), shared by every slice and every run:
+//
+//   <table directory>/<key>.factors
+//
+// A 32 byte header (FACTOR_TABLE_MAGIC, the key and the number of
+// slots) is followed by FACTOR_TABLE_SLOTS factor_entry slots, an open
+// addressed hash table of fixed size: the first process creates the
+// file whole, and every process maps it and probes it in place, so
+// that the factors written by the others are seen as soon as they land
+// and no process keeps a copy. A factor goes in the first empty slot of
+// the FACTOR_TABLE_PROBES that follow the hash of its attributes,
+// written under an exclusive flock; when they are all taken it is not
+// kept, which bounds the file. Each slot carries a check of its
+// contents, so a slot being written is read as empty.
+#define FACTOR_TABLE_MAGIC  "DSFACT02"
+#define FACTOR_TABLE_SLOTS  4096
+#define FACTOR_TABLE_PROBES 16
+
+typedef struct
+{
+  double principal_direction[3];
+  double transverse_ratio;
+  double factor;
+  hash_t check;
+} factor_entry;
+
+// Marks the voxels whose attributes another voxel of the same block
+// shares. The others are left out of the table: a direction drawn at
+// random for an isotropic object, or fudged by the uncertainty, is
+// unique to its voxel and would only fill the slots.
+void recurring_voxels ( const attributes* voxels, offset_t number_of_voxels, std::vector<bool>* recurring );
+
+class factor_table
+{
+ public:
+  factor_table  ();
+  ~factor_table ();
+  // without a table file, factors are only kept for this process
+  bool     open   ( const std::string& table_directory, hash_t key );
+  bool     lookup ( const attributes& voxel, double* factor );
+  bool     insert ( const attributes& voxel, double factor );
+  offset_t size   ( void );
+  offset_t added  ( void );
+ private:
+  std::string   file_name;
+  int           fd;
+  factor_entry* slots;
+  offset_t      inserted;
+  bool          map     ( void );
+};
+
+#endif
@@ -18,32 +18,11 @@
 #
 # Author can be reached at rborges@if.usp.br
 
-mkdir /tmp/$$
-cd /tmp/$$
-number=`echo $slice | awk '{ printf ("%03d", $1) }'`
-sample=`ls -1 --color=never /sampa/home/rborges/latest/$batch/sample_adc_z$number.bin | sed 's/^.*\///'`
-if [ ! -e /tmp/$$/$sample ]; then
-    cp /sampa/home/rborges/latest/$batch/$sample .
-fi
-if [ ! -e stejskal_clustered.exe ]; then
-    cp /sampa/home/rborges/latest/$batch/stejskal_clustered.exe .
-fi
-if [ ! -e stejskal_clustered.sh ]; then
-    cp /sampa/home/rborges/latest/$batch/stejskal_clustered.sh .
-fi
-if [ ! -e directions.txt ]; then
-    cp /sampa/home/rborges/latest/$batch/directions.txt .
-fi
+# A worker of the queue in the experiment directory: it leases
+# slice x direction tasks and runs them until there are none left.
+# The results are written in place, into their own files or straight
+# into the shared 4D file.
+cd /sampa/home/rborges/latest/$batch
+./queue_worker.exe queue -program ./stejskal_clustered.exe -log synthesis_$worker.log -manifest chunks.manifest
 
-# calculations
-while read line; do
-    grad_x=`echo $line | awk '{ print $1 }'`
-    grad_y=`echo $line | awk '{ print $2 }'`
-    grad_z=`echo $line | awk '{ print $3 }'`
-    /tmp/$$/stejskal_clustered.sh -i $sample -o ${batch}_${number}_${grad_x}_${grad_y}_${grad_z} -x $grad_x -y $grad_y -z $grad_z -s $steps_per_second
-    mv *.raw /sampa/home/rborges/latest
-done < /tmp/$$/directions.txt
-
-# cleanup
-rm -rf /tmp/$$
 exit 0
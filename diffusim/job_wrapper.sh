@@ -22,16 +22,15 @@ if [ -z "$2" ]; then
     echo "You must give a name for this project!"
     exit 1
 fi
-slice=$1
+worker=$1
 batch=$2
-steps_per_second=$3
 
-echo "Submitting job for slice $slice."
+echo "Submitting worker $worker."
 cd ~/latest/$batch
 
 test=1
 while [ ! $test -eq 0 ]; do
-    qsub -q griper -v batch=$batch,slice=$slice,steps_per_second=$steps_per_second /sampa/home/rborges/latest/$batch/job.sh >> qsub_output.txt
+    qsub -q griper -v batch=$batch,worker=$worker /sampa/home/rborges/latest/$batch/job.sh >> qsub_output.txt
     test=$?
     if [ ! $test -eq 0 ]; then
 	sleep 1
@@ -0,0 +1,357 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "chunk_manifest.hpp"
+#include "data_structures.hpp"
+#include "task_list.hpp"
+
+using namespace std;
+
+// Runs a task list (see task_list.hpp) on this machine, one task per
+// worker at a time, each task a process of its own. The tasks are
+// weighed by the tissue voxels of their slice and dealt heaviest first
+// to the least loaded worker; a worker takes from the front of its own
+// queue and, once it is empty, steals from the back of the queue with
+// the most work left, so that slices with more tissue do not leave
+// the other cores idle at the end. The throughput and the ETA are
+// measured in tissue voxels, so they hold whatever the order.
+//
+// With -manifest, chunks recorded there whose output is intact are
+// skipped, and every chunk that completes is recorded, so that a run
+// that was interrupted can be started again where it stopped. With
+// -cache, chunks computed before by any experiment are copied from the
+// cache (see result_cache.hpp), and those computed now are added to it.
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  deque<int>      tasks;
+  offset_t        weight;
+} task_queue;
+
+typedef struct
+{
+  pthread_mutex_t         lock;
+  vector<synthesis_task>* tasks;
+  vector<task_queue>*     queues;
+  string                  program;
+  string                  log_file;
+  chunk_manifest*         manifest;
+  unsigned int            done;
+  unsigned int            failed;
+  offset_t                done_weight;
+  offset_t                total_weight;
+} scheduler_state;
+
+typedef struct
+{
+  unsigned int     worker;
+  scheduler_state* state;
+} worker_job;
+
+// orders task indices heaviest first
+class heavier_task
+{
+ public:
+  heavier_task ( const vector<synthesis_task>& task_list ) : tasks ( task_list ) {}
+  bool operator() ( int left, int right ) const { return tasks[left].weight > tasks[right].weight; }
+ private:
+  const vector<synthesis_task>& tasks;
+};
+
+double elapsed_seconds ( const struct timeval& start );
+bool   next_task       ( scheduler_state* state, unsigned int worker, int* task );
+void*  worker_thread   ( void* argument );
+
+int main (int argc, char** argv)
+{
+  char                   line[256];
+  chunk_manifest         manifest;
+  double                 elapsed;
+  result_cache           cache;
+  double                 rate;
+  offset_t               eta;
+  pthread_t*             workers;
+  scheduler_state        state;
+  string                 cache_directory;
+  string                 manifest_file_name;
+  string                 task_file_name;
+  struct timeval         start;
+  unsigned int           cached;
+  unsigned int           least_loaded;
+  unsigned int           number_of_workers;
+  unsigned int           done;
+  vector<int>            order;
+  vector<synthesis_task> all_tasks;
+  vector<synthesis_task> tasks;
+  vector<task_queue>     queues;
+  vector<worker_job>     jobs;
+
+  if ( argc < 2 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " task_list_file_name [-workers number_of_workers] [-program ./stejskal_clustered.exe] [-log log_file_name] [-manifest manifest_file_name] [-cache cache_directory]" << endl;
+      exit (1);
+    }
+  task_file_name    = argv[1];
+  number_of_workers = sysconf ( _SC_NPROCESSORS_ONLN );
+  state.program     = "./stejskal_clustered.exe";
+  state.log_file    = "";
+  for ( int i = 2; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-workers" )
+	number_of_workers = atoi ( argv[++i] );
+      else if ( string ( argv[i] ) == "-program" )
+	state.program = argv[++i];
+      else if ( string ( argv[i] ) == "-log" )
+	state.log_file = argv[++i];
+      else if ( string ( argv[i] ) == "-manifest" )
+	manifest_file_name = argv[++i];
+      else if ( string ( argv[i] ) == "-cache" )
+	cache_directory = argv[++i];
+    }
+  if ( number_of_workers < 1 )
+    number_of_workers = 1;
+
+  if ( ! read_task_list ( task_file_name, all_tasks ) )
+    {
+      cout << "ERROR reading task list " << task_file_name << "." << endl;
+      exit (1);
+    }
+  state.manifest = NULL;
+  if ( manifest_file_name != "" )
+    {
+      if ( ! manifest.load ( manifest_file_name, state.program ) )
+	{
+	  cout << "ERROR reading manifest " << manifest_file_name << "." << endl;
+	  exit (1);
+	}
+      state.manifest = &manifest;
+    }
+  if ( cache_directory != "" && ! cache.open ( cache_directory, state.program ) )
+    {
+      cout << "ERROR opening cache " << cache_directory << "." << endl;
+      exit (1);
+    }
+  cached = 0;
+  for ( unsigned int t = 0; t < all_tasks.size (); t++ )
+    {
+      if ( state.manifest != NULL && manifest.is_complete ( all_tasks[t] ) )
+	continue;
+      if ( cache_directory != "" && task_from_cache ( cache, all_tasks[t] ) )
+	{
+	  if ( state.manifest != NULL && ! manifest.record ( all_tasks[t] ) )
+	    cout << "WARNING: could not record chunk " << all_tasks[t].id << " in the manifest." << endl;
+	  cached++;
+	  continue;
+	}
+      tasks.push_back ( all_tasks[t] );
+      // so that what is computed now is stored for the next time
+      if ( cache_directory != "" )
+	tasks.back ().options += " -cache " + cache_directory;
+    }
+  if ( tasks.size () + cached < all_tasks.size () )
+    cout << "Skipping " << all_tasks.size () - tasks.size () - cached << " chunks already done." << endl;
+  if ( cached > 0 )
+    cout << "Took " << cached << " chunks from the cache." << endl;
+  if ( tasks.empty () )
+    {
+      cout << "Nothing to do." << endl;
+      return 0;
+    }
+  if ( number_of_workers > tasks.size () )
+    number_of_workers = tasks.size ();
+  weigh_tasks ( tasks );
+
+  // heaviest first, each to the worker with the least work so far
+  queues.resize ( number_of_workers );
+  for ( unsigned int w = 0; w < number_of_workers; w++ )
+    {
+      pthread_mutex_init ( &( queues[w].lock ), NULL );
+      queues[w].weight = 0;
+    }
+  for ( unsigned int t = 0; t < tasks.size (); t++ )
+    order.push_back ( t );
+  stable_sort ( order.begin (), order.end (), heavier_task ( tasks ) );
+  state.total_weight = 0;
+  for ( unsigned int i = 0; i < order.size (); i++ )
+    {
+      least_loaded = 0;
+      for ( unsigned int w = 1; w < number_of_workers; w++ )
+	if ( queues[w].weight < queues[least_loaded].weight )
+	  least_loaded = w;
+      queues[least_loaded].tasks.push_back ( order[i] );
+      queues[least_loaded].weight += tasks[order[i]].weight;
+      state.total_weight          += tasks[order[i]].weight;
+    }
+
+  pthread_mutex_init ( &( state.lock ), NULL );
+  state.tasks       = &tasks;
+  state.queues      = &queues;
+  state.done        = 0;
+  state.failed      = 0;
+  state.done_weight = 0;
+  cout << "Running " << tasks.size () << " chunks (" << state.total_weight << " tissue voxels) on " << number_of_workers << " workers." << endl;
+
+  gettimeofday ( &start, NULL );
+  workers = new pthread_t[number_of_workers];
+  jobs.resize ( number_of_workers );
+  for ( unsigned int w = 0; w < number_of_workers; w++ )
+    {
+      jobs[w].worker = w;
+      jobs[w].state  = &state;
+      if ( pthread_create ( &( workers[w] ), NULL, worker_thread, &( jobs[w] ) ) != 0 )
+	{
+	  cout << "ERROR creating thread." << endl;
+	  exit (1);
+	}
+    }
+
+  // progress, once a second
+  do
+    {
+      sleep ( 1 );
+      pthread_mutex_lock ( &( state.lock ) );
+      done    = state.done;
+      elapsed = elapsed_seconds ( start );
+      rate    = elapsed > 0 ? state.done_weight / elapsed : 0;
+      eta     = rate > 0 ? static_cast<offset_t> ( ( state.total_weight - state.done_weight ) / rate ) : 0;
+      if ( state.done_weight > 0 )
+	snprintf ( line, sizeof ( line ), "%u of %u chunks done, %.0f voxels/s, ETA %02lld:%02lld:%02lld.   ",
+		   done, static_cast<unsigned int> ( tasks.size () ), rate, eta / 3600, ( eta % 3600 ) / 60, eta % 60 );
+      else
+	snprintf ( line, sizeof ( line ), "%u of %u chunks done.   ", done, static_cast<unsigned int> ( tasks.size () ) );
+      pthread_mutex_unlock ( &( state.lock ) );
+      cout << "\r" << line << flush;
+    }
+  while ( done < tasks.size () );
+  cout << endl;
+
+  for ( unsigned int w = 0; w < number_of_workers; w++ )
+    pthread_join ( workers[w], NULL );
+  delete[] workers;
+  cout << "Done in " << static_cast<offset_t> ( elapsed_seconds ( start ) ) << " s." << endl;
+  if ( state.failed > 0 )
+    {
+      cout << "ERROR: " << state.failed << " chunks failed." << endl;
+      exit (1);
+    }
+  return 0;
+}
+
+// own queue from the front, then steal from the back of the fullest
+bool next_task ( scheduler_state* state, unsigned int worker, int* task )
+{
+  vector<task_queue>& queues = *( state->queues );
+  offset_t            most_weight;
+  unsigned int        victim;
+
+  pthread_mutex_lock ( &( queues[worker].lock ) );
+  if ( ! queues[worker].tasks.empty () )
+    {
+      *task = queues[worker].tasks.front ();
+      queues[worker].tasks.pop_front ();
+      queues[worker].weight -= ( *state->tasks )[*task].weight;
+      pthread_mutex_unlock ( &( queues[worker].lock ) );
+      return true;
+    }
+  pthread_mutex_unlock ( &( queues[worker].lock ) );
+
+  while ( true )
+    {
+      // the victim may be emptied by another thief before we get to
+      // it, in which case we look again
+      victim      = worker;
+      most_weight = 0;
+      for ( unsigned int w = 0; w < queues.size (); w++ )
+	{
+	  if ( w == worker )
+	    continue;
+	  pthread_mutex_lock ( &( queues[w].lock ) );
+	  if ( ! queues[w].tasks.empty () && ( victim == worker || queues[w].weight > most_weight ) )
+	    {
+	      victim      = w;
+	      most_weight = queues[w].weight;
+	    }
+	  pthread_mutex_unlock ( &( queues[w].lock ) );
+	}
+      if ( victim == worker )
+	return false;
+      pthread_mutex_lock ( &( queues[victim].lock ) );
+      if ( ! queues[victim].tasks.empty () )
+	{
+	  *task = queues[victim].tasks.back ();
+	  queues[victim].tasks.pop_back ();
+	  queues[victim].weight -= ( *state->tasks )[*task].weight;
+	  pthread_mutex_unlock ( &( queues[victim].lock ) );
+	  return true;
+	}
+      pthread_mutex_unlock ( &( queues[victim].lock ) );
+    }
+}
+
+void* worker_thread ( void* argument )
+{
+  worker_job*      job = static_cast<worker_job*> ( argument );
+  scheduler_state* state = job->state;
+  int              status;
+  int              task;
+
+  while ( next_task ( state, job->worker, &task ) )
+    {
+      const synthesis_task& current = ( *state->tasks )[task];
+
+      status = run_task ( current, state->program, state->log_file );
+      if ( status == 0 && state->manifest != NULL && ! state->manifest->record ( current ) )
+	{
+	  pthread_mutex_lock ( &( state->lock ) );
+	  cout << endl << "WARNING: could not record chunk " << current.id << " in the manifest." << endl;
+	  pthread_mutex_unlock ( &( state->lock ) );
+	}
+      pthread_mutex_lock ( &( state->lock ) );
+      state->done++;
+      state->done_weight += current.weight;
+      if ( status != 0 )
+	{
+	  state->failed++;
+	  cout << endl << "ERROR: chunk failed (status " << status << "): " << format_task ( current ) << endl;
+	}
+      pthread_mutex_unlock ( &( state->lock ) );
+    }
+  return NULL;
+}
+
+double elapsed_seconds ( const struct timeval& start )
+{
+  struct timeval now;
+
+  gettimeofday ( &now, NULL );
+  return ( now.tv_sec - start.tv_sec ) + ( now.tv_usec - start.tv_usec ) / 1e6;
+}
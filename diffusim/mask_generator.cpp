@@ -18,25 +18,74 @@
 # Author can be reached at rborges@if.usp.br
 */
 
+#include <cerrno>
+#include <climits>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include <mxml.h>
+#include <sys/stat.h>
 
+#include "byte_order.hpp"
+#include "content_hash.hpp"
 #include "data_structures.hpp"
+#include "diffusion_model.hpp"
 #include "pretty.hpp"
+#include "raw_io.hpp"
+#include "volume.hpp"
 
 using namespace std;
 
 pretty prt;
 
+// Random draws seeded by the voxel and the object that sets it, so that
+// a voxel gets the same direction whatever the slab size and whichever
+// planes are generated: regenerating part of the volume leaves the rest
+// exactly as it was.
+typedef unsigned long long voxel_random;
+
+// What the incremental mode compares with the previous run, one line
+// per object and a header for what affects every plane.
+#define COMPILED_SCENE "compiled_scene.txt"
+
+typedef struct
+{
+  string       line;
+  unsigned int z_begin;
+  unsigned int z_end;
+} compiled_object;
+
+// The compartments a voxel gathers from the objects that overlap there,
+// with -compartments; the labels of the objects are kept for the
+// direction uncertainty, and left out of the compartments files.
+typedef struct
+{
+  unsigned char  count;
+  compartment    compartments[COMPARTMENT_CAPACITY];
+  unsigned short labels[COMPARTMENT_CAPACITY];
+} voxel_compartments;
+
 double_3d get_square_vertex         ( double_3d, double_3d );
 double_3d get_tangent_versor        ( double_3d, double_3d );
-void      generate_random_versor    ( double_3d* );
-void      generate_uncertain_versor ( double_3d* versor, const unsigned int uncertainty_percentage );
+void      generate_random_versor    ( double_3d*, voxel_random* );
+void      generate_uncertain_versor ( double_3d* versor, const unsigned int uncertainty_percentage, voxel_random* random );
+voxel_random seed_voxel_random      ( unsigned int x, unsigned int y, unsigned int z, unsigned short label );
+unsigned int next_random            ( voxel_random* );
+unsigned int objects_before_layer   ( const sample& xml_sample, unsigned int layer );
+bool      read_compiled_scene       ( vector<string>& header, map<unsigned short, compiled_object>& objects );
+void      mark_dirty_planes         ( const map<unsigned short, compiled_object>& previous, const map<unsigned short, compiled_object>& current, unsigned int max_z, vector<bool>& dirty );
+string    plane_file_name           ( unsigned int z );
+string    compartment_file_name     ( unsigned int z );
+void      add_compartment           ( voxel_compartments* voxel, const compartment& added, unsigned short label, bool* overflow );
+bool      has_node                  ( node_pointer*, const string );
 void      set_value_from_node       ( node_pointer*, const string, double*       );
 void      set_value_from_node       ( node_pointer*, const string, node_pointer* );
 void      set_value_from_node       ( node_pointer*, const string, short*        );
@@ -47,18 +96,39 @@ void      set_value_from_node       ( node_pointer*, const string, unsigned int*
 int main (int argc, char** argv )
 {
   attributes                 data;
+  bool                       compartments;
+  bool                       compartments_overflow;
+  bool                       incremental;
+  byte_order                 phantom_byte_order;
+  char                       hash_text[32];
+  compiled_object            scene_object;
+  compartment                compartment_buffer;
+  compartment_type           object_compartment;
+  attributes*                plane;
+  unsigned short*            plane_labels;
+  signal_t*                  plane_signals;
   cylinder_with_aniso_adc*   buffer_cylinder_aniso;
   cylinder_with_iso_adc*     buffer_cylinder_iso;
   cylinder_with_tangent_adc* buffer_cylinder_tan;
   double                     distance_to_center;
+  double                     object_fraction;
+  double*                    plane_components;
   double                     temp;
   double_3d                  center;
   double_3d                  point;
-  fstream                    buffer_file;
-  fstream                    mask_file;
+  hash_t                     phantom_hash;
+  ios::openmode              output_mode;
+  ofstream                   labels_file;
+  ofstream*                  mask_x_files;
+  ofstream*                  mask_y_files;
+  ofstream*                  mask_z_files;
   ifstream                   phantom_file;
-  int                        offset;
-  int                        offset_phantom;
+  map<unsigned short, compiled_object> previous_objects;
+  map<unsigned short, compiled_object> scene_objects;
+  offset_t                   memory_budget;
+  offset_t                   offset;
+  offset_t                   offset_phantom;
+  offset_t                   plane_voxels;
   node_pointer*              layer_node;
   node_pointer*              object_node;
   node_pointer*              tree;
@@ -66,28 +136,57 @@ int main (int argc, char** argv )
   ofstream                   out_file;
   rectangle*                 rectangle_buffer;
   sample                     xml_sample;
-  signal_t                      phantom_signal;
+  signal_t                   phantom_signal;
+  signal_t*                  phantom_signals;
   string                     buffer;
   string                     filename;
   string                     geometry;
   string                     raw_file_name;
+  string                     uncertainty_list;
   string                     xml_file_name;
-  stringstream               name_counter;
   stringstream               buffer_sstream;
+  stringstream               labels_table;
+  stringstream               object_description;
   unsigned int               current_layer;
   unsigned int               current_object;
+  unsigned int               dirty_planes;
   unsigned int               direction_uncertainty_percentage;
+  unsigned int               uncertainty_level;
   unsigned int               max_x;
   unsigned int               max_y;
   unsigned int               max_z;
   unsigned int               object_x;
   unsigned int               object_y;
   unsigned int               object_z;
+  unsigned int               rectangle_begin_z;
+  unsigned int               slab_depth;
+  unsigned int               z_begin;
+  unsigned int               z_end;
+  unsigned short             label;
+  unsigned short*            region_labels;
+  uint_3d                    rectangle_end;
+  vector<bool>               dirty;
+  vector<compartment>        plane_pool;
+  vector<compartment_type>   object_compartments;
+  vector<double>             object_fractions;
+  vector<unsigned char>      plane_counts;
+  vector<bool>               uncertain_label;
+  vector<string>             variant_directories;
+  vector<unsigned int>       uncertainty_levels;
+  vector<string>             previous_header;
+  vector<string>             scene_header;
+  vector< pair<unsigned int, unsigned int> > slabs;
+  volume*                    slab;
+  volume_layout              layout;
+  volume_layout              requested_layout;
+  voxel_compartments*        slab_compartments;
+  voxel_compartments*        voxel_list;
+  voxel_random               random;
   FILE*                      fp;
 
-  if ( argc < 3 )
+  if ( argc < 4 )
     {
-      cout << "USAGE: " << argv[0] << " raw_file_name xml_file_name direction_uncertainty_percentage" << endl;
+      cout << "USAGE: " << argv[0] << " raw_file_name xml_file_name direction_uncertainty_percentage [-memory memory_budget_in_MB] [-layout linear|bricked] [-byte_order little|big] [-incremental] [-uncertainties percentage,percentage,...] [-compartments]" << endl;
       exit (1);
     }
 
@@ -98,6 +197,73 @@ int main (int argc, char** argv )
   raw_file_name                    = argv[1];
   xml_file_name                    = argv[2];
   direction_uncertainty_percentage = atoi ( argv[3] );
+  memory_budget                    = 512;
+  layout                           = linear_layout;
+  phantom_byte_order               = native_byte_order;
+  incremental                      = false;
+  compartments                     = false;
+  for ( int i = 4; i < argc; i++ )
+    {
+      if ( string ( argv[i] ) == "-incremental" )
+	incremental = true;
+      else if ( string ( argv[i] ) == "-compartments" )
+	compartments = true;
+    }
+  for ( int i = 4; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-memory" )
+	memory_budget = atoll ( argv[++i] );
+      else if ( string ( argv[i] ) == "-layout" )
+	{
+	  if ( string ( argv[++i] ) == "bricked" )
+	    layout = bricked_layout;
+	}
+      else if ( string ( argv[i] ) == "-byte_order" )
+	phantom_byte_order = byte_order_from_name ( argv[++i] );
+      else if ( string ( argv[i] ) == "-uncertainties" )
+	uncertainty_list = argv[++i];
+    }
+  memory_budget *= 1024 * 1024;
+  if ( phantom_byte_order == unknown_byte_order )
+    {
+      prt.f ( verbosity_error, "ERROR: unknown byte order.\n" );
+      exit (1);
+    }
+
+  // With -uncertainties, the scene is rasterized once and a sample is
+  // written for each level, in u<level>/: only the directions of the
+  // anisotropic cylinders depend on it. Without, the single sample of
+  // direction_uncertainty_percentage goes in the current directory.
+  if ( uncertainty_list == "" )
+    {
+      uncertainty_levels.push_back ( direction_uncertainty_percentage );
+      variant_directories.push_back ( "" );
+    }
+  else
+    {
+      buffer = uncertainty_list;
+      for ( unsigned int i = 0; i < buffer.size (); i++ )
+	if ( buffer[i] == ',' )
+	  buffer[i] = ' ';
+      istringstream levels ( buffer );
+      while ( levels >> uncertainty_level )
+	{
+	  uncertainty_levels.push_back ( uncertainty_level );
+	  buffer_sstream.str ( "" );
+	  buffer_sstream << "u" << uncertainty_level;
+	  if ( mkdir ( buffer_sstream.str ().c_str (), 0755 ) != 0 && errno != EEXIST )
+	    {
+	      prt.f ( verbosity_error, "ERROR: cannot create %s.\n", buffer_sstream.str ().c_str () );
+	      exit (1);
+	    }
+	  variant_directories.push_back ( buffer_sstream.str () + "/" );
+	}
+      if ( uncertainty_levels.empty () )
+	{
+	  prt.f ( verbosity_error, "ERROR: no uncertainty levels in %s.\n", uncertainty_list.c_str () );
+	  exit (1);
+	}
+    }
 
   prt.f ( verbosity_information, "direction_uncertainty_percentage = %d\n", direction_uncertainty_percentage );
 
@@ -114,6 +280,9 @@ int main (int argc, char** argv )
   fclose(fp);
 
   set_value_from_node ( tree, "number_of_layers", &( xml_sample.number_of_layers ) );
+  // the compartment of every object, by label (0 is no object)
+  object_compartments.push_back ( ball_compartment );
+  object_fractions.push_back ( 0 );
   xml_sample.layers = new canvas[xml_sample.number_of_layers];
   cout << "Specification defines " << xml_sample.number_of_layers << " layers." << endl;
 
@@ -141,6 +310,12 @@ int main (int argc, char** argv )
 	  prt.f ( verbosity_information, "Parsing object %d:\n", current_object );
 	  prt.indentation++;
 	  prt.f ( verbosity_information, "Geometry: %s\n", geometry.c_str () );
+	  labels_table << objects_before_layer ( xml_sample, l ) + o + 1 << " " << l << " " << o << " " << geometry << endl;
+	  // cylinders go through every plane
+	  object_description.str ( "" );
+	  object_description.precision ( 17 );
+	  scene_object.z_begin = 0;
+	  scene_object.z_end   = UINT_MAX;
 	  if ( geometry == "cylinder_with_aniso_adc" )
 	    {
 	      buffer_cylinder_aniso = new cylinder_with_aniso_adc;
@@ -160,6 +335,12 @@ int main (int argc, char** argv )
 	      object_buffer->object_pointer = static_cast<void*> ( buffer_cylinder_aniso );
 	      xml_sample.layers[current_layer].objects[current_object] = *object_buffer;
 
+	      object_description << buffer_cylinder_aniso->voxel.iso_adc << " " << buffer_cylinder_aniso->center.x << " " << buffer_cylinder_aniso->center.y << " "
+				 << buffer_cylinder_aniso->center.z << " " << buffer_cylinder_aniso->radius << " "
+				 << buffer_cylinder_aniso->voxel.principal_direction.x << " " << buffer_cylinder_aniso->voxel.principal_direction.y << " "
+				 << buffer_cylinder_aniso->voxel.principal_direction.z << " " << buffer_cylinder_aniso->signal_threshold_low << " "
+				 << buffer_cylinder_aniso->signal_threshold_high << " " << buffer_cylinder_aniso->voxel.transverse_ratio;
+
 	      object_x = buffer_cylinder_aniso->center.x + buffer_cylinder_aniso->radius;
 	      object_y = buffer_cylinder_aniso->center.y + buffer_cylinder_aniso->radius;
 	      object_z = 0;
@@ -178,6 +359,9 @@ int main (int argc, char** argv )
 	      object_buffer->object_pointer = static_cast<void*> ( buffer_cylinder_iso );
 	      xml_sample.layers[current_layer].objects[current_object] = *object_buffer;
 
+	      object_description << buffer_cylinder_iso->voxel.iso_adc << " " << buffer_cylinder_iso->center.x << " " << buffer_cylinder_iso->center.y << " "
+				 << buffer_cylinder_iso->center.z << " " << buffer_cylinder_iso->radius << " " << buffer_cylinder_iso->voxel.transverse_ratio;
+
 	      object_x = buffer_cylinder_iso->center.x + buffer_cylinder_iso->radius;
 	      object_y = buffer_cylinder_iso->center.y + buffer_cylinder_iso->radius;
 	      object_z = 0;
@@ -196,6 +380,9 @@ int main (int argc, char** argv )
 	      object_buffer->object_pointer = static_cast<void*> (buffer_cylinder_tan);
 	      xml_sample.layers[current_layer].objects[current_object] = *object_buffer;
 
+	      object_description << buffer_cylinder_tan->voxel.iso_adc << " " << buffer_cylinder_tan->center.x << " " << buffer_cylinder_tan->center.y << " "
+				 << buffer_cylinder_tan->center.z << " " << buffer_cylinder_tan->radius << " " << buffer_cylinder_tan->voxel.transverse_ratio;
+
 	      object_x = buffer_cylinder_tan->center.x + buffer_cylinder_tan->radius;
 	      object_y = buffer_cylinder_tan->center.y + buffer_cylinder_tan->radius;
 	      object_z = 0;
@@ -229,11 +416,51 @@ int main (int argc, char** argv )
 	      object_buffer->object_pointer = static_cast<void*> (rectangle_buffer);
 	      xml_sample.layers[current_layer].objects[current_object] = *object_buffer;
 
+	      object_description << rectangle_buffer->voxel.iso_adc << " " << rectangle_buffer->size.x << " " << rectangle_buffer->size.y << " "
+				 << rectangle_buffer->size.z << " " << rectangle_buffer->origin.x << " " << rectangle_buffer->origin.y << " "
+				 << rectangle_buffer->origin.z << " " << buffer << " " << rectangle_buffer->voxel.transverse_ratio;
+	      if ( rectangle_buffer->diffusion == single_direction )
+		object_description << " " << rectangle_buffer->voxel.principal_direction.x << " " << rectangle_buffer->voxel.principal_direction.y << " "
+				   << rectangle_buffer->voxel.principal_direction.z;
+	      scene_object.z_begin = rectangle_buffer->origin.z;
+	      scene_object.z_end   = rectangle_buffer->origin.z + rectangle_buffer->size.z;
+
 	      object_x = rectangle_buffer->size.x;
 	      object_y = rectangle_buffer->size.y;
 	      object_z = rectangle_buffer->size.z;
 	    }
 
+	  // With -compartments, every object also adds a compartment to
+	  // the voxels it covers, next to those of the objects below it
+	  // (see diffusion_model.hpp): a ball if its diffusion is
+	  // isotropic, a zeppelin otherwise, unless it says which; of the
+	  // same volume fraction as the others, unless it says how much.
+	  object_compartment = zeppelin_compartment;
+	  if ( geometry == "cylinder_with_iso_adc" || ( geometry == "rectangle" && rectangle_buffer->diffusion == isotropic ) )
+	    object_compartment = ball_compartment;
+	  object_fraction = 1;
+	  if ( has_node ( object_node, "compartment" ) )
+	    {
+	      set_value_from_node ( object_node, "compartment", &( buffer ) );
+	      if ( ! compartment_type_from_name ( buffer, &object_compartment ) )
+		{
+		  prt.f ( verbosity_error, "ERROR: unknown compartment %s.\n", buffer.c_str () );
+		  exit (1);
+		}
+	    }
+	  if ( has_node ( object_node, "volume_fraction" ) )
+	    set_value_from_node ( object_node, "volume_fraction", &( object_fraction ) );
+	  object_compartments.push_back ( object_compartment );
+	  object_fractions.push_back ( object_fraction );
+	  if ( compartments )
+	    object_description << " compartment " << object_compartment << " " << object_fraction;
+
+	  buffer_sstream.str ( "" );
+	  buffer_sstream << "object " << objects_before_layer ( xml_sample, l ) + o + 1 << " " << scene_object.z_begin << " " << scene_object.z_end << " "
+			 << l << " " << o << " " << geometry << " " << object_description.str ();
+	  scene_object.line = buffer_sstream.str ();
+	  scene_objects[objects_before_layer ( xml_sample, l ) + o + 1] = scene_object;
+
 	  prt.f ( verbosity_information, "object_x = %d\n", object_x );
 	  prt.f ( verbosity_information, "object_y = %d\n", object_y );
 	  prt.f ( verbosity_information, "object_z = %d\n", object_z );
@@ -253,301 +480,443 @@ int main (int argc, char** argv )
   prt.f ( verbosity_information, "max_y = %d\n", max_y );
   prt.f ( verbosity_information, "max_z = %d\n", max_z );
 
-  // zero the buffer
-  prt.f ( verbosity_information, "Creating zero-filled buffer file...\n" );
-  buffer_file.open ("buffer.raw", ios::out | ios::binary | ios::in | ios::trunc );
-  if ( ! buffer_file )
+  // the later stages need the size of a plane to label their outputs
+  out_file.open ( "sample_dimensions.txt", ios::out | ios::trunc );
+  out_file << "size_x " << max_x << endl;
+  out_file << "size_y " << max_y << endl;
+  out_file << "slices " << max_z << endl;
+  out_file.close ();
+
+  // each voxel is labelled with the last object that set it (objects
+  // numbered from 1 across the layers, 0 for none), so that the
+  // synthetic images can be compared region by region
+  out_file.open ( "mask_labels.txt", ios::out | ios::trunc );
+  out_file << "# label layer object geometry" << endl;
+  out_file << labels_table.str ();
+  out_file.close ();
+
+  // the volume is generated one slab of planes at a time, each slab
+  // sized to fit in the memory budget together with its phantom signal,
+  // labels and compartments
+  requested_layout = layout;
+  slab_depth = slab_depth_for_budget ( max_x, max_y, max_z, sizeof ( attributes ) + sizeof ( signal_t ) + sizeof ( unsigned short ) +
+				      ( compartments ? sizeof ( voxel_compartments ) : 0 ), memory_budget, &layout );
+  if ( requested_layout == bricked_layout && layout == linear_layout )
+    cout << "WARNING: a row of bricks does not fit in the memory budget: using the linear layout." << endl;
+  plane_voxels = static_cast<offset_t> ( max_x ) * max_y;
+  prt.f ( verbosity_information, "Processing %d planes at a time.\n", slab_depth );
+
+  // With -incremental, only the planes reached by objects that changed
+  // since the last run (see compiled_scene.txt) are generated again;
+  // anything that affects every plane makes them all dirty.
+  buffer_sstream.str ( "" );
+  buffer_sstream << "dimensions " << max_x << " " << max_y << " " << max_z;
+  scene_header.push_back ( buffer_sstream.str () );
+  buffer_sstream.str ( "" );
+  if ( uncertainty_list == "" )
+    buffer_sstream << "uncertainty " << direction_uncertainty_percentage;
+  else
+    buffer_sstream << "uncertainties " << uncertainty_list;
+  scene_header.push_back ( buffer_sstream.str () );
+  if ( compartments )
+    {
+      buffer_sstream.str ( "" );
+      buffer_sstream << "compartments " << COMPARTMENT_CAPACITY;
+      scene_header.push_back ( buffer_sstream.str () );
+    }
+  if ( ! hash_file ( raw_file_name, &phantom_hash ) )
     {
-      cout << "ERROR: cannot open buffer_file." << endl;
+      cout << "ERROR: cannot open phantom file." << endl;
       exit (1);
     }
-
-  for (unsigned int x = 0; x < max_x; x++)
-    for (unsigned int y = 0; y < max_y; y++)
-      for (unsigned int z = 0; z < max_z; z++)
+  snprintf ( hash_text, sizeof ( hash_text ), "%016llx", phantom_hash );
+  scene_header.push_back ( string ( "phantom " ) + hash_text );
+  dirty.assign ( max_z, true );
+  dirty_planes = max_z;
+  if ( incremental && uncertainty_list != "" )
+    {
+      cout << "A sweep of uncertainties is always generated whole: ignoring -incremental." << endl;
+      incremental = false;
+    }
+  if ( incremental )
+    {
+      if ( read_compiled_scene ( previous_header, previous_objects ) && previous_header == scene_header &&
+	   file_size ( "mask_labels.raw" ) == static_cast<offset_t> ( max_z ) * plane_voxels * static_cast<offset_t> ( sizeof ( unsigned short ) ) )
+	{
+	  dirty.assign ( max_z, false );
+	  mark_dirty_planes ( previous_objects, scene_objects, max_z, dirty );
+	  // and any plane whose sample went missing
+	  for ( unsigned int z = 0; z < max_z; z++ )
+	    if ( file_size ( plane_file_name ( z ).c_str () ) != plane_voxels * static_cast<offset_t> ( sizeof ( attributes ) ) ||
+		 ( compartments && file_size ( compartment_file_name ( z ).c_str () ) < plane_voxels ) )
+	      dirty[z] = true;
+	  dirty_planes = 0;
+	  for ( unsigned int z = 0; z < max_z; z++ )
+	    if ( dirty[z] )
+	      dirty_planes++;
+	  cout << "The scene changed in " << dirty_planes << " of " << max_z << " planes." << endl;
+	}
+      else
 	{
-	  data.iso_adc                = 0;
-	  data.principal_direction.x  = 0;
-	  data.principal_direction.y  = 0;
-	  data.principal_direction.z  = 0;
-	  data.signal                 = 0;
-	  data.transverse_ratio       = 0;
-	  buffer_file.write ( (char*) &data, sizeof ( attributes ) );	  
+	  cout << "Nothing to compare the scene with: generating every plane." << endl;
+	  incremental = false;
 	}
+    }
+  // slabs of consecutive dirty planes
+  for ( unsigned int z = 0; z < max_z; z++ )
+    if ( dirty[z] )
+      {
+	if ( slabs.empty () || slabs.back ().second != z || z - slabs.back ().first >= slab_depth )
+	  slabs.push_back ( make_pair ( z, z + 1 ) );
+	else
+	  slabs.back ().second = z + 1;
+      }
+  // until every plane is written, the scene does not describe them
+  remove ( COMPILED_SCENE );
 
   phantom_file.open ( raw_file_name.c_str (), ios::in | ios::binary );
+  if ( ! phantom_file )
+    {
+      cout << "ERROR: cannot open phantom file." << endl;
+      exit (1);
+    }
+  // an incremental run patches its planes into the files of the last
+  // one; the masks are patched only if they were kept
+  output_mode = ios::out | ios::binary | ( incremental ? ios::in : ios::trunc );
+  mask_x_files = new ofstream[uncertainty_levels.size ()];
+  mask_y_files = new ofstream[uncertainty_levels.size ()];
+  mask_z_files = new ofstream[uncertainty_levels.size ()];
+  for ( unsigned int v = 0; v < uncertainty_levels.size (); v++ )
+    {
+      mask_x_files[v].open ( ( variant_directories[v] + "mask_x.raw" ).c_str (), output_mode );
+      mask_y_files[v].open ( ( variant_directories[v] + "mask_y.raw" ).c_str (), output_mode );
+      mask_z_files[v].open ( ( variant_directories[v] + "mask_z.raw" ).c_str (), output_mode );
+    }
+  labels_file.open ( "mask_labels.raw", output_mode );
+  // the objects whose directions are fudged by the uncertainty
+  uncertain_label.assign ( objects_before_layer ( xml_sample, xml_sample.number_of_layers ) + 1, false );
+  plane            = new attributes[plane_voxels];
+  plane_components = new double[plane_voxels];
+  plane_labels     = new unsigned short[plane_voxels];
+  plane_signals    = new signal_t[plane_voxels];
+  plane_counts.resize ( plane_voxels );
+  compartments_overflow = false;
+  // the padding of the voxels is written too: it must not carry stack
+  // garbage, or identical planes would hash differently (see
+  // chunk_manifest.hpp and result_cache.hpp)
+  memset ( &data, 0, sizeof ( data ) );
 
-  // generate sample in buffer
-  prt.f ( verbosity_status, "Generating mask in the buffer...\n" );
-  prt.f ( verbosity_information, "Mask has %d layers.\n", xml_sample.number_of_layers );
-  for (unsigned int l = 0; l < xml_sample.number_of_layers; l++)
+  for ( unsigned int s = 0; s < slabs.size (); s++ )
     {
-      prt.f ( verbosity_status, "Generating layer %d ... of %d\n", l + 1, xml_sample.number_of_layers );
-      prt.f ( verbosity_information, "Layer has %d objects.\n", xml_sample.layers[l].number_of_objects );
-      for (unsigned int o = 0; o < xml_sample.layers[l].number_of_objects; o++)
+      z_begin = slabs[s].first;
+      z_end   = slabs[s].second;
+      slab = new volume ( max_x, max_y, z_begin, z_end, layout );
+
+      // read the phantom signal for the whole slab at once, plane by
+      // plane into the layout of the slab, which the signal, labels and
+      // compartments of the voxels all follow
+      phantom_signals = new signal_t[slab->number_of_stored_voxels ()];
+      memset ( phantom_signals, 0, slab->number_of_stored_voxels () * sizeof ( signal_t ) );
+      offset_phantom = static_cast<offset_t> ( z_begin ) * plane_voxels * sizeof ( signal_t );
+      phantom_file.clear ();
+      phantom_file.seekg ( offset_phantom, ios::beg );
+      for ( unsigned int z = z_begin; z < z_end; z++ )
 	{
-	  prt.f ( verbosity_status, "Generating object %d ...\n", o );
-	  object_buffer = &(xml_sample.layers[l].objects[o]);
-	  // rectangular prism object:
-	  if (object_buffer->type == rectangle_type)
+	  memset ( plane_signals, 0, plane_voxels * sizeof ( signal_t ) );
+	  phantom_file.read ( ( char* ) plane_signals, plane_voxels * sizeof ( signal_t ) );
+	  if ( byte_order_differs ( phantom_byte_order ) )
+	    swap_bytes ( ( char* ) plane_signals, plane_voxels, sizeof ( signal_t ) );
+	  for ( offset_t i = 0; i < plane_voxels; i++ )
+	    phantom_signals[slab->index ( i % max_x, i / max_x, z )] = plane_signals[i];
+	}
+      region_labels = new unsigned short[slab->number_of_stored_voxels ()];
+      memset ( region_labels, 0, slab->number_of_stored_voxels () * sizeof ( unsigned short ) );
+      slab_compartments = NULL;
+      if ( compartments )
+	{
+	  slab_compartments = new voxel_compartments[slab->number_of_stored_voxels ()];
+	  memset ( slab_compartments, 0, slab->number_of_stored_voxels () * sizeof ( voxel_compartments ) );
+	}
+
+      // generate sample in the slab
+      prt.f ( verbosity_status, "Generating mask for planes %d to %d of %d...\n", z_begin, z_end - 1, max_z );
+      prt.f ( verbosity_information, "Mask has %d layers.\n", xml_sample.number_of_layers );
+      for (unsigned int l = 0; l < xml_sample.number_of_layers; l++)
+	{
+	  prt.f ( verbosity_status, "Generating layer %d ... of %d\n", l + 1, xml_sample.number_of_layers );
+	  prt.f ( verbosity_information, "Layer has %d objects.\n", xml_sample.layers[l].number_of_objects );
+	  for (unsigned int o = 0; o < xml_sample.layers[l].number_of_objects; o++)
 	    {
-	      prt.f ( verbosity_information, "Object %d is a rectangle.\n", o );
-	      rectangle_buffer = static_cast<rectangle*> (object_buffer->object_pointer);
-	      unsigned int x = rectangle_buffer->origin.x;
-	      x++;
-	      for (unsigned int x = rectangle_buffer->origin.x; x < (rectangle_buffer->origin.x + rectangle_buffer->size.x); x++)
+	      prt.f ( verbosity_status, "Generating object %d ...\n", o );
+	      object_buffer = &(xml_sample.layers[l].objects[o]);
+	      label = objects_before_layer ( xml_sample, l ) + o + 1;
+	      // rectangular prism object:
+	      if (object_buffer->type == rectangle_type)
 		{
-		  for (unsigned int y = rectangle_buffer->origin.y; y < (rectangle_buffer->origin.y + rectangle_buffer->size.y); y++)
-		    for (unsigned int z = rectangle_buffer->origin.z; z < (rectangle_buffer->origin.z + rectangle_buffer->size.z); z++)
+		  prt.f ( verbosity_information, "Object %d is a rectangle.\n", o );
+		  rectangle_buffer = static_cast<rectangle*> (object_buffer->object_pointer);
+		  // clip the prism to the volume and to the slab
+		  rectangle_end.x = rectangle_buffer->origin.x + rectangle_buffer->size.x;
+		  rectangle_end.y = rectangle_buffer->origin.y + rectangle_buffer->size.y;
+		  rectangle_end.z = rectangle_buffer->origin.z + rectangle_buffer->size.z;
+		  if ( rectangle_end.x > max_x )
+		    rectangle_end.x = max_x;
+		  if ( rectangle_end.y > max_y )
+		    rectangle_end.y = max_y;
+		  if ( rectangle_end.z > z_end )
+		    rectangle_end.z = z_end;
+		  rectangle_begin_z = rectangle_buffer->origin.z;
+		  if ( rectangle_begin_z < z_begin )
+		    rectangle_begin_z = z_begin;
+		  for (unsigned int z = rectangle_begin_z; z < rectangle_end.z; z++)
+		    {
+		      for (unsigned int y = rectangle_buffer->origin.y; y < rectangle_end.y; y++)
+			for (unsigned int x = rectangle_buffer->origin.x; x < rectangle_end.x; x++)
+			  {
+			    data.iso_adc = rectangle_buffer->voxel.iso_adc;
+			    if ( rectangle_buffer->diffusion == isotropic )
+			      {
+				random = seed_voxel_random ( x, y, z, label );
+				generate_random_versor ( &( data.principal_direction ), &random );
+			      }
+			    if ( rectangle_buffer->diffusion == single_direction )
+			      {
+				data.principal_direction.x = rectangle_buffer->voxel.principal_direction.x;
+				data.principal_direction.y = rectangle_buffer->voxel.principal_direction.y;
+				data.principal_direction.z = rectangle_buffer->voxel.principal_direction.z;
+			      }
+			    data.transverse_ratio = rectangle_buffer->voxel.transverse_ratio;
+			    // read signal from the phantom slab
+			    offset = slab->index ( x, y, z );
+			    data.signal = phantom_signals[offset];
+			    // save data in the slab
+			    *( slab->at ( x, y, z ) ) = data;
+			    region_labels[offset] = label;
+			    if ( compartments )
+			      add_compartment ( &slab_compartments[offset], make_compartment ( object_compartments[label], object_fractions[label], data ), label, &compartments_overflow );
+			  }
+		    }
+		}
+	      // generate cylinder with anisotrpic diffusion, within a threshold
+	      if ( object_buffer->type == cylinder_with_aniso_adc_type )
+		{
+		  prt.f ( verbosity_information, "Object %d is a anisotropic cylinder.\n", o );
+		  buffer_cylinder_aniso = static_cast<cylinder_with_aniso_adc*> (object_buffer->object_pointer);
+		  for (unsigned int z = z_begin; z < z_end; z++)
+		    for (unsigned int y = 0; y < max_y; y++)
 		      {
-			data.iso_adc = rectangle_buffer->voxel.iso_adc;
-			if ( rectangle_buffer->diffusion == isotropic )
+			for (unsigned int x = 0; x < max_x; x++)
 			  {
-			    generate_random_versor ( &( data.principal_direction ) );
+			    temp = static_cast<double> (buffer_cylinder_aniso->center.x);
+			    temp = temp - x;
+			    distance_to_center = temp * temp;
+			    temp = static_cast<double> (buffer_cylinder_aniso->center.y);
+			    temp = temp - y;
+			    distance_to_center += temp * temp;
+			    distance_to_center = sqrt ( distance_to_center );
+			    if ( distance_to_center <= static_cast<double> ( buffer_cylinder_aniso->radius ) )
+			      {
+				offset = slab->index ( x, y, z );
+				phantom_signal = phantom_signals[offset];
+				if ( static_cast<double> ( phantom_signal ) >= buffer_cylinder_aniso->signal_threshold_low &&
+				     static_cast<double> ( phantom_signal ) <= buffer_cylinder_aniso->signal_threshold_high )
+				  {
+				    data.signal = phantom_signal;
+				    // get the direction from the xml
+				    data.principal_direction.x = buffer_cylinder_aniso->voxel.principal_direction.x;
+				    data.principal_direction.y = buffer_cylinder_aniso->voxel.principal_direction.y;
+				    data.principal_direction.z = buffer_cylinder_aniso->voxel.principal_direction.z;
+				    // the uncertainty is applied as the planes are saved
+				    uncertain_label[label] = true;
+				    data.iso_adc = buffer_cylinder_aniso->voxel.iso_adc;
+				    data.transverse_ratio = buffer_cylinder_aniso->voxel.transverse_ratio;
+				    // save it in the slab
+				    *( slab->at ( x, y, z ) ) = data;
+				    region_labels[offset] = label;
+				    if ( compartments )
+				      add_compartment ( &slab_compartments[offset], make_compartment ( object_compartments[label], object_fractions[label], data ), label, &compartments_overflow );
+				  }
+			      }
 			  }
-			if ( rectangle_buffer->diffusion == single_direction )
+		      }
+		}
+	      if (object_buffer->type == cylinder_with_tangent_adc_type)
+		{
+		  prt.f ( verbosity_information, "Object %d is a tangentially anisotropic cylinder.\n", o );
+		  buffer_cylinder_tan = static_cast<cylinder_with_tangent_adc*> (object_buffer->object_pointer);
+		  for (unsigned int z = z_begin; z < z_end; z++)
+		    for (unsigned int y = 0; y < max_y; y++)
+		      {
+			for (unsigned int x = 0; x < max_x; x++)
 			  {
-			    data.principal_direction.x = rectangle_buffer->voxel.principal_direction.x;
-			    data.principal_direction.y = rectangle_buffer->voxel.principal_direction.y;
-			    data.principal_direction.z = rectangle_buffer->voxel.principal_direction.z;
+			    temp = static_cast<double> (buffer_cylinder_tan->center.x);
+			    temp = temp - x;
+			    distance_to_center = temp * temp;
+			    temp = static_cast<double> (buffer_cylinder_tan->center.y);
+			    temp = temp - y;
+			    distance_to_center += temp * temp;
+			    distance_to_center = sqrt (distance_to_center);
+			    if (distance_to_center <= static_cast<double> (buffer_cylinder_tan->radius))
+			      {
+				point.x = x;
+				point.y = y;
+				point.z = z;
+				center.x = buffer_cylinder_tan->center.x;
+				center.y = buffer_cylinder_tan->center.y;
+				center.z = z;
+				data.principal_direction = get_tangent_versor ( center, point );
+				data.iso_adc = buffer_cylinder_tan->voxel.iso_adc;
+				data.transverse_ratio = buffer_cylinder_tan->voxel.transverse_ratio;
+				// read signal
+				offset = slab->index ( x, y, z );
+				data.signal = phantom_signals[offset];
+				// write data
+				*( slab->at ( x, y, z ) ) = data;
+				region_labels[offset] = label;
+				if ( compartments )
+				  add_compartment ( &slab_compartments[offset], make_compartment ( object_compartments[label], object_fractions[label], data ), label, &compartments_overflow );
+			      }
+			  }
+		      }
+		}
+	      if ( object_buffer->type == cylinder_with_iso_adc_type )
+		{
+		  prt.f ( verbosity_information, "Object %d is a cylinder with isotropic diffusion.\n", o );
+		  buffer_cylinder_iso = static_cast<cylinder_with_iso_adc*> (object_buffer->object_pointer);
+		  for (unsigned int z = z_begin; z < z_end; z++)
+		    for (unsigned int y = 0; y < max_y; y++)
+		      {
+			for (unsigned int x = 0; x < max_x; x++)
+			  {
+			    temp = static_cast<double> (buffer_cylinder_iso->center.x);
+			    temp = temp - x;
+			    distance_to_center = temp * temp;
+			    temp = static_cast<double> (buffer_cylinder_iso->center.y);
+			    temp = temp - y;
+			    distance_to_center += temp * temp;
+			    distance_to_center = sqrt (distance_to_center);
+			    if (distance_to_center <= static_cast<double> (buffer_cylinder_iso->radius))
+			      {
+				random = seed_voxel_random ( x, y, z, label );
+				generate_random_versor ( &( data.principal_direction ), &random );
+				data.iso_adc = buffer_cylinder_iso->voxel.iso_adc;
+				data.transverse_ratio = buffer_cylinder_iso->voxel.transverse_ratio;
+				// read signal
+				offset = slab->index ( x, y, z );
+				data.signal = phantom_signals[offset];
+				// write data
+				*( slab->at ( x, y, z ) ) = data;
+				region_labels[offset] = label;
+				if ( compartments )
+				  add_compartment ( &slab_compartments[offset], make_compartment ( object_compartments[label], object_fractions[label], data ), label, &compartments_overflow );
+			      }
 			  }
-			data.transverse_ratio = rectangle_buffer->voxel.transverse_ratio;
-			// read signal from file
-			offset = z * max_x * max_y;
-			offset += y * max_y;
-			offset += x;
-			offset_phantom = offset * sizeof( signal_t );
-			offset *= sizeof ( attributes );
-			phantom_file.seekg (offset_phantom, ios::beg);
-			phantom_file.read ((char*) &phantom_signal, sizeof ( signal_t ));
-			data.signal = phantom_signal;
-			// save data on file
-			buffer_file.seekp (offset, ios::beg);
-			buffer_file.write ((char*) &data, sizeof (attributes));
 		      }
 		}
 	    }
-	  // generate cylinder with anisotrpic diffusion, within a threshold
-	  if ( object_buffer->type == cylinder_with_aniso_adc_type )
-	    {
-	      prt.f ( verbosity_information, "Object %d is a anisotropic cylinder.\n", o );
-	      buffer_cylinder_aniso = static_cast<cylinder_with_aniso_adc*> (object_buffer->object_pointer);
-	      for (unsigned int z = 0; z < max_z; z++)
-		for (unsigned int y = 0; y < max_y; y++)
-		  {
-		    for (unsigned int x = 0; x < max_x; x++)
-		    {
-		      temp = static_cast<double> (buffer_cylinder_aniso->center.x);
-		      temp = temp - x;
-		      distance_to_center = temp * temp;
-		      temp = static_cast<double> (buffer_cylinder_aniso->center.y);
-		      temp = temp - y;
-		      distance_to_center += temp * temp;
-		      distance_to_center = sqrt ( distance_to_center );
-		      if ( distance_to_center <= static_cast<double> ( buffer_cylinder_aniso->radius ) )
-			{
-			  offset = z * max_x * max_y;
-			  offset += y * max_x;
-			  offset += x;
-			  offset_phantom = offset * sizeof( signal_t );
-			  offset *= sizeof ( attributes );
-			  phantom_file.seekg ( offset_phantom, ios::beg );
-			  phantom_file.read ( ( char* ) &phantom_signal, sizeof ( signal_t ));
-			  if ( static_cast<double> ( phantom_signal ) >= buffer_cylinder_aniso->signal_threshold_low && 
-			       static_cast<double> ( phantom_signal ) <= buffer_cylinder_aniso->signal_threshold_high )
-			    {
-			      data.signal = phantom_signal;
-			      // get the direction from the xml
-			      data.principal_direction.x = buffer_cylinder_aniso->voxel.principal_direction.x;
-			      data.principal_direction.y = buffer_cylinder_aniso->voxel.principal_direction.y;
-			      data.principal_direction.z = buffer_cylinder_aniso->voxel.principal_direction.z;
-			      // "fudge" the direction, considering some arbitrary value for the uncertainty
-			      generate_uncertain_versor ( &( data.principal_direction ), direction_uncertainty_percentage );
-			      data.iso_adc = buffer_cylinder_aniso->voxel.iso_adc;
-			      data.transverse_ratio = buffer_cylinder_aniso->voxel.transverse_ratio;
-			      // save it in the buffer
-			      buffer_file.seekp (offset, ios::beg);
-			      buffer_file.write ((char*) &data, sizeof (attributes));
-			    }
-			  else
-			    {
-			      //prt.f ( verbosity_debug, "-" );
-			    }
-			}
-		      else
-			{
-			  //prt.f ( verbosity_debug, " " );
-			}
-		    }
-		    //prt.f ( verbosity_debug, "\n" );
-		  }
-	    }
-	  if (object_buffer->type == cylinder_with_tangent_adc_type)
-	    {
-	      prt.f ( verbosity_information, "Object %d is a tangentially anisotropic cylinder.\n", o );
-	      buffer_cylinder_tan = static_cast<cylinder_with_tangent_adc*> (object_buffer->object_pointer);
-	      for (unsigned int z = 0; z < max_z; z++)
-		for (unsigned int y = 0; y < max_y; y++)
-		  {
-		    for (unsigned int x = 0; x < max_x; x++)
-		    {
-		      temp = static_cast<double> (buffer_cylinder_tan->center.x);
-		      temp = temp - x;
-		      distance_to_center = temp * temp;
-		      temp = static_cast<double> (buffer_cylinder_tan->center.y);
-		      temp = temp - y;
-		      distance_to_center += temp * temp;
-		      distance_to_center = sqrt (distance_to_center);
-		      if (distance_to_center <= static_cast<double> (buffer_cylinder_tan->radius))
-			{
-			  point.x = x;
-			  point.y = y;
-			  point.z = z;
-			  center.x = buffer_cylinder_tan->center.x;
-			  center.y = buffer_cylinder_tan->center.y;
-			  center.z = z;
-			  data.principal_direction = get_tangent_versor ( center, point );
-			  data.iso_adc = buffer_cylinder_tan->voxel.iso_adc;
-			  data.transverse_ratio = buffer_cylinder_tan->voxel.transverse_ratio;
-			  // read signal
-			  offset = z * max_x * max_y;
-			  offset += y * max_x;
-			  offset += x;
-			  offset_phantom = offset * sizeof( signal_t );
-			  offset *= sizeof (attributes);
-			  phantom_file.seekg (offset_phantom, ios::beg);
-			  phantom_file.read ((char*) &phantom_signal, sizeof ( signal_t ));
-			  data.signal = phantom_signal;
-			  // write data
-			  buffer_file.seekp (offset, ios::beg);
-			  buffer_file.write ((char*) &data, sizeof (attributes));
-			}
-		    }
-		  }
-	    }
-	  if ( object_buffer->type == cylinder_with_iso_adc_type )
+	}
+      delete[] phantom_signals;
+      labels_file.seekp ( static_cast<offset_t> ( z_begin ) * plane_voxels * sizeof ( unsigned short ) );
+      for ( unsigned int z = z_begin; z < z_end; z++ )
+	{
+	  for ( offset_t i = 0; i < plane_voxels; i++ )
+	    plane_labels[i] = region_labels[slab->index ( i % max_x, i / max_x, z )];
+	  labels_file.write ( ( char* ) plane_labels, plane_voxels * sizeof ( unsigned short ) );
+	}
+
+      // save the masks and the Z files of the slab, once for every
+      // uncertainty level
+      prt.f ( verbosity_status, "Saving planes %d to %d...\n", z_begin, z_end - 1 );
+      for ( unsigned int v = 0; v < uncertainty_levels.size (); v++ )
+	{
+	  mask_x_files[v].seekp ( static_cast<offset_t> ( z_begin ) * plane_voxels * sizeof ( double ) );
+	  mask_y_files[v].seekp ( static_cast<offset_t> ( z_begin ) * plane_voxels * sizeof ( double ) );
+	  mask_z_files[v].seekp ( static_cast<offset_t> ( z_begin ) * plane_voxels * sizeof ( double ) );
+	  for ( unsigned int z = z_begin; z < z_end; z++ )
 	    {
-	      prt.f ( verbosity_information, "Object %d is a cylinder with isotropic diffusion.\n", o );
-	      buffer_cylinder_iso = static_cast<cylinder_with_iso_adc*> (object_buffer->object_pointer);
-	      for (unsigned int z = 0; z < max_z; z++)
-		for (unsigned int y = 0; y < max_y; y++)
-		  {
-		    for (unsigned int x = 0; x < max_x; x++)
+	      slab->get_plane ( z, plane );
+	      for ( offset_t i = 0; i < plane_voxels; i++ )
+		{
+		  label = region_labels[slab->index ( i % max_x, i / max_x, z )];
+		  if ( ! uncertain_label[label] )
+		    continue;
+		  // "fudge" the direction, considering some arbitrary value for the uncertainty
+		  random = seed_voxel_random ( i % max_x, i / max_x, z, label );
+		  generate_uncertain_versor ( &( plane[i].principal_direction ), uncertainty_levels[v], &random );
+		}
+	      for ( offset_t i = 0; i < plane_voxels; i++ )
+		plane_components[i] = plane[i].principal_direction.x;
+	      mask_x_files[v].write ( ( char* ) plane_components, plane_voxels * sizeof ( double ) );
+	      for ( offset_t i = 0; i < plane_voxels; i++ )
+		plane_components[i] = plane[i].principal_direction.y;
+	      mask_y_files[v].write ( ( char* ) plane_components, plane_voxels * sizeof ( double ) );
+	      for ( offset_t i = 0; i < plane_voxels; i++ )
+		plane_components[i] = plane[i].principal_direction.z;
+	      mask_z_files[v].write ( ( char* ) plane_components, plane_voxels * sizeof ( double ) );
+
+	      filename = variant_directories[v] + plane_file_name ( z );
+	      out_file.open (filename.c_str (), ios::out | ios::binary);
+	      out_file.write ((char*) plane, plane_voxels * sizeof (attributes));
+	      out_file.close ();
+
+	      // the count of every voxel, then their compartments packed
+	      // one after the other, with the same uncertainty
+	      if ( ! compartments )
+		continue;
+	      plane_pool.clear ();
+	      for ( offset_t i = 0; i < plane_voxels; i++ )
+		{
+		  voxel_list = &slab_compartments[slab->index ( i % max_x, i / max_x, z )];
+		  plane_counts[i] = voxel_list->count;
+		  for ( unsigned int k = 0; k < voxel_list->count; k++ )
 		    {
-		      temp = static_cast<double> (buffer_cylinder_iso->center.x);
-		      temp = temp - x;
-		      distance_to_center = temp * temp;
-		      temp = static_cast<double> (buffer_cylinder_iso->center.y);
-		      temp = temp - y;
-		      distance_to_center += temp * temp;
-		      distance_to_center = sqrt (distance_to_center);
-		      if (distance_to_center <= static_cast<double> (buffer_cylinder_iso->radius))
+		      compartment_buffer = voxel_list->compartments[k];
+		      if ( uncertain_label[voxel_list->labels[k]] )
 			{
-			  generate_random_versor ( &( data.principal_direction ) );
-			  data.iso_adc = buffer_cylinder_iso->voxel.iso_adc;
-			  data.transverse_ratio = buffer_cylinder_iso->voxel.transverse_ratio;
-			  // read signal
-			  offset = z * max_x * max_y;
-			  offset += y * max_x;
-			  offset += x;
-			  offset_phantom = offset * sizeof( signal_t );
-			  offset *= sizeof ( attributes );
-			  phantom_file.seekg (offset_phantom, ios::beg);
-			  phantom_file.read ((char*) &phantom_signal, sizeof ( signal_t ));
-			  data.signal = phantom_signal;
-			  // write data
-			  buffer_file.seekp (offset, ios::beg);
-			  buffer_file.write ((char*) &data, sizeof (attributes));
+			  random = seed_voxel_random ( i % max_x, i / max_x, z, voxel_list->labels[k] );
+			  generate_uncertain_versor ( &( compartment_buffer.direction ), uncertainty_levels[v], &random );
 			}
+		      plane_pool.push_back ( compartment_buffer );
 		    }
-		  }
+		}
+	      filename = variant_directories[v] + compartment_file_name ( z );
+	      out_file.open ( filename.c_str (), ios::out | ios::binary | ios::trunc );
+	      out_file.write ( ( char* ) &plane_counts[0], plane_voxels );
+	      if ( ! plane_pool.empty () )
+		out_file.write ( ( char* ) &plane_pool[0], plane_pool.size () * sizeof ( compartment ) );
+	      out_file.close ();
 	    }
 	}
+      delete[] region_labels;
+      delete[] slab_compartments;
+      delete slab;
     }
   phantom_file.close ();
-
-  // extract masks file
-  prt.f ( verbosity_status, "Saving masks files...\n" );
-  mask_file.open ("mask_x.raw", ios::out | ios::binary | ios::trunc );
-  buffer_file.seekg ( 0, ios::beg );
-  for ( unsigned int z = 0; z < max_z; z++ )
+  for ( unsigned int v = 0; v < uncertainty_levels.size (); v++ )
     {
-      for ( unsigned int y = 0; y < max_y; y++)
-	{
-	  for ( unsigned int x = 0; x < max_x; x++)
-	    {
-	      offset =  z * max_y * max_x;
-	      offset += y * max_x;
-	      offset += x;
-	      offset *= sizeof(attributes);
-	      buffer_file.read ((char*) &data, sizeof(attributes));
-	      mask_file.write ((char*) &data.principal_direction.x, sizeof( double ));
-	    }
-	}
+      mask_x_files[v].close ();
+      mask_y_files[v].close ();
+      mask_z_files[v].close ();
     }
-  mask_file.close ();
-  buffer_file.seekg (0, ios::beg);
-  mask_file.open ("mask_y.raw", ios::out | ios::binary);
-  for ( unsigned int z = 0; z < max_z; z++ )
-    {
-      for ( unsigned int y = 0; y < max_y; y++)
-	{
-	  for ( unsigned int x = 0; x < max_x; x++)
-	    {
-	      offset =  z * max_y * max_x;
-	      offset += y * max_x;
-	      offset += x;
-	      offset *= sizeof(attributes);
-	      buffer_file.read ((char*) &data, sizeof(attributes));
-	      mask_file.write ((char*) &data.principal_direction.y, sizeof( double ));
-	    }
-	}
-    }
-  mask_file.close ();
-  buffer_file.seekg ( 0, ios::beg );
-  mask_file.open ( "mask_z.raw", ios::out | ios::binary );
-  for ( unsigned int z = 0; z < max_z; z++ )
-    {
-      for ( unsigned int y = 0; y < max_y; y++ )
-	{
-	  for ( unsigned int x = 0; x < max_x; x++ )
-	    {
-	      offset =  z * max_y * max_x;
-	      offset += y * max_x;
-	      offset += x;
-	      offset *= sizeof(attributes);
-	      buffer_file.read ((char*) &data, sizeof(attributes));
-	      mask_file.write ((char*) &data.principal_direction.z, sizeof( double ));
-	    }
-	}
-    }
-  mask_file.close ();
+  delete[] mask_x_files;
+  delete[] mask_y_files;
+  delete[] mask_z_files;
+  labels_file.close ();
+  delete[] plane;
+  delete[] plane_components;
+  delete[] plane_labels;
+  delete[] plane_signals;
+  if ( compartments_overflow )
+    cout << "WARNING: more than " << COMPARTMENT_CAPACITY << " objects overlap in some voxels: the last ones add no compartment there." << endl;
 
-  // split buffer in Z files
-  prt.f ( verbosity_status, "Creating the Z files...\n" );
-  for ( unsigned int z = 0; z < max_z; z++)
-    {
-      filename = "sample_adc_z";
-      name_counter.seekp(0);
-      name_counter.width (3);
-      name_counter.fill ('0');
-      name_counter << z;
-      filename += name_counter.str ();
-      filename += ".bin";
-      out_file.open (filename.c_str (), ios::out | ios::binary);
-      offset = z * max_x * max_y * sizeof (attributes);
-      buffer_file.seekg (offset, ios::beg);
-      for ( unsigned int x = 0; x < max_x; x++)
-	{
-	  for ( unsigned int y = 0; y < max_y; y++) 
-	    {
-	      buffer_file.read ((char*) &data, sizeof (attributes));
-	      out_file.write ((char*) &data, sizeof (attributes));
-	    }
-	}
-      out_file.close ();
-      }
-  buffer_file.close ();
+  out_file.open ( COMPILED_SCENE ".tmp", ios::out | ios::trunc );
+  out_file << "# the scene these planes were generated from, for mask_generator -incremental" << endl;
+  for ( unsigned int i = 0; i < scene_header.size (); i++ )
+    out_file << scene_header[i] << endl;
+  for ( map<unsigned short, compiled_object>::iterator i = scene_objects.begin (); i != scene_objects.end (); i++ )
+    out_file << i->second.line << endl;
+  out_file.close ();
+  rename ( COMPILED_SCENE ".tmp", COMPILED_SCENE );
 
   return 0;
 }
@@ -650,25 +1019,25 @@ double_3d get_tangent_versor ( double_3d center, double_3d point )
   return versor;
 }
 
-void generate_random_versor ( double_3d* versor )
+void generate_random_versor ( double_3d* versor, voxel_random* random )
 {
   double    phi;
   double    theta;
 
-  phi   = static_cast<double> ( rand () % 361 );
-  theta = static_cast<double> ( rand () % 181 );
+  phi   = static_cast<double> ( next_random ( random ) % 361 );
+  theta = static_cast<double> ( next_random ( random ) % 181 );
 
   versor->x = sin ( theta ) * cos ( phi );
   versor->y = sin ( theta ) * sin ( phi );
   versor->z = cos ( theta );
 }
 
-void generate_uncertain_versor ( double_3d* versor, const unsigned int uncertainty_percentage )
+void generate_uncertain_versor ( double_3d* versor, const unsigned int uncertainty_percentage, voxel_random* random )
 {
   double    magnitude;
   double_3d random_versor;
 
-  generate_random_versor ( &random_versor );
+  generate_random_versor ( &random_versor, random );
   versor->x = versor->x * ( 100 - uncertainty_percentage ) + random_versor.x * uncertainty_percentage;
   versor->x /= 100;
   versor->y = versor->y * ( 100 - uncertainty_percentage ) + random_versor.y * uncertainty_percentage;
@@ -683,6 +1052,133 @@ void generate_uncertain_versor ( double_3d* versor, const unsigned int uncertain
   versor->z /= magnitude;
 }
 
+voxel_random seed_voxel_random ( unsigned int x, unsigned int y, unsigned int z, unsigned short label )
+{
+  unsigned int seed[4];
+
+  seed[0] = x;
+  seed[1] = y;
+  seed[2] = z;
+  seed[3] = label;
+  return fnv1a ( seed, sizeof ( seed ) );
+}
+
+// splitmix64, which mixes well even from seeds that differ by one bit
+unsigned int next_random ( voxel_random* random )
+{
+  unsigned long long mixed;
+
+  *random += 0x9E3779B97F4A7C15ULL;
+  mixed    = *random;
+  mixed    = ( mixed ^ ( mixed >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+  mixed    = ( mixed ^ ( mixed >> 27 ) ) * 0x94D049BB133111EBULL;
+  return static_cast<unsigned int> ( ( mixed ^ ( mixed >> 31 ) ) >> 33 );
+}
+
+string plane_file_name ( unsigned int z )
+{
+  stringstream name;
+
+  name << "sample_adc_z";
+  name.width ( 3 );
+  name.fill ( '0' );
+  name << z << ".bin";
+  return name.str ();
+}
+
+string compartment_file_name ( unsigned int z )
+{
+  stringstream name;
+
+  name << "sample_compartments_z";
+  name.width ( 3 );
+  name.fill ( '0' );
+  name << z << ".bin";
+  return name.str ();
+}
+
+void add_compartment ( voxel_compartments* voxel, const compartment& added, unsigned short label, bool* overflow )
+{
+  if ( voxel->count == COMPARTMENT_CAPACITY )
+    {
+      *overflow = true;
+      return;
+    }
+  voxel->compartments[voxel->count] = added;
+  voxel->labels[voxel->count]       = label;
+  voxel->count++;
+}
+
+bool read_compiled_scene ( vector<string>& header, map<unsigned short, compiled_object>& objects )
+{
+  compiled_object scene_object;
+  ifstream        scene_file;
+  string          keyword;
+  string          line;
+  unsigned short  label;
+
+  scene_file.open ( COMPILED_SCENE );
+  if ( ! scene_file )
+    return false;
+  while ( getline ( scene_file, line ) )
+    {
+      istringstream fields ( line );
+
+      if ( line == "" || line[0] == '#' )
+	continue;
+      fields >> keyword;
+      if ( keyword != "object" )
+	{
+	  header.push_back ( line );
+	  continue;
+	}
+      if ( ! ( fields >> label >> scene_object.z_begin >> scene_object.z_end ) )
+	return false;
+      scene_object.line = line;
+      objects[label]    = scene_object;
+    }
+  return true;
+}
+
+// the planes of every object added, removed or changed, both where it
+// was and where it is now
+void mark_dirty_planes ( const map<unsigned short, compiled_object>& previous, const map<unsigned short, compiled_object>& current, unsigned int max_z, vector<bool>& dirty )
+{
+  map<unsigned short, compiled_object>::const_iterator i;
+  map<unsigned short, compiled_object>::const_iterator match;
+
+  for ( i = previous.begin (); i != previous.end (); i++ )
+    {
+      match = current.find ( i->first );
+      if ( match != current.end () && match->second.line == i->second.line )
+	continue;
+      for ( unsigned int z = i->second.z_begin; z < i->second.z_end && z < max_z; z++ )
+	dirty[z] = true;
+      if ( match != current.end () )
+	for ( unsigned int z = match->second.z_begin; z < match->second.z_end && z < max_z; z++ )
+	  dirty[z] = true;
+    }
+  for ( i = current.begin (); i != current.end (); i++ )
+    if ( previous.find ( i->first ) == previous.end () )
+      for ( unsigned int z = i->second.z_begin; z < i->second.z_end && z < max_z; z++ )
+	dirty[z] = true;
+}
+
+// objects are numbered across the layers, for the region labels
+unsigned int objects_before_layer ( const sample& xml_sample, unsigned int layer )
+{
+  unsigned int count = 0;
+
+  for ( unsigned int l = 0; l < layer; l++ )
+    count += xml_sample.layers[l].number_of_objects;
+  return count;
+}
+
+bool has_node ( node_pointer* node, const string element_name )
+{
+  return mxmlFindElement ( node->pointer, node->pointer, element_name.c_str (), NULL, NULL, MXML_DESCEND ) != NULL;
+}
+
 void set_value_from_node ( node_pointer* node, const string element_name, double* variable )
 {
   string      result;
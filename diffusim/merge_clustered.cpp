@@ -18,25 +18,26 @@
 # Author can be reached at rborges@if.usp.br
 */
 
-#include <fstream>
+#include <cstdlib>
+#include <fcntl.h>
 #include <iostream>
 #include <sstream>
 #include <string>
-#include <cstdlib>
+#include <unistd.h>
+
+#include "raw_io.hpp"
 
 using namespace std;
 
 int main (int argc, char** argv)
 {
-  ifstream input_file;
-  ofstream output_file;
+  copy_block*  blocks;
+  int          output_fd;
+  int          number_of_blocks;
+  offset_t     output_size;
+  string       file_name;
+  string       input_suffix;
   stringstream string_buffer;
-  string file_name;
-  string input_suffix;
-  int number_of_blocks;
-  int file_size;
-  char* buffer;
-  int output_size;
 
   if (argc < 4)
     {
@@ -49,39 +50,37 @@ int main (int argc, char** argv)
   input_suffix = argv[2];
   number_of_blocks = atoi (argv[3]);
 
-  output_file.open (file_name.c_str ());
-  buffer = new char;
+  // find where each input goes in the output
+  blocks = new copy_block[number_of_blocks];
   output_size = 0;
-
   for (int i = 0; i < number_of_blocks; i++)
     {
-      //cout << output_size << " ";
-      //      file_name = input_suffix;
-      file_name = "";
-      string_buffer.seekp (0);
+      string_buffer.str ("");
       string_buffer.width (3);
       string_buffer.fill ('0');
       string_buffer << i;
-      file_name += string_buffer.str ();
-      file_name += input_suffix;
-      file_name += ".raw";
-      //cout << file_name << endl;
-      input_file.open (file_name.c_str ());
-      input_file.seekg(0,ios::end);
-      file_size = input_file.tellg ();
-      input_file.seekg(0,ios::beg);
-      output_file.seekp(output_size,ios::beg);
-      while (input_file.tellg () < file_size)
+      blocks[i].file_name = string_buffer.str () + input_suffix + ".raw";
+      blocks[i].file_size = file_size ( blocks[i].file_name.c_str () );
+      if ( blocks[i].file_size < 0 )
 	{
-	  input_file.read (buffer, sizeof (char));
-	  output_file.write (buffer, sizeof (char));
+	  cout << "ERROR: cannot stat " << blocks[i].file_name << "." << endl;
+	  exit (1);
 	}
-      input_file.close ();
-      output_size += file_size;
-      //cout << " " << output_size << endl;
+      blocks[i].output_offset = output_size;
+      output_size += blocks[i].file_size;
     }
-  
-  delete buffer;
-  output_file.close ();
+
+  // preallocate the output, so that the inputs can be copied in any order
+  output_fd = open ( file_name.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( output_fd < 0 || ! preallocate ( output_fd, output_size ) )
+    {
+      cout << "ERROR: cannot create " << file_name << "." << endl;
+      exit (1);
+    }
+  close ( output_fd );
+
+  if ( ! parallel_copy ( file_name, blocks, number_of_blocks ) )
+    exit (1);
+  delete[] blocks;
   return 0;
 }
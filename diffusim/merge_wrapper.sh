@@ -67,44 +67,28 @@ for param in $parameters; do
     fi
 done
 
-count=0
 cd ~/latest/$name
-mkdir adc_files
-mv sample_adc_z*.bin adc_files/
-mkdir components
-mkdir dir_files
-# put files for each direction in a single folder, and merge them in a component
+
+# list where every slice of every direction goes in the final file
+echo "slices $number_of_slices" > manifest.txt
+echo "directions $number_of_directions" >> manifest.txt
+echo "b0 000_merged.raw" >> manifest.txt
+count=0
 while read line; do
-    # prepare
     grad_x=`echo $line | awk '{ print $1 }'`
     grad_y=`echo $line | awk '{ print $2 }'`
     grad_z=`echo $line | awk '{ print $3 }'`
-    files=`ls -1 --color=never ${name}_???_${grad_x}_${grad_y}_${grad_z}_att.raw | grep -v "^dir"`
-    mkdir "dir_files/dir_${grad_x}_${grad_y}_${grad_z}"
-    mv $files dir_files/dir_${grad_x}_${grad_y}_${grad_z}/
-    cd dir_files/dir_${grad_x}_${grad_y}_${grad_z}/
-    rename "s/_${grad_x}_${grad_y}_${grad_z}_att\.raw/_att\.raw/" *.raw
-    rename "s/${name}_//" *.raw
-    # merge
-    #echo -e "($count)\t Merging files for direction ${grad_x}\t ${grad_y}\t ${grad_z} "
-    printf "($count)\t Merging files for direction %+01.3f %+01.3f %+01.3f\n" ${grad_x} ${grad_y} ${grad_z}
-    padded=`python -c "print '%03d' % $count"`
-    ../../merge_clustered.exe ${padded}_mer.raw _att $number_of_slices
-    mv ${padded}_mer.raw ../../components
+    slice=0
+    while [ $slice -lt $number_of_slices ]; do
+	number=`printf "%03d" $slice`
+	echo "chunk $count $slice ${name}_${number}_${grad_x}_${grad_y}_${grad_z}_att.raw" >> manifest.txt
+	slice=$(($slice+1))
+    done
     count=$(($count+1))
-    cd ../..
 done < directions.txt
 
-echo "Merging the b0 with the first component..."
-mv components/000_mer.raw components/000_mer_original.raw
-ln -s components/000_mer_original.raw 001_merged.raw
-./merge_clustered.exe 000_mer.raw _merged 2
-mv 000_mer.raw components/
-echo "Merging the components..."
-cd components
-../merge_clustered.exe ${name}_merged.raw _mer $number_of_directions
-cd ..
-mv components/${name}_merged.raw ${name}_synthetic.raw
+echo "Assembling the b0 and $count directions..."
+./assemble_4d.exe manifest.txt ${name}_synthetic.raw || exit 1
 
 # clean up
 cd ..
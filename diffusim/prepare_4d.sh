@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+
+# Creates the final 4D file of a run in direct mode at its full size,
+# with the b0 in place, before any task writes its chunks into it: the
+# tasks only open it (see stejskal_clustered -destination), so that none
+# of them has to preallocate a file the others are writing. Needs
+# assemble_4d.exe, the b0 and the sample_dimensions.txt of
+# mask_generator in the current directory. An existing file keeps the
+# chunks it has.
+
+usage=$(
+cat <<EOF
+USAGE: $0 <PARAMETERS>
+PARAMETERS:
+\t -b b0 file name (default: 000_merged.raw)
+\t -d number of volumes after the b0: gradient directions times shells (*)
+\t -o 4D file name (*)
+\t -s number of slices (*)
+(*) Indicates an obligatory option.
+EOF
+)
+
+b0_file=000_merged.raw
+
+while getopts "b:d:o:s:" OPTION; do
+    case $OPTION in
+	b)  b0_file=$OPTARG
+	    ;;
+	d)  volumes=$OPTARG
+	    ;;
+	o)  output_file=$OPTARG
+	    ;;
+	s)  slices=$OPTARG
+	    ;;
+	*)
+	    echo "Unrecognized option."
+	    echo -e "$usage"
+	    exit 1
+	    ;;
+    esac
+done
+
+parameters="volumes output_file slices"
+for param in $parameters; do
+    eval content=\$$param
+    if [ -z "$content" ]; then
+	echo "ERROR: Missing parameters."
+	echo -e "$usage"
+	exit 1
+    fi
+done
+
+# a chunk is one slice of signal_t voxels
+size_x=`awk '/^size_x/ { print $2 }' sample_dimensions.txt`
+size_y=`awk '/^size_y/ { print $2 }' sample_dimensions.txt`
+manifest=`mktemp prepare_4d.XXXXXX`
+echo -e "slices $slices\ndirections $volumes\nb0 $b0_file\nchunk_size $(($size_x * $size_y * 4))" > $manifest
+./assemble_4d.exe $manifest $output_file
+status=$?
+rm -f $manifest
+if [ ! $status -eq 0 ]; then
+    echo "ERROR: cannot create $output_file."
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,189 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "chunk_manifest.hpp"
+#include "task_list.hpp"
+#include "work_queue.hpp"
+
+using namespace std;
+
+// The coordinator side of the work queue (see work_queue.hpp):
+//
+//   submit: puts every task of a task list in a new queue, but those
+//           a manifest (-manifest, see chunk_manifest.hpp) has as done
+//           and those whose result is cached (-cache, see
+//           result_cache.hpp), which are copied into place instead;
+//   wait:   waits for all of them to be done or failed, taking back
+//           the leases of workers that stopped touching them, and
+//           then closes the queue so that idle workers exit.
+//
+// Workers are started in between, anywhere the queue directory can be
+// seen (queue_worker.exe). Waiting is woken by inotify as soon as a
+// worker on this machine finishes a task; changes made by other
+// machines are seen within a few seconds.
+int main (int argc, char** argv)
+{
+  char                   line[256];
+  chunk_manifest         manifest;
+  int                    attempts;
+  int                    cached;
+  int                    done;
+  int                    failed;
+  int                    lease_seconds;
+  int                    pending;
+  int                    reclaimed;
+  int                    running;
+  int                    timeout;
+  int                    watch_fd;
+  result_cache           cache;
+  string                 cache_directory;
+  string                 manifest_file_name;
+  string                 mode;
+  string                 program;
+  string                 previous_line;
+  vector<synthesis_task> all_tasks;
+  vector<synthesis_task> tasks;
+
+  if ( argc < 3 || ( string ( argv[1] ) == "submit" && argc < 4 ) )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " submit queue_directory task_list_file_name [-attempts number_of_attempts] [-lease seconds] [-manifest manifest_file_name] [-cache cache_directory] [-program ./stejskal_clustered.exe]" << endl;
+      cout << "       " << argv[0] << " wait queue_directory" << endl;
+      exit (1);
+    }
+  mode = argv[1];
+  work_queue queue ( argv[2] );
+
+  if ( mode == "submit" )
+    {
+      attempts      = 3;
+      lease_seconds = 60;
+      program       = "./stejskal_clustered.exe";
+      for ( int i = 4; i < argc - 1; i++ )
+	{
+	  if ( string ( argv[i] ) == "-attempts" )
+	    attempts = atoi ( argv[++i] );
+	  else if ( string ( argv[i] ) == "-lease" )
+	    lease_seconds = atoi ( argv[++i] );
+	  else if ( string ( argv[i] ) == "-manifest" )
+	    manifest_file_name = argv[++i];
+	  else if ( string ( argv[i] ) == "-cache" )
+	    cache_directory = argv[++i];
+	  else if ( string ( argv[i] ) == "-program" )
+	    program = argv[++i];
+	}
+      if ( attempts < 1 )
+	attempts = 1;
+      if ( lease_seconds < 1 )
+	lease_seconds = 1;
+      if ( ! read_task_list ( argv[3], all_tasks ) )
+	{
+	  cout << "ERROR reading task list " << argv[3] << "." << endl;
+	  exit (1);
+	}
+      if ( manifest_file_name != "" && ! manifest.load ( manifest_file_name, program ) )
+	{
+	  cout << "ERROR reading manifest " << manifest_file_name << "." << endl;
+	  exit (1);
+	}
+      if ( cache_directory != "" && ! cache.open ( cache_directory, program ) )
+	{
+	  cout << "ERROR opening cache " << cache_directory << "." << endl;
+	  exit (1);
+	}
+      cached = 0;
+      for ( unsigned int t = 0; t < all_tasks.size (); t++ )
+	{
+	  if ( manifest_file_name != "" && manifest.is_complete ( all_tasks[t] ) )
+	    continue;
+	  if ( cache_directory != "" && task_from_cache ( cache, all_tasks[t] ) )
+	    {
+	      if ( manifest_file_name != "" && ! manifest.record ( all_tasks[t] ) )
+		cout << "WARNING: could not record chunk " << all_tasks[t].id << " in the manifest." << endl;
+	      cached++;
+	      continue;
+	    }
+	  tasks.push_back ( all_tasks[t] );
+	  // so that the workers store what they compute
+	  if ( cache_directory != "" )
+	    tasks.back ().options += " -cache " + cache_directory;
+	}
+      if ( tasks.size () + cached < all_tasks.size () )
+	cout << "Skipping " << all_tasks.size () - tasks.size () - cached << " chunks already done." << endl;
+      if ( cached > 0 )
+	cout << "Took " << cached << " chunks from the cache." << endl;
+      if ( ! queue.create ( tasks, attempts, lease_seconds ) )
+	{
+	  cout << "ERROR creating queue in " << queue.directory << "." << endl;
+	  exit (1);
+	}
+      cout << "Submitted " << tasks.size () << " chunks to " << queue.directory << "." << endl;
+      return 0;
+    }
+
+  if ( mode != "wait" )
+    {
+      cout << "ERROR: unknown mode " << mode << "." << endl;
+      exit (1);
+    }
+  if ( ! queue.load () )
+    {
+      cout << "ERROR: no queue in " << queue.directory << "." << endl;
+      exit (1);
+    }
+  watch_fd = queue.watch ();
+  // often enough to take back a dead worker's lease soon after it expires
+  timeout = queue.lease_seconds / 4;
+  if ( timeout < 1 )
+    timeout = 1;
+  if ( timeout > 5 )
+    timeout = 5;
+  while ( true )
+    {
+      reclaimed = queue.reclaim_expired ();
+      if ( reclaimed > 0 )
+	cout << endl << "Took back " << reclaimed << " expired leases." << endl;
+      queue.count ( &pending, &running, &done, &failed );
+      snprintf ( line, sizeof ( line ), "%d of %d chunks done, %d running, %d pending, %d failed.",
+		 done, queue.number_of_tasks, running, pending, failed );
+      if ( line != previous_line )
+	cout << "\r" << line << flush;
+      previous_line = line;
+      if ( done + failed >= queue.number_of_tasks )
+	break;
+      queue.wait_for_change ( watch_fd, timeout );
+    }
+  cout << endl;
+  if ( watch_fd >= 0 )
+    close ( watch_fd );
+  queue.close ();
+  if ( failed > 0 )
+    {
+      cout << "ERROR: " << failed << " chunks failed after " << queue.attempts << " attempts, see " << queue.directory << "/failed." << endl;
+      exit (1);
+    }
+  return 0;
+}
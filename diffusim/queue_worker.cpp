@@ -0,0 +1,177 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <pthread.h>
+#include <string>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "chunk_manifest.hpp"
+#include "task_list.hpp"
+#include "work_queue.hpp"
+
+using namespace std;
+
+// The worker side of the work queue (see work_queue.hpp): leases one
+// task at a time and runs it, touching the lease while it runs, until
+// the queue is closed or has nothing left. Failed tasks go back to the
+// queue to be retried, by this or any other worker. Start as many as
+// there are cores to spare, on as many machines as see the queue.
+// With -manifest, every chunk done is recorded there (see
+// chunk_manifest.hpp), so that an interrupted run can be resumed.
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  stop_requested;
+  bool            stop;
+  work_queue*     queue;
+  string          lease;
+} heartbeat_job;
+
+void* heartbeat_thread ( void* argument );
+
+int main (int argc, char** argv)
+{
+  chunk_manifest manifest;
+  heartbeat_job  heartbeat;
+  int            done;
+  int            failed;
+  int            pending;
+  int            running;
+  int            status;
+  int            watch_fd;
+  pthread_t      heartbeat_worker;
+  string         lease;
+  string         log_file;
+  string         manifest_file_name;
+  string         program;
+  synthesis_task task;
+  unsigned int   tasks_run;
+
+  if ( argc < 2 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " queue_directory [-program ./stejskal_clustered.exe] [-log log_file_name] [-manifest manifest_file_name]" << endl;
+      exit (1);
+    }
+  work_queue queue ( argv[1] );
+  program  = "./stejskal_clustered.exe";
+  log_file = "";
+  for ( int i = 2; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-program" )
+	program = argv[++i];
+      else if ( string ( argv[i] ) == "-log" )
+	log_file = argv[++i];
+      else if ( string ( argv[i] ) == "-manifest" )
+	manifest_file_name = argv[++i];
+    }
+  if ( ! queue.load () )
+    {
+      cout << "ERROR: no queue in " << queue.directory << "." << endl;
+      exit (1);
+    }
+  if ( manifest_file_name != "" && ! manifest.load ( manifest_file_name, program ) )
+    {
+      cout << "ERROR reading manifest " << manifest_file_name << "." << endl;
+      exit (1);
+    }
+
+  pthread_mutex_init ( &( heartbeat.lock ), NULL );
+  pthread_cond_init ( &( heartbeat.stop_requested ), NULL );
+  heartbeat.queue = &queue;
+  watch_fd        = queue.watch ();
+  tasks_run       = 0;
+  while ( true )
+    {
+      if ( queue.claim ( task, lease ) )
+	{
+	  cout << "Running chunk " << task.id << "." << endl;
+	  heartbeat.stop  = false;
+	  heartbeat.lease = lease;
+	  if ( pthread_create ( &heartbeat_worker, NULL, heartbeat_thread, &heartbeat ) != 0 )
+	    {
+	      cout << "ERROR creating thread." << endl;
+	      queue.retry ( lease );
+	      exit (1);
+	    }
+	  status = run_task ( task, program, log_file );
+	  pthread_mutex_lock ( &( heartbeat.lock ) );
+	  heartbeat.stop = true;
+	  pthread_cond_signal ( &( heartbeat.stop_requested ) );
+	  pthread_mutex_unlock ( &( heartbeat.lock ) );
+	  pthread_join ( heartbeat_worker, NULL );
+	  tasks_run++;
+	  if ( status != 0 )
+	    {
+	      cout << "ERROR: chunk " << task.id << " failed (status " << status << ")." << endl;
+	      queue.retry ( lease );
+	    }
+	  else
+	    {
+	      // recorded before it is marked done, so that a chunk done is
+	      // always in the manifest
+	      if ( manifest_file_name != "" && ! manifest.record ( task ) )
+		cout << "WARNING: could not record chunk " << task.id << " in the manifest." << endl;
+	      if ( ! queue.complete ( lease ) )
+		cout << "Chunk " << task.id << " was taken back before it was done." << endl;
+	    }
+	  continue;
+	}
+      if ( queue.closed () )
+	break;
+      // nothing to lease: wait for a retry, or for the queue to close
+      queue.count ( &pending, &running, &done, &failed );
+      if ( pending == 0 && running == 0 && done + failed >= queue.number_of_tasks )
+	break;
+      queue.wait_for_change ( watch_fd, 5 );
+    }
+  if ( watch_fd >= 0 )
+    close ( watch_fd );
+  cout << "Ran " << tasks_run << " chunks." << endl;
+  return 0;
+}
+
+void* heartbeat_thread ( void* argument )
+{
+  heartbeat_job*  job = static_cast<heartbeat_job*> ( argument );
+  struct timespec deadline;
+  struct timeval  now;
+  int             interval;
+
+  interval = job->queue->lease_seconds / 4;
+  if ( interval < 1 )
+    interval = 1;
+  pthread_mutex_lock ( &( job->lock ) );
+  while ( ! job->stop )
+    {
+      gettimeofday ( &now, NULL );
+      deadline.tv_sec  = now.tv_sec + interval;
+      deadline.tv_nsec = now.tv_usec * 1000;
+      pthread_cond_timedwait ( &( job->stop_requested ), &( job->lock ), &deadline );
+      if ( ! job->stop && ! job->queue->heartbeat ( job->lease ) )
+	break;
+    }
+  pthread_mutex_unlock ( &( job->lock ) );
+  return NULL;
+}
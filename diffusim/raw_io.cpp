@@ -0,0 +1,248 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "raw_io.hpp"
+
+using namespace std;
+
+typedef struct
+{
+  copy_block*     blocks;
+  int             number_of_blocks;
+  // both written by every worker, under lock
+  int             next_block;
+  bool            failed;
+  string          output_file_name;
+  pthread_mutex_t lock;
+} copy_job;
+
+offset_t file_size ( int fd )
+{
+  struct stat status;
+
+  if ( fstat ( fd, &status ) != 0 )
+    return -1;
+  return status.st_size;
+}
+
+offset_t file_size ( const char* file_name )
+{
+  struct stat status;
+
+  if ( stat ( file_name, &status ) != 0 )
+    return -1;
+  return status.st_size;
+}
+
+bool preallocate ( int fd, offset_t size )
+{
+  // reserve the blocks up front when the filesystem can; otherwise
+  // at least set the final size, so that writes can land anywhere
+  if ( size == 0 )
+    return true;
+  if ( posix_fallocate ( fd, 0, size ) == 0 )
+    return true;
+  return ftruncate ( fd, size ) == 0;
+}
+
+bool read_at ( int fd, void* buffer, offset_t length, offset_t offset )
+{
+  ssize_t result;
+  char*   position = static_cast<char*> ( buffer );
+
+  while ( length > 0 )
+    {
+      result = pread ( fd, position, length, offset );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result <= 0 )
+	return false;
+      position += result;
+      offset   += result;
+      length   -= result;
+    }
+  return true;
+}
+
+bool write_at ( int fd, const void* buffer, offset_t length, offset_t offset )
+{
+  ssize_t     result;
+  const char* position = static_cast<const char*> ( buffer );
+
+  while ( length > 0 )
+    {
+      result = pwrite ( fd, position, length, offset );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result <= 0 )
+	return false;
+      position += result;
+      offset   += result;
+      length   -= result;
+    }
+  return true;
+}
+
+static bool copy_with_buffer ( int in_fd, offset_t in_offset, int out_fd, offset_t out_offset, offset_t length )
+{
+  offset_t chunk;
+  void*    buffer;
+  bool     ok = true;
+
+  if ( posix_memalign ( &buffer, RAW_IO_ALIGNMENT, RAW_IO_BUFFER_SIZE ) != 0 )
+    return false;
+  while ( ok && length > 0 )
+    {
+      chunk = length < RAW_IO_BUFFER_SIZE ? length : RAW_IO_BUFFER_SIZE;
+      ok = read_at ( in_fd, buffer, chunk, in_offset ) && write_at ( out_fd, buffer, chunk, out_offset );
+      in_offset  += chunk;
+      out_offset += chunk;
+      length     -= chunk;
+    }
+  free ( buffer );
+  return ok;
+}
+
+bool copy_range ( int in_fd, offset_t in_offset, int out_fd, offset_t out_offset, offset_t length )
+{
+  loff_t  in_position  = in_offset;
+  loff_t  out_position = out_offset;
+  off_t   send_position;
+  ssize_t result;
+
+  // first choice: let the kernel copy (or reflink) without ever
+  // bringing the data to user space
+  while ( length > 0 )
+    {
+      result = copy_file_range ( in_fd, &in_position, out_fd, &out_position, length, 0 );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result <= 0 )
+	break;
+      length -= result;
+    }
+  if ( length == 0 )
+    return true;
+
+  // second choice: sendfile, which writes at the current position of
+  // out_fd, so the caller must not share out_fd with other threads
+  if ( lseek ( out_fd, out_position, SEEK_SET ) == out_position )
+    {
+      send_position = in_position;
+      while ( length > 0 )
+	{
+	  result = sendfile ( out_fd, in_fd, &send_position, length );
+	  if ( result < 0 && errno == EINTR )
+	    continue;
+	  if ( result <= 0 )
+	    break;
+	  length       -= result;
+	  out_position += result;
+	}
+      in_position = send_position;
+      if ( length == 0 )
+	return true;
+    }
+
+  // last resort: large aligned buffers
+  return copy_with_buffer ( in_fd, in_position, out_fd, out_position, length );
+}
+
+static void* copy_worker ( void* argument )
+{
+  int       block;
+  int       input_fd;
+  int       output_fd;
+  copy_job* job = static_cast<copy_job*> ( argument );
+
+  // each worker has its own descriptor, since sendfile moves its position
+  output_fd = open ( job->output_file_name.c_str (), O_WRONLY );
+  if ( output_fd < 0 )
+    {
+      perror ( job->output_file_name.c_str () );
+      pthread_mutex_lock ( &job->lock );
+      job->failed = true;
+      pthread_mutex_unlock ( &job->lock );
+      return NULL;
+    }
+  while ( true )
+    {
+      pthread_mutex_lock ( &job->lock );
+      block = job->next_block++;
+      pthread_mutex_unlock ( &job->lock );
+      if ( block >= job->number_of_blocks )
+	break;
+
+      input_fd = open ( job->blocks[block].file_name.c_str (), O_RDONLY );
+      if ( input_fd < 0 ||
+	   ! copy_range ( input_fd, 0, output_fd, job->blocks[block].output_offset, job->blocks[block].file_size ) )
+	{
+	  perror ( job->blocks[block].file_name.c_str () );
+	  pthread_mutex_lock ( &job->lock );
+	  job->failed = true;
+	  pthread_mutex_unlock ( &job->lock );
+	}
+      if ( input_fd >= 0 )
+	close ( input_fd );
+    }
+  close ( output_fd );
+  return NULL;
+}
+
+bool parallel_copy ( const string& output_file_name, copy_block* blocks, int number_of_blocks )
+{
+  copy_job   job;
+  int        number_of_threads;
+  pthread_t* threads;
+
+  job.blocks           = blocks;
+  job.number_of_blocks = number_of_blocks;
+  job.next_block       = 0;
+  job.failed           = false;
+  job.output_file_name = output_file_name;
+  pthread_mutex_init ( &job.lock, NULL );
+
+  number_of_threads = sysconf ( _SC_NPROCESSORS_ONLN );
+  if ( number_of_threads > number_of_blocks )
+    number_of_threads = number_of_blocks;
+  if ( number_of_threads < 1 )
+    number_of_threads = 1;
+  threads = new pthread_t[number_of_threads];
+  for ( int i = 0; i < number_of_threads; i++ )
+    pthread_create ( &threads[i], NULL, copy_worker, &job );
+  for ( int i = 0; i < number_of_threads; i++ )
+    pthread_join ( threads[i], NULL );
+
+  pthread_mutex_destroy ( &job.lock );
+  delete[] threads;
+  return ! job.failed;
+}
@@ -0,0 +1,53 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef RAW_IO
+#define RAW_IO
+
+#include <string>
+
+#include "data_structures.hpp"
+
+// size of the bounce buffer used when the kernel cannot copy for us
+#define RAW_IO_BUFFER_SIZE ( 8 * 1024 * 1024 )
+#define RAW_IO_ALIGNMENT   4096
+
+// All functions take plain file descriptors and explicit offsets, so
+// that several threads can work on the same file at once. They return
+// false on failure, leaving errno set.
+offset_t file_size   ( int fd );
+offset_t file_size   ( const char* file_name );
+bool     preallocate ( int fd, offset_t size );
+bool     read_at     ( int fd, void* buffer, offset_t length, offset_t offset );
+bool     write_at    ( int fd, const void* buffer, offset_t length, offset_t offset );
+bool     copy_range  ( int in_fd, offset_t in_offset, int out_fd, offset_t out_offset, offset_t length );
+
+// A whole file to be copied to output_offset of some output file.
+typedef struct
+{
+  std::string file_name;
+  offset_t    file_size;
+  offset_t    output_offset;
+} copy_block;
+
+// Copies every block into the (already preallocated) output, with one
+// thread per core, each block written exactly once.
+bool     parallel_copy ( const std::string& output_file_name, copy_block* blocks, int number_of_blocks );
+
+#endif
@@ -0,0 +1,135 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "raw_io.hpp"
+#include "result_cache.hpp"
+
+using namespace std;
+
+result_cache::result_cache ()
+{
+  program_hash = FNV_OFFSET_BASIS;
+}
+
+bool result_cache::open ( const string& cache_directory, const string& program )
+{
+  directory = cache_directory;
+  if ( mkdir ( directory.c_str (), 0755 ) != 0 && errno != EEXIST )
+    return false;
+  return hash_file ( program, &program_hash );
+}
+
+bool result_cache::key ( const string& sample_file, const double_3d& gradient, const parameters& sequence, hash_t* key )
+{
+  hash_t sample_hash;
+
+  if ( sample_hashes.find ( sample_file ) == sample_hashes.end () )
+    {
+      if ( ! hash_file ( sample_file, &sample_hash ) )
+	return false;
+      sample_hashes[sample_file] = sample_hash;
+    }
+  sample_hash = sample_hashes[sample_file];
+
+  *key = fnv1a ( &program_hash, sizeof ( program_hash ) );
+  *key = fnv1a ( &sample_hash, sizeof ( sample_hash ), *key );
+  *key = hash_sequence ( sequence, gradient, *key );
+  return true;
+}
+
+string result_cache::entry ( hash_t key )
+{
+  char name[32];
+
+  snprintf ( name, sizeof ( name ), "%016llx", key );
+  return directory + "/" + string ( name, 2 ) + "/" + name + ".raw";
+}
+
+bool result_cache::fetch ( hash_t key, const string& file_name, offset_t offset, offset_t length, bool own_file )
+{
+  int  entry_fd;
+  int  output_fd;
+  bool result;
+
+  entry_fd = ::open ( entry ( key ).c_str (), O_RDONLY );
+  if ( entry_fd < 0 )
+    return false;
+  if ( file_size ( entry_fd ) != length )
+    {
+      ::close ( entry_fd );
+      return false;
+    }
+  // a chunk of a shared file goes into the file the driver created
+  output_fd = ::open ( file_name.c_str (), O_WRONLY | ( own_file ? O_CREAT | O_TRUNC : 0 ), 0644 );
+  if ( output_fd < 0 )
+    {
+      ::close ( entry_fd );
+      return false;
+    }
+  result = copy_range ( entry_fd, 0, output_fd, offset, length );
+  ::close ( entry_fd );
+  ::close ( output_fd );
+  return result;
+}
+
+bool result_cache::store ( hash_t key, const string& file_name, offset_t offset, offset_t length )
+{
+  char         host[256];
+  int          input_fd;
+  int          entry_fd;
+  bool         result;
+  string       entry_file_name;
+  stringstream temporary_name;
+
+  entry_file_name = entry ( key );
+  if ( mkdir ( entry_file_name.substr ( 0, entry_file_name.rfind ( '/' ) ).c_str (), 0755 ) != 0 && errno != EEXIST )
+    return false;
+  // unique across the hosts that share the directory
+  if ( gethostname ( host, sizeof ( host ) ) != 0 )
+    snprintf ( host, sizeof ( host ), "unknown" );
+  host[sizeof ( host ) - 1] = '\0';
+  temporary_name << entry_file_name << "." << host << "." << getpid () << ".tmp";
+
+  input_fd = ::open ( file_name.c_str (), O_RDONLY );
+  if ( input_fd < 0 )
+    return false;
+  entry_fd = ::open ( temporary_name.str ().c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( entry_fd < 0 )
+    {
+      ::close ( input_fd );
+      return false;
+    }
+  result = copy_range ( input_fd, offset, entry_fd, 0, length );
+  ::close ( input_fd );
+  if ( ::close ( entry_fd ) != 0 )
+    result = false;
+  if ( result )
+    result = rename ( temporary_name.str ().c_str (), entry_file_name.c_str () ) == 0;
+  if ( ! result )
+    unlink ( temporary_name.str ().c_str () );
+  return result;
+}
@@ -0,0 +1,64 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef RESULT_CACHE
+#define RESULT_CACHE
+
+#include <map>
+#include <string>
+
+#include "content_hash.hpp"
+#include "data_structures.hpp"
+#include "sequence.hpp"
+
+// Attenuated slices kept on disk between experiments, named after what
+// they were computed from: the contents of the sample slice, the
+// gradient, the pulse sequence with the hash of its waveform, the
+// diffusion model with the hash of the compartments, and the program
+// that computed them (see hash_sequence). The time step is left out:
+// the integration is exact. Experiments that share slices, such as one rerun with
+// another set of directions, then take those from here instead of
+// integrating them again. The layout is
+//
+//   <cache directory>/<first 2 digits of the key>/<key>.raw
+//
+// each entry holding the signal_t voxels of one slice. Entries are
+// written to a temporary file and renamed into place, so that a reader
+// never sees one half written, and any number of processes, on any
+// number of hosts sharing the directory, can fill the cache at once.
+// Nothing is ever evicted: remove the directory to empty it.
+class result_cache
+{
+ public:
+  result_cache ();
+  bool        open  ( const std::string& cache_directory, const std::string& program );
+  bool        key   ( const std::string& sample_file, const double_3d& gradient, const parameters& sequence, hash_t* key );
+  std::string entry ( hash_t key );
+  // copy the entry into, or from, length bytes at offset of file_name;
+  // a file of its own is truncated to the slice when fetched into, a
+  // shared one must already exist
+  bool        fetch ( hash_t key, const std::string& file_name, offset_t offset, offset_t length, bool own_file );
+  bool        store ( hash_t key, const std::string& file_name, offset_t offset, offset_t length );
+ private:
+  std::string                   directory;
+  hash_t                        program_hash;
+  std::map<std::string, hash_t> sample_hashes;
+};
+
+#endif
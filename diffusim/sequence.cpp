@@ -0,0 +1,156 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "sequence.hpp"
+
+using namespace std;
+
+void experimental_parameters ( parameters* params, double number_of_steps )
+{
+  params->gamma                 = 42.576;
+  params->gradient              = REFERENCE_GRADIENT; // b = 1000; other b values in a shell table
+
+  params->gradient_zero         = 3;
+  params->delta_lowercase       = 13.9e-3;
+  params->delta_uppercase       = 23.8e-3;
+  params->t1                    = 5e-3;
+  params->tau                   = params->t1 + params->delta_lowercase + ( params->delta_uppercase - params->delta_lowercase ) / 2;   // guessing from sequence shape
+  params->tau_prime             = params->tau * 2;
+  //params->tau_prime             = 51.67e-3; // from "echo time" parameter in .REC file
+  //params->tau                   = params->tau_prime / 2;
+  params->sim_time_step         = static_cast<double> ( params->tau_prime / number_of_steps );
+  params->diffusion_coefficient = 0;
+  params->waveform_hash         = 0;
+  params->diffusion_model       = 0;
+  params->compartments_hash     = 0;
+}
+
+hash_t hash_sequence ( const parameters& sequence, const double_3d& gradient, hash_t hash )
+{
+  double values[11];
+
+  // not the time step: the integration is exact
+  values[0]  = gradient.x;
+  values[1]  = gradient.y;
+  values[2]  = gradient.z;
+  values[3]  = sequence.gamma;
+  values[4]  = sequence.gradient;
+  values[5]  = sequence.gradient_zero;
+  values[6]  = sequence.delta_lowercase;
+  values[7]  = sequence.delta_uppercase;
+  values[8]  = sequence.tau;
+  values[9]  = sequence.tau_prime;
+  values[10] = sequence.t1;
+  hash = fnv1a ( values, sizeof ( values ), hash );
+  hash = fnv1a ( &( sequence.waveform_hash ), sizeof ( sequence.waveform_hash ), hash );
+  hash = fnv1a ( &( sequence.diffusion_model ), sizeof ( sequence.diffusion_model ), hash );
+  return fnv1a ( &( sequence.compartments_hash ), sizeof ( sequence.compartments_hash ), hash );
+}
+
+double gradient_for_b_value ( double b_value )
+{
+  return REFERENCE_GRADIENT * sqrt ( b_value / REFERENCE_B_VALUE );
+}
+
+bool read_shell_table ( const string& file_name, vector<double>& gradients )
+{
+  ifstream shell_file;
+  string   line;
+  string   kind;
+  double   value;
+
+  gradients.clear ();
+  if ( file_name == "" )
+    {
+      gradients.push_back ( REFERENCE_GRADIENT );
+      return true;
+    }
+  shell_file.open ( file_name.c_str () );
+  if ( ! shell_file )
+    return false;
+  while ( getline ( shell_file, line ) )
+    {
+      if ( line.find ( '#' ) != string::npos )
+	line = line.substr ( 0, line.find ( '#' ) );
+      if ( line.find_first_not_of ( " \t" ) == string::npos )
+	continue;
+      istringstream fields ( line );
+      if ( ! ( fields >> kind >> value ) || value < 0 )
+	return false;
+      if ( kind == "b" )
+	gradients.push_back ( gradient_for_b_value ( value ) );
+      else if ( kind == "gradient" )
+	gradients.push_back ( value );
+      else
+	return false;
+    }
+  return gradients.size () > 0;
+}
+
+bool read_gradient_table ( const string& file_name, vector<double_3d>& gradients )
+{
+  ifstream  gradient_file;
+  string    line;
+  double_3d gradient;
+
+  gradients.clear ();
+  gradient_file.open ( file_name.c_str () );
+  if ( ! gradient_file )
+    return false;
+  while ( getline ( gradient_file, line ) )
+    {
+      if ( line.find_first_not_of ( " \t" ) == string::npos )
+	continue;
+      istringstream fields ( line );
+      if ( ! ( fields >> gradient.x >> gradient.y >> gradient.z ) )
+	return false;
+      gradients.push_back ( gradient );
+    }
+  return gradients.size () > 0;
+}
+
+string shell_output_file ( const string& prefix, int shell, int number_of_shells )
+{
+  stringstream name;
+
+  name << prefix;
+  if ( number_of_shells > 1 )
+    name << "_shell" << shell;
+  name << "_att.raw";
+  return name.str ();
+}
+
+string gradient_output_prefix ( const string& prefix, int direction, int number_of_gradients )
+{
+  stringstream name;
+
+  name << prefix;
+  if ( number_of_gradients > 1 )
+    name << "_d" << direction;
+  return name.str ();
+}
+
+offset_t shell_chunk_offset ( offset_t b0_size, int shell, int direction, int slice, int number_of_directions, int number_of_slices, offset_t chunk_size )
+{
+  return b0_size + ( ( static_cast<offset_t> ( shell ) * number_of_directions + direction ) * number_of_slices + slice ) * chunk_size;
+}
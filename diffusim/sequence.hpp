@@ -0,0 +1,86 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef SEQUENCE
+#define SEQUENCE
+
+#include <string>
+#include <vector>
+
+#include "content_hash.hpp"
+#include "data_structures.hpp"
+
+// The gradient amplitude of the sequence was calibrated for this b
+// value; b grows with the square of the amplitude.
+#define REFERENCE_B_VALUE  1000          // s/mm^2
+#define REFERENCE_GRADIENT 0.000386019   // T/m
+
+struct parameters
+{
+  double sim_time_step;         // seconds
+  double gamma;                 // radian second^-1 Tesla^-1
+  double diffusion_coefficient; // m^2/second
+  double gradient;              // T/m
+  double gradient_zero;         // T/m
+  double delta_lowercase;       // seconds
+  double delta_uppercase;       // seconds
+  double tau;                   // seconds
+  double tau_prime;             // seconds: time when 1st echo amplitude is maximal
+  double t1;                    // seconds: time when 1st gradient pulse occurs
+  hash_t waveform_hash;         // of the gradient waveform (see waveform.hpp)
+  int    diffusion_model;       // diffusion_model_type (see diffusion_model.hpp)
+  hash_t compartments_hash;     // of the compartments file, with the compartment model
+};
+
+// The pulse sequence of the experiments. The attenuation is integrated
+// exactly (see waveform.hpp): number_of_steps only sets sim_time_step,
+// which results no longer depend on. Anything that reuses results (see
+// result_cache.hpp) takes them from here, so that it sees the sequence
+// the synthesis sees.
+void   experimental_parameters ( parameters* params, double number_of_steps );
+
+// Hashes what an attenuation depends on, but the voxel: the sequence
+// (without its per voxel diffusion coefficient) and the gradient.
+hash_t hash_sequence           ( const parameters& sequence, const double_3d& gradient, hash_t hash = FNV_OFFSET_BASIS );
+
+// A shell table gives the gradient amplitude of each shell that a run
+// synthesizes, one shell per line ('#' starts a comment):
+//
+//   b <b value in s/mm^2>
+//   gradient <amplitude in T/m>
+//
+// An empty file name stands for the single shell of
+// experimental_parameters.
+double gradient_for_b_value    ( double b_value );
+bool   read_shell_table        ( const std::string& file_name, std::vector<double>& gradients );
+
+// The gradient directions of a run, one "x y z" per line, as in
+// directions.txt.
+bool   read_gradient_table     ( const std::string& file_name, std::vector<double_3d>& gradients );
+
+// Where the attenuated slice of a shell goes: prefix_att.raw when there
+// is a single shell, prefix_shell<k>_att.raw otherwise; or its chunk of
+// the final 4D file, where the shells follow each other:
+//   [b0][shell 0: direction 0: slice 0 .. slice n-1][direction 1: ...]...[shell 1: ...]
+// A run of several gradient directions adds _d<direction> to the prefix.
+std::string shell_output_file  ( const std::string& prefix, int shell, int number_of_shells );
+std::string gradient_output_prefix ( const std::string& prefix, int direction, int number_of_gradients );
+offset_t    shell_chunk_offset ( offset_t b0_size, int shell, int direction, int slice, int number_of_directions, int number_of_slices, offset_t chunk_size );
+
+#endif
@@ -21,116 +21,210 @@
 #include <iostream>
 #include <math.h>
 #include <cstdlib>
+#include <fcntl.h>
 #include <fstream>
 #include <string>
+#include <unistd.h>
+#include <vector>
 
 #include "data_structures.hpp"
+#include "diffusion_model.hpp"
+#include "factor_table.hpp"
 #include "pretty.hpp"
+#include "raw_io.hpp"
+#include "result_cache.hpp"
+#include "sequence.hpp"
+#include "waveform.hpp"
 
 pretty prt;
 
-typedef struct
-{
-  attributes attr;
-  signal_t attenuated_signal;
-} precomputed;
-
-#define MAX_PRECOMPUTED 1000
-
-double integration            ( double, double, double (*) (double) );
-double naive_integration      ( double, double, double (*) (double) );
-double f_uppercase            ( double );
-double int_f_uppercase        ( double, double );
-double f_uppercase_square     ( double );
-double int_f_uppercase_square ( double, double );
-double f_lowercase            ( void );
-double g                      ( double );
-double attenuation            ( void );
+double attenuation            ( double );
 double b_value                ( void );
 void   stejskal_tanner        ( void );
 
 using namespace std;
 
-struct parameters
-{
-  double sim_time_step;         // seconds
-  double gamma;                 // radian second^-1 Tesla^-1
-  double diffusion_coefficient; // m^2/second
-  double gradient;              // T/m
-  double gradient_zero;         // T/m
-  double delta_lowercase;       // seconds
-  double delta_uppercase;       // seconds
-  double tau;                   // seconds
-  double tau_prime;             // seconds: time when 1st echo amplitude is maximal
-  double t1;                    // seconds: time when 1st gradient pulse occurs
-};
-
 parameters params;
 
 int main(int argc, char** argv)
 {
   attributes   data;
+  attributes*  sample_block;
   double       dot_product_aux;
+  bool         diffusion_known;
   bool         flag;
   double       conversion_aux;
+  double       factor;
   double       gradient_modulus;
   double       principal_direction_modulus;
+  double       tensor[TENSOR_COMPONENTS];
+  double*      tensor_block;
+  double*      diffusivity_block;
+  double*      compartment_attenuation_block;
   double_3d    gradient_direction;
+  diffusion_model_type model;
+  factor_table* factors;
   ifstream     sample_file;
-  int          sample_file_size;
-  int          index_last_value_stored;
-  int          number_values_stored;
+  ifstream     compartments_file;
+  int          destination_fd;
+  int          direction_index;
+  int          number_of_directions;
+  int          number_of_gradients;
+  int          number_of_outputs;
+  int          number_of_shells;
+  int          number_of_slices;
+  int          output;
+  int          outputs_to_compute;
+  int          slice_index;
   int          sizeof_signal_t;
-  ofstream     attenuated_out_file;
-  precomputed  precomputed_values[MAX_PRECOMPUTED];
+  offset_t     b0_size;
+  offset_t     block_voxels;
+  offset_t     chunk_size;
+  offset_t     compartments_in_block;
+  offset_t     number_of_compartments;
+  offset_t     memory_budget;
+  offset_t     number_of_voxels;
+  offset_t     sample_file_size;
+  offset_t     voxels_in_block;
+  ofstream*    attenuated_out_files;
+  result_cache cache;
+  hash_t       program_hash;
   signal_t     signal;
   signal_t     attenuated_signal;
+  signal_t*    attenuated_block;
   string       sample_filename;
   string       signal_output_filename;
-  string       attenuated_output_filename;
+  string       destination_filename;
+  string       cache_directory;
+  string       factors_directory;
+  string       shell_table;
+  string       gradient_table;
+  string       model_name;
+  string       compartments_filename;
+  string       waveform_filename;
+  waveform     shape;
+  offset_t     factors_size;
+  offset_t     factors_added;
+  // one of each per shell
+  vector<double>     shell_gradients;
+  vector<double>     shell_integrals;
+  vector<double>     shell_coefficients;
+  vector<parameters> shell_params;
+  // one of each per gradient direction
+  vector<double_3d>  gradients;
+  vector<double>     gradient_moduli;
+  vector<double>     gradient_term_table;
+  // one of each per output, shell by shell and, within a shell,
+  // direction by direction
+  vector<bool>       output_cached;
+  vector<hash_t>     cache_keys;
+  vector<offset_t>   chunk_offsets;
+  vector<string>     output_filenames;
+  // with the compartment model: the count of every voxel, and the
+  // compartments of a block
+  vector<unsigned char> compartment_counts;
+  vector<compartment>   compartment_block;
+  // with the principal model: the voxels of a block whose factors go
+  // in the table
+  vector<bool>          recurring;
   
   //prt.current_verbosity_level = verbosity_error;
   prt.current_verbosity_level = verbosity_status;
   //prt.current_verbosity_level = verbosity_debug;
 
   // preparation
-  index_last_value_stored = 0;
-  number_values_stored = 0;
   sizeof_signal_t = sizeof ( signal_t );
   prt.f ( verbosity_debug, "sizeof ( signal_t )   == %d.\n", sizeof_signal_t );
 
-  // experimental values:
-  params.gamma                 = 42.576;
-  //params.gradient              = 0.000193009; // b = 0250
-  //params.gradient              = 0.000272956; // b = 0500
-  //params.gradient              = 0.000334302; // b = 0750
-  params.gradient              = 0.000386019; // b = 1000
-
-  params.gradient_zero         = 3;
-  params.delta_lowercase       = 13.9e-3;
-  params.delta_uppercase       = 23.8e-3;
-  params.t1                    = 5e-3;
-  //params.sim_time_step         = 1e-4; // ~ 460 steps
-  params.tau                   = params.t1 + params.delta_lowercase + ( params.delta_uppercase - params.delta_lowercase ) / 2;   // guessing from sequence shape
-  params.tau_prime             = params.tau * 2;
-  //params.tau_prime             = 51.67e-3; // from "echo time" parameter in .REC file
-  //params.tau                   = params.tau_prime / 2;
-  
   // parse input
   if (argc < 7)
     {
       cout << "ERROR: too few arguments." << endl;
-      cout << "USAGE: " << argv[0] << " input_file output_filename_prefix gradient_direction_x gradient_direction_y gradient_direction_z number_of_steps" << endl;
+      cout << "USAGE: " << argv[0] << " input_file output_filename_prefix gradient_direction_x gradient_direction_y gradient_direction_z number_of_steps [-memory memory_budget_in_MB] [-cache cache_directory] [-factors factor_table_directory] [-shells shell_table] [-waveform waveform_file] [-model principal|tensor|compartments] [-compartments compartments_file] [-gradients gradient_table] [-destination 4d_file_name -direction direction_index -slice slice_index -directions number_of_directions -slices number_of_slices -b0_size b0_size_in_bytes]" << endl;
       exit (1);
     }
   sample_filename = argv[1];
   signal_output_filename = argv[2];
-  attenuated_output_filename = signal_output_filename + "_att.raw";
-  signal_output_filename += "_out.raw";
   gradient_direction.x = atof (argv[3]);
   gradient_direction.y = atof (argv[4]);
   gradient_direction.z = atof (argv[5]);
-  params.sim_time_step = static_cast<double> ( params.tau_prime / atof ( argv[6] ) );
+  // experimental values (see sequence.cpp)
+  experimental_parameters ( &params, atof ( argv[6] ) );
+  memory_budget = 64;
+  b0_size = 0;
+  direction_index = 0;
+  slice_index = 0;
+  number_of_directions = 0;
+  number_of_slices = 0;
+  model_name = "principal";
+  for ( int i = 7; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-memory" )
+	memory_budget = atoll ( argv[++i] );
+      else if ( string ( argv[i] ) == "-cache" )
+	cache_directory = argv[++i];
+      else if ( string ( argv[i] ) == "-factors" )
+	factors_directory = argv[++i];
+      else if ( string ( argv[i] ) == "-shells" )
+	shell_table = argv[++i];
+      else if ( string ( argv[i] ) == "-waveform" )
+	waveform_filename = argv[++i];
+      else if ( string ( argv[i] ) == "-model" )
+	model_name = argv[++i];
+      else if ( string ( argv[i] ) == "-gradients" )
+	gradient_table = argv[++i];
+      else if ( string ( argv[i] ) == "-compartments" )
+	compartments_filename = argv[++i];
+      else if ( string ( argv[i] ) == "-destination" )
+	destination_filename = argv[++i];
+      else if ( string ( argv[i] ) == "-direction" )
+	direction_index = atoi ( argv[++i] );
+      else if ( string ( argv[i] ) == "-slice" )
+	slice_index = atoi ( argv[++i] );
+      else if ( string ( argv[i] ) == "-directions" )
+	number_of_directions = atoi ( argv[++i] );
+      else if ( string ( argv[i] ) == "-slices" )
+	number_of_slices = atoi ( argv[++i] );
+      else if ( string ( argv[i] ) == "-b0_size" )
+	b0_size = atoll ( argv[++i] );
+    }
+  memory_budget *= 1024 * 1024;
+  if ( ! diffusion_model_from_name ( model_name, &model ) )
+    {
+      cout << "ERROR: unknown diffusion model " << model_name << "." << endl;
+      exit (1);
+    }
+  params.diffusion_model = model;
+  // With -gradients, every direction of the table is computed in this
+  // run, as directions direction_index onwards; otherwise only the one
+  // given.
+  if ( gradient_table == "" )
+    gradients.push_back ( gradient_direction );
+  else if ( ! read_gradient_table ( gradient_table, gradients ) )
+    {
+      cout << "ERROR: cannot read the gradient table " << gradient_table << "." << endl;
+      exit (1);
+    }
+  number_of_gradients = gradients.size ();
+  if ( destination_filename != "" &&
+       ( direction_index < 0 || direction_index + number_of_gradients > number_of_directions ||
+	 slice_index     < 0 || slice_index     >= number_of_slices ) )
+    {
+      cout << "ERROR: direction or slice outside of the destination file." << endl;
+      exit (1);
+    }
+  if ( ! read_shell_table ( shell_table, shell_gradients ) )
+    {
+      cout << "ERROR: cannot read the shell table " << shell_table << "." << endl;
+      exit (1);
+    }
+  number_of_shells  = shell_gradients.size ();
+  number_of_outputs = number_of_shells * number_of_gradients;
+  if ( ! read_waveform ( waveform_filename, &params, &shape ) )
+    {
+      cout << "ERROR: cannot read the waveform " << waveform_filename << "." << endl;
+      exit (1);
+    }
 
   // parameters
   sample_file.open (sample_filename.c_str (), ios::in | ios::binary);
@@ -140,185 +234,349 @@ int main(int argc, char** argv)
       exit (1);
     }
 
-  gradient_modulus = gradient_direction.x * gradient_direction.x +
-                     gradient_direction.y * gradient_direction.y +
-                     gradient_direction.z * gradient_direction.z;
-  gradient_modulus = sqrt (gradient_modulus);
-  prt.f ( verbosity_information, "gradient_modulus = %+0.3f\n", gradient_modulus );
+  for ( int g = 0; g < number_of_gradients; g++ )
+    {
+      gradient_modulus = gradients[g].x * gradients[g].x +
+			 gradients[g].y * gradients[g].y +
+			 gradients[g].z * gradients[g].z;
+      gradient_modulus = sqrt (gradient_modulus);
+      prt.f ( verbosity_information, "gradient_modulus = %+0.3f\n", gradient_modulus );
+      gradient_moduli.push_back ( gradient_modulus );
+      gradient_term_table.resize ( ( g + 1 ) * TENSOR_COMPONENTS );
+      gradient_terms ( gradients[g], &gradient_term_table[g * TENSOR_COMPONENTS] );
+    }
   // integrate stejskal-tanner equation
-  attenuated_out_file.open (attenuated_output_filename.c_str (), ios::out | ios::binary);
   sample_file.seekg (0, ios::end);
   sample_file_size = sample_file.tellg ();
-  prt.f ( verbosity_information, "sample size = %d\n", sample_file_size );
+  number_of_voxels = sample_file_size / sizeof ( attributes );
+  prt.f ( verbosity_information, "sample size = %lld\n", sample_file_size );
   sample_file.seekg (0, ios::beg);
-  while ( sample_file.tellg () < sample_file_size )
+
+  // the compartments of the voxels (see diffusion_model.hpp): the
+  // counts are read whole, the compartments block by block
+  if ( model == compartment_model )
     {
-      flag = true;
-      prt.f ( verbosity_information, "%d of %d: ", static_cast<int> ( sample_file.tellg () ), sample_file_size );
-      sample_file.read ((char*) &data, sizeof(attributes));
-      signal = data.signal;
-      // check if value has already been computed
-      for (int i = 0; i < number_values_stored; i++)
+      compartments_file.open ( compartments_filename.c_str (), ios::in | ios::binary );
+      compartment_counts.resize ( number_of_voxels + 1 );
+      if ( compartments_filename == "" || ! compartments_file ||
+	   ! compartments_file.read ( ( char* ) &compartment_counts[0], number_of_voxels ) )
 	{
-	  if ( precomputed_values[i].attr.signal == data.signal &&
-	       precomputed_values[i].attr.iso_adc == data.iso_adc &&
-	       precomputed_values[i].attr.transverse_ratio == data.transverse_ratio &&
-	       precomputed_values[i].attr.principal_direction.x  == data.principal_direction.x  &&
-	       precomputed_values[i].attr.principal_direction.y  == data.principal_direction.y  &&
-	       precomputed_values[i].attr.principal_direction.z  == data.principal_direction.z )
-	    {
-	      attenuated_signal = precomputed_values[i].attenuated_signal;
-	      attenuated_out_file.write ((char*) &attenuated_signal, sizeof_signal_t );
-	      flag = false;
-	      break;
-	    }
+	  cout << "ERROR: cannot read the compartments file " << compartments_filename << "." << endl;
+	  exit (1);
 	}
-      if ( flag ) // There is no equal entry on the lookup table.
+      number_of_compartments = 0;
+      for ( offset_t voxel = 0; voxel < number_of_voxels; voxel++ )
+	number_of_compartments += compartment_counts[voxel];
+      if ( file_size ( compartments_filename.c_str () ) != number_of_voxels + number_of_compartments * static_cast<offset_t> ( sizeof ( compartment ) ) ||
+	   ! hash_file ( compartments_filename, &params.compartments_hash ) )
 	{
-	  if ( gradient_direction.x == 0 &&
-	       gradient_direction.y == 0 &&
-	       gradient_direction.z == 0 ) // If we are considering the null direction...
-	    {
-	      params.diffusion_coefficient = 0;
-	      attenuated_signal = signal;
-	      attenuated_out_file.write ((char*) &attenuated_signal, sizeof_signal_t );
-	    }
-	  else // For new non-null entries...
-	    {
-	      // Calculate effective ADC
-	      // ADC_eff = E . P + E . T
-	      //         = E . P + |E||T|senA, A = acos ( E . P / |E||P| )
+	  cout << "ERROR: the compartments file " << compartments_filename << " does not match the sample." << endl;
+	  exit (1);
+	}
+      prt.f ( verbosity_information, "%lld compartments\n", number_of_compartments );
+    }
 
-	      dot_product_aux = gradient_direction.x * data.principal_direction.x +
-		gradient_direction.y * data.principal_direction.y +
-		gradient_direction.z * data.principal_direction.z;
+  // Every shell differs from the others only in its gradient amplitude:
+  // the integral of its waveform is computed once, and each voxel only
+  // scales it by its own diffusion coefficient.
+  for ( int shell = 0; shell < number_of_shells; shell++ )
+    {
+      params.gradient = shell_gradients[shell];
+      shell_params.push_back ( params );
+      shell_integrals.push_back ( waveform_integral ( shape, params ) );
+      shell_coefficients.push_back ( - params.gamma * params.gamma * shell_integrals.back () );
+      prt.f ( verbosity_information, "shell %d: gradient = %g T/m\n", shell, shell_gradients[shell] );
+    }
 
-	      principal_direction_modulus = sqrt ( data.principal_direction.x * data.principal_direction.x +
-						   data.principal_direction.y * data.principal_direction.y +
-						   data.principal_direction.z * data.principal_direction.z );
+  // Either write files of our own, or write straight into our chunks
+  // of the final 4D file (see shell_chunk_offset in sequence.hpp).
+  // The driver creates that file at its full size before any task
+  // runs (see assemble_4d): preallocating it here, from every process,
+  // would race with the chunks the others are writing.
+  destination_fd = -1;
+  chunk_size     = number_of_voxels * sizeof_signal_t;
+  for ( int shell = 0; shell < number_of_shells; shell++ )
+    for ( int g = 0; g < number_of_gradients; g++ )
+      {
+	if ( destination_filename == "" )
+	  {
+	    chunk_offsets.push_back ( 0 );
+	    output_filenames.push_back ( shell_output_file ( gradient_output_prefix ( signal_output_filename, direction_index + g, number_of_gradients ), shell, number_of_shells ) );
+	  }
+	else
+	  {
+	    chunk_offsets.push_back ( shell_chunk_offset ( b0_size, shell, direction_index + g, slice_index, number_of_directions, number_of_slices, chunk_size ) );
+	    output_filenames.push_back ( destination_filename );
+	  }
+      }
+
+  // the same slice, gradient and sequence may have been computed
+  // already, by this experiment or by any other (see result_cache.hpp)
+  output_cached.assign ( number_of_outputs, false );
+  cache_keys.assign ( number_of_outputs, 0 );
+  outputs_to_compute = number_of_outputs;
+  if ( cache_directory != "" && ! cache.open ( cache_directory, "/proc/self/exe" ) )
+    {
+      cout << "WARNING: cannot use the cache in " << cache_directory << "." << endl;
+      cache_directory = "";
+    }
+  for ( output = 0; output < number_of_outputs && cache_directory != ""; output++ )
+    {
+      if ( ! cache.key ( sample_filename, gradients[output % number_of_gradients], shell_params[output / number_of_gradients], &cache_keys[output] ) )
+	{
+	  cout << "WARNING: cannot use the cache in " << cache_directory << "." << endl;
+	  cache_directory = "";
+	}
+      else if ( cache.fetch ( cache_keys[output], output_filenames[output], chunk_offsets[output], chunk_size, destination_filename == "" ) )
+	{
+	  cout << "Taken from the cache: " << cache.entry ( cache_keys[output] ) << endl;
+	  output_cached[output] = true;
+	  outputs_to_compute--;
+	}
+    }
+  if ( outputs_to_compute == 0 )
+    {
+      sample_file.close ();
+      return 0;
+    }
 
-	      params.diffusion_coefficient = dot_product_aux +
-		gradient_modulus * ( principal_direction_modulus * data.transverse_ratio ) *
-		sin ( acos ( dot_product_aux / ( gradient_modulus * principal_direction_modulus ) ) );
-	      
-	      if ( params.diffusion_coefficient < 0 )
-		params.diffusion_coefficient *= -1;
+  // factors of the diffusion attributes seen before with this sequence
+  // and gradient, for those that recur (see factor_table.hpp); the
+  // cache keeps its own. The tensor and compartment models compute
+  // their factors in batches instead.
+  factors = new factor_table[number_of_outputs];
+  if ( factors_directory == "" && cache_directory != "" )
+    factors_directory = cache_directory + "/factors";
+  if ( factors_directory != "" && model == principal_model )
+    {
+      if ( ! hash_file ( "/proc/self/exe", &program_hash ) )
+	cout << "WARNING: cannot use the factor table in " << factors_directory << "." << endl;
+      else
+	for ( output = 0; output < number_of_outputs; output++ )
+	  if ( ! output_cached[output] &&
+	       ! factors[output].open ( factors_directory, hash_sequence ( shell_params[output / number_of_gradients], gradients[output % number_of_gradients], fnv1a ( &program_hash, sizeof ( program_hash ) ) ) ) )
+	    cout << "WARNING: cannot use the factor table in " << factors_directory << "." << endl;
+    }
+
+  attenuated_out_files = new ofstream[number_of_outputs];
+  if ( destination_filename == "" )
+    {
+      for ( output = 0; output < number_of_outputs; output++ )
+	if ( ! output_cached[output] )
+	  attenuated_out_files[output].open ( output_filenames[output].c_str (), ios::out | ios::binary );
+    }
+  else
+    {
+      destination_fd = open ( destination_filename.c_str (), O_WRONLY );
+      if ( destination_fd < 0 )
+	{
+	  cout << "ERROR: cannot open destination file." << endl;
+	  exit (1);
+	}
+      if ( file_size ( destination_fd ) < shell_chunk_offset ( b0_size, number_of_shells, 0, 0, number_of_directions, number_of_slices, chunk_size ) )
+	{
+	  cout << "ERROR: destination file is shorter than the dataset: it must be created first." << endl;
+	  exit (1);
+	}
+    }
 
-	      // calculate the attenuation
-	      conversion_aux = exp ( attenuation () ) * static_cast<double> ( signal );
+  // the sample is read and written in blocks that fit the memory
+  // budget; a block of voxels is attenuated for every output at once.
+  // The compartments of a block are counted as if every voxel had as
+  // many as it can, each laid out again for the kernel.
+  block_voxels = sizeof ( attributes ) + number_of_outputs * sizeof_signal_t;
+  if ( model == tensor_model )
+    block_voxels += ( TENSOR_COMPONENTS + number_of_gradients ) * sizeof ( double );
+  if ( model == compartment_model )
+    block_voxels += number_of_outputs * sizeof ( double ) + COMPARTMENT_CAPACITY * ( sizeof ( compartment ) + 8 * sizeof ( double ) );
+  block_voxels = memory_budget / block_voxels;
+  if ( block_voxels < 1 )
+    block_voxels = 1;
+  if ( block_voxels > number_of_voxels )
+    block_voxels = number_of_voxels;
+  sample_block      = new attributes[block_voxels];
+  attenuated_block  = new signal_t[number_of_outputs * block_voxels];
+  tensor_block      = NULL;
+  diffusivity_block = NULL;
+  compartment_attenuation_block = NULL;
+  if ( model == tensor_model )
+    {
+      tensor_block      = new double[TENSOR_COMPONENTS * block_voxels];
+      diffusivity_block = new double[number_of_gradients * block_voxels];
+    }
+  if ( model == compartment_model )
+    compartment_attenuation_block = new double[number_of_outputs * block_voxels];
+  for ( offset_t block_begin = 0; block_begin < number_of_voxels; block_begin += block_voxels )
+    {
+      voxels_in_block = number_of_voxels - block_begin;
+      if ( voxels_in_block > block_voxels )
+	voxels_in_block = block_voxels;
+      sample_file.read ((char*) sample_block, voxels_in_block * sizeof(attributes));
+      if ( model == principal_model )
+	recurring_voxels ( sample_block, voxels_in_block, &recurring );
+
+      // the diffusivities of the whole block along every gradient, in
+      // one product (see diffusion_model.hpp)
+      if ( model == tensor_model )
+	{
+	  for ( offset_t voxel = 0; voxel < voxels_in_block; voxel++ )
+	    {
+	      voxel_tensor ( sample_block[voxel], tensor );
+	      for ( int c = 0; c < TENSOR_COMPONENTS; c++ )
+		tensor_block[c * voxels_in_block + voxel] = tensor[c];
+	    }
+	  tensor_diffusivities ( tensor_block, voxels_in_block, &gradient_term_table[0], number_of_gradients, diffusivity_block );
+	}
+      // and the attenuations of the whole block, every compartment
+      // along every gradient for every shell, in one pass
+      if ( model == compartment_model )
+	{
+	  compartments_in_block = 0;
+	  for ( offset_t voxel = 0; voxel < voxels_in_block; voxel++ )
+	    compartments_in_block += compartment_counts[block_begin + voxel];
+	  compartment_block.resize ( compartments_in_block + 1 );
+	  compartments_file.read ( ( char* ) &compartment_block[0], compartments_in_block * sizeof ( compartment ) );
+	  compartment_attenuations ( &compartment_block[0], &compartment_counts[block_begin], voxels_in_block, &gradients[0], number_of_gradients,
+				     &shell_coefficients[0], number_of_shells, compartment_attenuation_block );
+	}
 
-	      // Verify the result fits the data type:
-	      if ( conversion_aux >   pow ( 2, 8 * sizeof_signal_t - 1 ) || 
-		   conversion_aux < - pow ( 2, 8 * sizeof_signal_t - 1 ) )
+      for ( int g = 0; g < number_of_gradients; g++ )
+	{
+	  gradient_direction = gradients[g];
+	  gradient_modulus   = gradient_moduli[g];
+	  for ( offset_t voxel = 0; voxel < voxels_in_block; voxel++ )
+	    {
+	      flag = false;
+	      diffusion_known = false;
+	      prt.f ( verbosity_information, "%lld of %lld: ", block_begin + voxel, number_of_voxels );
+	      data = sample_block[voxel];
+	      signal = data.signal;
+	      attenuated_signal = signal;
+	      for ( int shell = 0; shell < number_of_shells; shell++ )
 		{
-		  prt.f ( verbosity_error, "ERROR: signal outside bounds of sizeof_signal_t\n" );
-		  exit ( 1 );
+		  output = shell * number_of_gradients + g;
+		  if ( output_cached[output] )
+		    continue;
+		  if ( gradient_direction.x == 0 &&
+		       gradient_direction.y == 0 &&
+		       gradient_direction.z == 0 ) // If we are considering the null direction...
+		    {
+		      params.diffusion_coefficient = 0;
+		      attenuated_signal = signal;
+		      attenuated_block[output * block_voxels + voxel] = attenuated_signal;
+		      continue;
+		    }
+		  if ( model == tensor_model )
+		    factor = exp ( shell_coefficients[shell] * diffusivity_block[g * voxels_in_block + voxel] );
+		  else if ( model == compartment_model )
+		    factor = compartment_attenuation_block[output * voxels_in_block + voxel];
+		  // check if the factor has already been computed, by this
+		  // process or by any other sharing the table
+		  else if ( ! recurring[voxel] || ! factors[output].lookup ( data, &factor ) ) // For new entries...
+		    {
+		      flag = true;
+		      // the diffusion coefficient does not depend on the shell
+		      if ( ! diffusion_known )
+			{
+			  // Calculate effective ADC
+			  // ADC_eff = E . P + E . T
+			  //         = E . P + |E||T|senA, A = acos ( E . P / |E||P| )
+
+			  dot_product_aux = gradient_direction.x * data.principal_direction.x +
+			    gradient_direction.y * data.principal_direction.y +
+			    gradient_direction.z * data.principal_direction.z;
+
+			  principal_direction_modulus = sqrt ( data.principal_direction.x * data.principal_direction.x +
+							       data.principal_direction.y * data.principal_direction.y +
+							       data.principal_direction.z * data.principal_direction.z );
+
+			  params.diffusion_coefficient = dot_product_aux +
+			    gradient_modulus * ( principal_direction_modulus * data.transverse_ratio ) *
+			    sin ( acos ( dot_product_aux / ( gradient_modulus * principal_direction_modulus ) ) );
+	      
+			  if ( params.diffusion_coefficient < 0 )
+			    params.diffusion_coefficient *= -1;
+			  diffusion_known = true;
+			}
+
+		      // calculate the attenuation
+		      factor = exp ( attenuation ( shell_integrals[shell] ) );
+		      if ( recurring[voxel] && ! factors[output].insert ( data, factor ) )
+			cout << "WARNING: cannot append to the factor table, keeping factors in memory." << endl;
+		    }
+		  conversion_aux = factor * static_cast<double> ( signal );
+
+		  // Verify the result fits the data type:
+		  if ( conversion_aux >   pow ( 2, 8 * sizeof_signal_t - 1 ) || 
+		       conversion_aux < - pow ( 2, 8 * sizeof_signal_t - 1 ) )
+		    {
+		      prt.f ( verbosity_error, "ERROR: signal outside bounds of sizeof_signal_t\n" );
+		      exit ( 1 );
+		    }
+		  attenuated_signal = static_cast<signal_t> ( conversion_aux );
+		  attenuated_block[output * block_voxels + voxel] = attenuated_signal;
 		}
-	      attenuated_signal = static_cast<signal_t> ( conversion_aux );
-	      attenuated_out_file.write ((char*) &attenuated_signal, sizeof_signal_t);
+	      prt.f ( verbosity_debug, "%+0.3f => %+0.3f", static_cast<double> ( signal ), static_cast<double> ( attenuated_signal ) );
+	      if ( flag )
+		prt.f ( verbosity_information, " (new)\n" );
+	      else
+		prt.f ( verbosity_information, " (cached)\n" );
+	    }
+	}
+      for ( output = 0; output < number_of_outputs; output++ )
+	{
+	  if ( output_cached[output] )
+	    continue;
+	  if ( destination_fd < 0 )
+	    attenuated_out_files[output].write ((char*) ( attenuated_block + output * block_voxels ), voxels_in_block * sizeof_signal_t);
+	  else if ( ! write_at ( destination_fd, attenuated_block + output * block_voxels, voxels_in_block * sizeof_signal_t, chunk_offsets[output] + block_begin * sizeof_signal_t ) )
+	    {
+	      cout << "ERROR: cannot write to destination file." << endl;
+	      exit (1);
 	    }
-	  precomputed_values[index_last_value_stored].attenuated_signal = attenuated_signal;
-	  precomputed_values[index_last_value_stored].attr.signal = data.signal;
-	  precomputed_values[index_last_value_stored].attr.transverse_ratio = data.transverse_ratio;
-	  precomputed_values[index_last_value_stored].attr.iso_adc = data.iso_adc;
-	  precomputed_values[index_last_value_stored].attr.principal_direction.x = data.principal_direction.x;
-	  precomputed_values[index_last_value_stored].attr.principal_direction.y = data.principal_direction.y;
-	  precomputed_values[index_last_value_stored].attr.principal_direction.z = data.principal_direction.z;
-	  if (index_last_value_stored < MAX_PRECOMPUTED - 1)
-	    index_last_value_stored++;
-	  else
-	    index_last_value_stored = 0;
-	  if (number_values_stored < MAX_PRECOMPUTED - 1)
-	    number_values_stored++;
 	}
-      prt.f ( verbosity_debug, "%+0.3f => %+0.3f", static_cast<double> ( signal ), static_cast<double> ( attenuated_signal ) );
-      if ( flag )
-	prt.f ( verbosity_information, " (new)\n" );
-      else
-	prt.f ( verbosity_information, " (cached)\n" );
     }
+  delete[] sample_block;
+  delete[] attenuated_block;
+  delete[] tensor_block;
+  delete[] diffusivity_block;
+  delete[] compartment_attenuation_block;
 
-  // print stored values
-  for (int i = 0; i < number_values_stored; i++)
+  if ( model == principal_model )
     {
-      prt.f ( verbosity_information, "%d: %+0.3f ", i, static_cast<double> (precomputed_values[i].attr.signal) );
-      prt.f ( verbosity_information, "%+0.3f,", precomputed_values[i].attr.principal_direction.x ); 
-      prt.f ( verbosity_information, "%+0.3f,", precomputed_values[i].attr.principal_direction.y );
-      prt.f ( verbosity_information, "%+0.3f => ", precomputed_values[i].attr.principal_direction.z );
-      prt.f ( verbosity_information, "%+0.3f\n", static_cast<double> (precomputed_values[i].attenuated_signal) );
+      factors_size  = 0;
+      factors_added = 0;
+      for ( output = 0; output < number_of_outputs; output++ )
+	{
+	  factors_size  += factors[output].size ();
+	  factors_added += factors[output].added ();
+	}
+      prt.f ( verbosity_status, "%lld attenuation factors in the table, %lld new.\n", factors_size, factors_added );
     }
-  attenuated_out_file.close ();
+  delete[] factors;
+  if ( destination_fd < 0 )
+    for ( output = 0; output < number_of_outputs; output++ )
+      attenuated_out_files[output].close ();
+  else
+    close ( destination_fd );
+  delete[] attenuated_out_files;
   sample_file.close ();
+  compartments_file.close ();
+  for ( output = 0; output < number_of_outputs; output++ )
+    if ( cache_directory != "" && ! output_cached[output] &&
+	 ! cache.store ( cache_keys[output], output_filenames[output], chunk_offsets[output], chunk_size ) )
+      cout << "WARNING: cannot store the result in the cache." << endl;
   return 0;
 }
 
-double attenuation (void)
+double attenuation (double integral)
 {
-  double f_value, coefficient, term1, term2, term3, result;
-  f_value = f_lowercase ();
+  double coefficient, result;
   coefficient = - params.gamma * params.gamma * params.diffusion_coefficient;
-  term1 = int_f_uppercase_square (0, params.tau_prime);
-  term2 = - 4 * f_value * int_f_uppercase (params.tau, params.tau_prime);
-  term3 = 4 * pow (f_value, 2) * (params.tau_prime - params.tau);
-  result = coefficient * (term1 + term2 + term3);
-  return result;
-}
-
-double integration (double lower_bound, double upper_bound, double (*function) (double))
-{
-  double result;
-  result = naive_integration (lower_bound, upper_bound, function);
-  return result;
-}
-
-double naive_integration (double lower_bound, double upper_bound, double (*function) (double))
-{
-  double seconds;
-  double result = 0;
-  for (seconds = lower_bound + params.sim_time_step; seconds <= upper_bound; seconds += params.sim_time_step)
-    result += function (seconds) * params.sim_time_step;
+  result = coefficient * integral;
   return result;
 }
 
-double f_lowercase (void) // for the 180 degrees case
-{
-  return (params.gradient_zero + params.gradient) * params.delta_lowercase 
-    + params.gradient_zero * (params.tau - params.delta_lowercase);
-}
-
-double g (double time)
-{
-  if ((0 <= time && time < params.t1) ||
-      (params.t1 + params.delta_lowercase < time && time < (params.t1 + params.delta_uppercase) && (params.t1 + params.delta_uppercase) > params.tau) ||
-      (params.t1 + params.delta_lowercase + params.delta_uppercase < time))
-    return params.gradient_zero;
-  if ((params.t1 <= time && time < (params.t1 + params.delta_lowercase) && (params.t1 + params.delta_lowercase) < params.tau) ||
-      (params.t1 + params.delta_uppercase < time && time < (params.t1 + params.delta_lowercase + params.delta_uppercase) && (params.t1 + params.delta_lowercase + params.delta_uppercase) < 2 * params.tau))
-    return params.gradient_zero + params.gradient;
-  cout << "ERROR: G (" << time << ") undefined." << endl;
-  exit (1);
-}
-
-double f_uppercase (double upper_bound)
-{
-  return integration (0, upper_bound, &g);
-}
-
-double int_f_uppercase (double lower_bound, double upper_bound)
-{
-  return integration (lower_bound, upper_bound, &f_uppercase);
-}
-
-double f_uppercase_square (double upper_bound)
-{
-  return pow (f_uppercase (upper_bound), 2);
-}
-
-double int_f_uppercase_square (double lower_bound, double upper_bound)
-{
-  return integration (lower_bound, upper_bound, &f_uppercase_square);
-}
-
 double b_value (void)
 {
   return 0;
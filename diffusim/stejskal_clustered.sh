@@ -21,24 +21,56 @@
 usage=$(
 cat <<EOF 
 USAGE: $0 <PARAMETERS>
-PARAMETERS (all are obligatory):
-\t -i input_file
-\t -o output_filename_prefix 
-\t -s number of steps for longest integration
-\t -x gradient_direction_x 
-\t -y gradient_direction_y 
-\t -z gradient_direction_z
+PARAMETERS:
+\t -b size of the b0 in bytes (+)
+\t -f write into this final 4D file instead of output_filename_prefix_att.raw
+\t -i input_file (*)
+\t -k index of the gradient direction (+)
+\t -l index of the slice (+)
+\t -m memory budget in MB
+\t -n number of slices (+)
+\t -o output_filename_prefix (*)
+\t -r number of gradient directions (+)
+\t -s number of steps for longest integration (*)
+\t -x gradient_direction_x (*)
+\t -y gradient_direction_y (*)
+\t -z gradient_direction_z (*)
+(*) Indicates an obligatory option.
+(+) Indicates an option obligatory with -f.
 EOF
 )
 
-while getopts "i:o:s:x:y:z:" OPTION; do
+memory_budget=64
+
+while getopts "b:f:i:k:l:m:n:o:r:s:x:y:z:" OPTION; do
     case $OPTION in
+	b)
+	    b0_size=$OPTARG
+	    ;;
+	f)
+	    destination=$OPTARG
+	    ;;
 	i)
 	    input_file=$OPTARG
 	    ;;
+	k)
+	    direction_index=$OPTARG
+	    ;;
+	l)
+	    slice_index=$OPTARG
+	    ;;
+	m)
+	    memory_budget=$OPTARG
+	    ;;
+	n)
+	    slices=$OPTARG
+	    ;;
 	o)
 	    output_filename_prefix=$OPTARG
 	    ;;
+	r)
+	    directions=$OPTARG
+	    ;;
 	s)
 	    steps=$OPTARG
 	    ;;
@@ -69,6 +101,19 @@ for param in $parameters; do
     fi
 done
 
-./stejskal_clustered.exe $input_file $output_filename_prefix $gradient_direction_x $gradient_direction_y $gradient_direction_z $steps
+destination_options=""
+if [ -n "$destination" ]; then
+    for param in b0_size direction_index slice_index slices directions; do
+	eval content=\$$param
+	if [ -z "$content" ]; then
+	    echo "ERROR: Missing parameters for -f."
+	    echo -e "$usage"
+	    exit 1
+	fi
+    done
+    destination_options="-destination $destination -direction $direction_index -slice $slice_index -directions $directions -slices $slices -b0_size $b0_size"
+fi
+
+./stejskal_clustered.exe $input_file $output_filename_prefix $gradient_direction_x $gradient_direction_y $gradient_direction_z $steps -memory $memory_budget $destination_options
 
 exit 0
@@ -0,0 +1,254 @@
+#!/bin/bash
+
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+
+# Synthesizes a grid of variants of an experiment: every direction
+# uncertainty against every shell table, each variant with all the
+# shells (b values) of its table. The scene is rasterized once for all
+# the uncertainties (see mask_generator -uncertainties), and the chunks
+# of every variant run in a single batch of local_scheduler.exe. Each
+# variant ends up in a directory of its own, u<uncertainty>_<table>,
+# named after the shell table without its extension, or
+# u<uncertainty>_default with the single b value of sequence.cpp. The
+# number of steps is not a dimension: the integration is exact, so it
+# does not change the results (see sequence.hpp).
+
+source=`pwd`
+
+usage=$(
+cat <<EOF
+USAGE: $0 <PARAMETERS>
+PARAMETERS:
+\t -d number of gradient directions (*)
+\t -e experiment_name (*)
+\t -g list of shell tables, one variant each, as in "low.txt high.txt" (see sequence.hpp; default: the b value of sequence.cpp)
+\t -k directory of the results cache shared by experiments (default: ~/diffusim_cache, none to disable)
+\t -m memory budget in MB for each process
+\t -p gradient waveform file (see waveform.hpp; default: the pulse pair of sequence.cpp)
+\t -r resume an interrupted sweep, computing only the chunks it had not done
+\t -s number of slices (*)
+\t -t number of steps per second (default: 100; it does not change the results)
+\t -u list of direction uncertainty percentages, as in "0 5 10" (default: 0)
+\t -w number of processes to run at once (default: one per core)
+\t -x diffusion model: principal (default), tensor or compartments (see diffusion_model.hpp)
+(*) Indicates an obligatory option.
+EOF
+)
+
+uncertainties=0
+steps_per_second=100
+memory_budget=512
+resume=0
+cache_directory=~/diffusim_cache
+
+while getopts "d:e:g:k:m:p:rs:t:u:w:x:" OPTION; do
+    case $OPTION in
+	d)  gradient_directions=$OPTARG
+	    ;;
+	e)  experiment_name=$OPTARG
+	    ;;
+	g)  for table in $OPTARG; do
+		shell_tables="$shell_tables `readlink -f $table`"
+	    done
+	    ;;
+	k)  cache_directory=$OPTARG
+	    ;;
+	m)  memory_budget=$OPTARG
+	    ;;
+	p)  waveform=`readlink -f $OPTARG`
+	    ;;
+	r)  resume=1
+	    ;;
+	s)  slices=$OPTARG
+	    ;;
+	t)  steps_per_second=$OPTARG
+	    ;;
+	u)  uncertainties=$OPTARG
+	    ;;
+	w)  workers=$OPTARG
+	    ;;
+	x)  model=$OPTARG
+	    ;;
+	*)
+	    echo "Unrecognized option."
+	    echo -e "$usage"
+	    exit 1
+	    ;;
+    esac
+done
+
+parameters="gradient_directions experiment_name slices"
+for param in $parameters; do
+    eval content=\$$param
+    if [ -z "$content" ]; then
+	echo "ERROR: Missing parameters."
+	echo -e "$usage"
+	exit 1
+    fi
+done
+
+sweep_name=${experiment_name}_sweep
+if [ $resume -eq 0 ] && [ -e ~/latest/$sweep_name ]; then
+    rm -rf ~/latest/$sweep_name
+fi
+mkdir -p ~/latest/$sweep_name
+cd ~/latest/$sweep_name
+
+# the labels, signal and geometry are the same for every uncertainty:
+# one run of mask_generator writes the sample of each level in u<level>
+uncertainty_list=`echo $uncertainties | tr ' ' ','`
+compartment_options=""
+if [ "$model" == "compartments" ]; then
+    compartment_options="-compartments"
+fi
+mask_inputs="`cat $source/$experiment_name.xml $source/b0.raw | cksum` $uncertainty_list $compartment_options"
+if [ $resume -eq 1 ] && [ -e mask_generator.done ] && [ "`cat mask_generator.done`" == "$mask_inputs" ]; then
+    echo "Resuming with the samples generated before."
+else
+    rm -f mask_generator.done
+    rm -f sweep.manifest
+
+    cp $source/$experiment_name.xml .
+    cp $source/b0.raw .
+    cp $source/mask_generator.exe .
+
+    ./mask_generator.exe b0.raw $experiment_name.xml 0 -memory $memory_budget -uncertainties $uncertainty_list $compartment_options
+    if [ ! $? -eq 0 ]; then
+	echo "ERROR: mask_generator failed."
+	exit 1
+    fi
+    echo "$mask_inputs" > mask_generator.done
+
+    rm $experiment_name.xml
+    rm b0.raw
+    rm mask_generator.exe
+    rm -f u*/mask_x.raw
+    rm -f u*/mask_y.raw
+    rm -f u*/mask_z.raw
+fi
+
+# every variant is written directly into its 4D file:
+# [b0][shell 0: direction 0: slice 0 .. slice n-1][direction 1: ...]...[shell 1: ...]
+b0_size=`stat -c %s $source/000_merged.raw`
+shell_names=default
+if [ -n "$shell_tables" ]; then
+    shell_names=""
+    for table in $shell_tables; do
+	name=`basename $table | sed 's/\.[^.]*$//'`
+	cp $table shells_$name.txt
+	shell_names="$shell_names $name"
+    done
+fi
+# the number of shells of a variant, and the options that give them
+variant_shells () {
+    if [ "$1" == "default" ]; then
+	echo 1
+    else
+	grep -c -E '^[[:space:]]*(b|gradient)[[:space:]]' shells_$1.txt
+    fi
+}
+variant_shell_options () {
+    if [ ! "$1" == "default" ]; then
+	echo "-g shells_$1.txt"
+    fi
+}
+shell_options=""
+if [ -n "$waveform" ]; then
+    cp $waveform waveform.txt
+    shell_options="$shell_options -p waveform.txt"
+fi
+if [ -n "$model" ]; then
+    shell_options="$shell_options -x $model"
+fi
+cache_options=""
+if [ ! "$cache_directory" == "none" ]; then
+    cache_options="-cache $cache_directory"
+fi
+
+cp $source/directions.txt .
+cp $source/local_scheduler.exe .
+cp $source/stejskal_clustered.exe .
+cp $source/write_task_list.sh .
+cp $source/000_merged.raw .
+cp $source/assemble_4d.exe .
+cp $source/prepare_4d.sh .
+
+# the tasks of all the variants, in one list: the scheduler balances
+# them across the cores, heaviest slices first, whatever their variant
+rm -f variant_tasks.txt
+for uncertainty in $uncertainties; do
+    for shell_name in $shell_names; do
+	variant=u${uncertainty}_${shell_name}
+	shells=`variant_shells $shell_name`
+	mkdir -p $variant
+	# created whole, b0 included, before any task writes into it
+	./prepare_4d.sh -d $(($gradient_directions * $shells)) -s $slices -o $variant/${experiment_name}_synthetic.raw || exit 1
+	./write_task_list.sh -e $experiment_name -t $steps_per_second -m $memory_budget -o $variant/tasks.txt -b $b0_size -d $gradient_directions -s $slices -i u$uncertainty -r $variant `variant_shell_options $shell_name` $shell_options
+	cat $variant/tasks.txt >> variant_tasks.txt
+	rm $variant/tasks.txt
+    done
+done
+awk '{ $1 = NR - 1; print }' variant_tasks.txt > tasks.txt
+rm variant_tasks.txt
+
+worker_options=""
+if [ -n "$workers" ]; then
+    worker_options="-workers $workers"
+fi
+./local_scheduler.exe tasks.txt $worker_options -log synthesis.log -manifest sweep.manifest $cache_options
+if [ ! $? -eq 0 ]; then
+    echo "ERROR: some chunks failed, see synthesis.log."
+    exit 1
+fi
+rm local_scheduler.exe
+rm stejskal_clustered.exe
+rm write_task_list.sh
+rm tasks.txt
+
+rm prepare_4d.sh
+
+# the b0 and the chunks of each variant are already in place
+cp $source/raw_to_nifti.exe .
+size_x=`awk '/^size_x/ { print $2 }' sample_dimensions.txt`
+size_y=`awk '/^size_y/ { print $2 }' sample_dimensions.txt`
+b0_volumes=$(($b0_size / ($size_x * $size_y * $slices * 4)))
+for uncertainty in $uncertainties; do
+    for shell_name in $shell_names; do
+	variant=u${uncertainty}_${shell_name}
+	shells=`variant_shells $shell_name`
+	./raw_to_nifti.exe $variant/${experiment_name}_synthetic.raw $variant/${experiment_name}_synthetic.nii.gz $size_x $size_y $slices $(($b0_volumes + $shells * $gradient_directions)) int32
+    done
+done
+
+echo "Press ENTER to cleanup local temporary directory."
+read
+rm 000_merged.raw
+rm assemble_4d.exe
+rm raw_to_nifti.exe
+for uncertainty in $uncertainties; do
+    rm -rf u$uncertainty
+done
+
+if [ -e $source/$sweep_name ]; then
+    rm -rf $source/$sweep_name
+fi
+
+mv ~/latest/$sweep_name $source/
+
+exit 0
@@ -0,0 +1,310 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "diffusion_model.hpp"
+#include "raw_io.hpp"
+#include "task_list.hpp"
+#include "waveform.hpp"
+
+using namespace std;
+
+bool read_task_list ( const string& file_name, vector<synthesis_task>& tasks )
+{
+  ifstream       task_file;
+  string         line;
+  synthesis_task task;
+
+  task_file.open ( file_name.c_str () );
+  if ( ! task_file )
+    return false;
+  tasks.clear ();
+  while ( getline ( task_file, line ) )
+    {
+      if ( line.find_first_not_of ( " \t" ) == string::npos || line[line.find_first_not_of ( " \t" )] == '#' )
+	continue;
+      if ( ! parse_task ( line, task ) )
+	return false;
+      tasks.push_back ( task );
+    }
+  return true;
+}
+
+bool parse_task ( const string& line, synthesis_task& task )
+{
+  istringstream fields ( line );
+
+  if ( ! ( fields >> task.id >> task.sample_file >> task.output_prefix >> task.gradient[0] >> task.gradient[1] >> task.gradient[2] >> task.steps ) )
+    return false;
+  getline ( fields, task.options );
+  if ( task.options.find_first_not_of ( " \t" ) == string::npos )
+    task.options = "";
+  else
+    task.options = task.options.substr ( task.options.find_first_not_of ( " \t" ) );
+  task.weight = 0;
+  return true;
+}
+
+string format_task ( const synthesis_task& task )
+{
+  stringstream line;
+
+  line << task.id << " " << task.sample_file << " " << task.output_prefix << " "
+       << task.gradient[0] << " " << task.gradient[1] << " " << task.gradient[2] << " " << task.steps;
+  if ( task.options != "" )
+    line << " " << task.options;
+  return line.str ();
+}
+
+offset_t tissue_voxels ( const string& sample_file_name )
+{
+  attributes* voxels;
+  int         fd;
+  offset_t    count;
+  offset_t    number_of_voxels;
+  offset_t    block_voxels;
+  offset_t    length;
+
+  fd = open ( sample_file_name.c_str (), O_RDONLY );
+  if ( fd < 0 )
+    return 0;
+  number_of_voxels = file_size ( fd ) / sizeof ( attributes );
+  block_voxels     = RAW_IO_BUFFER_SIZE / sizeof ( attributes );
+  voxels           = new attributes[block_voxels];
+  count            = 0;
+  for ( offset_t begin = 0; begin < number_of_voxels; begin += block_voxels )
+    {
+      length = number_of_voxels - begin < block_voxels ? number_of_voxels - begin : block_voxels;
+      if ( ! read_at ( fd, voxels, length * sizeof ( attributes ), begin * sizeof ( attributes ) ) )
+	break;
+      for ( offset_t i = 0; i < length; i++ )
+	if ( voxels[i].signal != 0 || voxels[i].iso_adc != 0 )
+	  count++;
+    }
+  delete[] voxels;
+  close ( fd );
+  return count;
+}
+
+void weigh_tasks ( vector<synthesis_task>& tasks )
+{
+  map<string, offset_t> weights;
+
+  // every direction of a slice shares its sample file
+  for ( unsigned int t = 0; t < tasks.size (); t++ )
+    {
+      if ( weights.find ( tasks[t].sample_file ) == weights.end () )
+	weights[tasks[t].sample_file] = tissue_voxels ( tasks[t].sample_file ) + 1;
+      tasks[t].weight = weights[tasks[t].sample_file];
+    }
+}
+
+// the value of an option of the task, or "" when it is not given
+string task_option ( const synthesis_task& task, const string& option )
+{
+  istringstream options ( task.options );
+  string        name;
+  string        value;
+
+  while ( options >> name )
+    if ( name == option )
+      options >> value;
+  return value;
+}
+
+bool task_shells ( const synthesis_task& task, vector<double>& gradients )
+{
+  return read_shell_table ( task_option ( task, "-shells" ), gradients );
+}
+
+bool task_gradients ( const synthesis_task& task, vector<double_3d>& gradients )
+{
+  string    gradient_table;
+  double_3d gradient;
+
+  gradient_table = task_option ( task, "-gradients" );
+  if ( gradient_table != "" )
+    return read_gradient_table ( gradient_table, gradients );
+  // read as stejskal_clustered reads its arguments, so that the keys
+  // are the ones it computes
+  gradient.x = atof ( task.gradient[0].c_str () );
+  gradient.y = atof ( task.gradient[1].c_str () );
+  gradient.z = atof ( task.gradient[2].c_str () );
+  gradients.clear ();
+  gradients.push_back ( gradient );
+  return true;
+}
+
+bool task_output ( const synthesis_task& task, vector<task_output_region>& outputs )
+{
+  istringstream      options ( task.options );
+  string             option;
+  string             destination;
+  offset_t           b0_size;
+  offset_t           sample_size;
+  int                direction_index;
+  int                slice_index;
+  int                number_of_directions;
+  int                number_of_slices;
+  vector<double>     gradients;
+  vector<double_3d>  directions;
+  task_output_region output;
+
+  b0_size              = 0;
+  direction_index      = 0;
+  slice_index          = 0;
+  number_of_directions = 0;
+  number_of_slices     = 0;
+  while ( options >> option )
+    {
+      if ( option == "-destination" )
+	options >> destination;
+      else if ( option == "-direction" )
+	options >> direction_index;
+      else if ( option == "-slice" )
+	options >> slice_index;
+      else if ( option == "-directions" )
+	options >> number_of_directions;
+      else if ( option == "-slices" )
+	options >> number_of_slices;
+      else if ( option == "-b0_size" )
+	options >> b0_size;
+    }
+  sample_size = file_size ( task.sample_file.c_str () );
+  if ( sample_size < 0 || ! task_shells ( task, gradients ) || ! task_gradients ( task, directions ) )
+    return false;
+  outputs.clear ();
+  output.length   = sample_size / sizeof ( attributes ) * sizeof ( signal_t );
+  output.own_file = destination == "";
+  for ( unsigned int shell = 0; shell < gradients.size (); shell++ )
+    for ( unsigned int g = 0; g < directions.size (); g++ )
+      {
+	if ( destination == "" )
+	  {
+	    output.file_name = shell_output_file ( gradient_output_prefix ( task.output_prefix, direction_index + g, directions.size () ), shell, gradients.size () );
+	    output.offset    = 0;
+	  }
+	else
+	  {
+	    output.file_name = destination;
+	    output.offset    = shell_chunk_offset ( b0_size, shell, direction_index + g, slice_index, number_of_directions, number_of_slices, output.length );
+	  }
+	outputs.push_back ( output );
+      }
+  return true;
+}
+
+bool task_from_cache ( result_cache& cache, const synthesis_task& task )
+{
+  hash_t                     key;
+  parameters                 sequence;
+  waveform                   shape;
+  diffusion_model_type       model;
+  string                     model_name;
+  unsigned int               output;
+  vector<double>             gradients;
+  vector<double_3d>          directions;
+  vector<task_output_region> outputs;
+
+  experimental_parameters ( &sequence, atof ( task.steps.c_str () ) );
+  model_name = task_option ( task, "-model" );
+  if ( model_name == "" )
+    model_name = "principal";
+  if ( ! diffusion_model_from_name ( model_name, &model ) ||
+       ! read_waveform ( task_option ( task, "-waveform" ), &sequence, &shape ) ||
+       ! task_shells ( task, gradients ) || ! task_gradients ( task, directions ) ||
+       ! task_output ( task, outputs ) )
+    return false;
+  sequence.diffusion_model = model;
+  if ( model == compartment_model && ! hash_file ( task_option ( task, "-compartments" ), &sequence.compartments_hash ) )
+    return false;
+  for ( unsigned int shell = 0; shell < gradients.size (); shell++ )
+    {
+      sequence.gradient = gradients[shell];
+      for ( unsigned int g = 0; g < directions.size (); g++ )
+	{
+	  output = shell * directions.size () + g;
+	  if ( ! cache.key ( task.sample_file, directions[g], sequence, &key ) ||
+	       ! cache.fetch ( key, outputs[output].file_name, outputs[output].offset, outputs[output].length, outputs[output].own_file ) )
+	    return false;
+	}
+    }
+  return true;
+}
+
+int run_task ( const synthesis_task& task, const string& program, const string& log_file )
+{
+  vector<string> arguments;
+  vector<char*>  argv;
+  istringstream  options ( task.options );
+  string         option;
+  pid_t          child;
+  int            log_fd;
+  int            status;
+
+  arguments.push_back ( program );
+  arguments.push_back ( task.sample_file );
+  arguments.push_back ( task.output_prefix );
+  for ( int i = 0; i < 3; i++ )
+    arguments.push_back ( task.gradient[i] );
+  arguments.push_back ( task.steps );
+  while ( options >> option )
+    arguments.push_back ( option );
+  for ( unsigned int i = 0; i < arguments.size (); i++ )
+    argv.push_back ( const_cast<char*> ( arguments[i].c_str () ) );
+  argv.push_back ( NULL );
+
+  // everything is ready before the fork: the child only redirects and
+  // calls exec
+  if ( log_file == "" )
+    log_fd = open ( "/dev/null", O_WRONLY );
+  else
+    log_fd = open ( log_file.c_str (), O_WRONLY | O_CREAT | O_APPEND, 0644 );
+  if ( log_fd < 0 )
+    return -1;
+  child = fork ();
+  if ( child < 0 )
+    {
+      close ( log_fd );
+      return -1;
+    }
+  if ( child == 0 )
+    {
+      dup2 ( log_fd, STDOUT_FILENO );
+      close ( log_fd );
+      execv ( argv[0], &( argv[0] ) );
+      _exit ( 127 );
+    }
+  close ( log_fd );
+  while ( waitpid ( child, &status, 0 ) < 0 )
+    if ( errno != EINTR )
+      return -1;
+  if ( WIFEXITED ( status ) )
+    return WEXITSTATUS ( status );
+  return -1;
+}
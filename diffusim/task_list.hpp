@@ -0,0 +1,87 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef TASK_LIST
+#define TASK_LIST
+
+#include <string>
+#include <vector>
+
+#include "data_structures.hpp"
+#include "result_cache.hpp"
+
+// One run of stejskal_clustered: a slice of the sample against one
+// gradient direction. Task lists have one task per line ('#' starts a
+// comment):
+//
+//   <task id> <sample file> <output prefix> <gx> <gy> <gz> <steps> [options]
+//
+// where the options (-memory, -destination ...) are passed on to
+// stejskal_clustered as they are. The gradient is kept as written, so
+// that the program sees exactly what a shell script would pass it.
+typedef struct
+{
+  unsigned int id;
+  std::string  sample_file;
+  std::string  output_prefix;
+  std::string  gradient[3];
+  std::string  steps;
+  std::string  options;
+  offset_t     weight;         // tissue voxels, the cost of the task
+} synthesis_task;
+
+bool        read_task_list ( const std::string& file_name, std::vector<synthesis_task>& tasks );
+bool        parse_task     ( const std::string& line, synthesis_task& task );
+std::string format_task    ( const synthesis_task& task );
+
+// Voxels of a sample file with anything in them: the background costs
+// next to nothing, every tissue voxel an integration of its own.
+offset_t    tissue_voxels  ( const std::string& sample_file_name );
+void        weigh_tasks    ( std::vector<synthesis_task>& tasks );
+
+// Where the task writes its result, one output per shell of its
+// -shells table and gradient of its -gradients table, shell by shell:
+// its own files (see shell_output_file and gradient_output_prefix), or
+// its chunks of the final 4D file when given -destination.
+typedef struct
+{
+  std::string file_name;
+  offset_t    offset;
+  offset_t    length;
+  bool        own_file;        // holds nothing but this output
+} task_output_region;
+
+std::string task_option    ( const synthesis_task& task, const std::string& option );
+bool        task_shells    ( const synthesis_task& task, std::vector<double>& gradients );
+// The gradient directions of the task: its -gradients table, or else
+// the one on its line.
+bool        task_gradients ( const synthesis_task& task, std::vector<double_3d>& gradients );
+bool        task_output    ( const synthesis_task& task, std::vector<task_output_region>& outputs );
+
+// Fills the outputs of the task from the cache, when the cache holds
+// the results of all its shells and gradients; the task then need not
+// run.
+bool        task_from_cache ( result_cache& cache, const synthesis_task& task );
+
+// Runs the task as a child process, its output appended to log_file
+// (or discarded when it is empty); returns its exit status, or -1 if
+// it could not be run at all.
+int         run_task       ( const synthesis_task& task, const std::string& program, const std::string& log_file );
+
+#endif
@@ -0,0 +1,170 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "volume.hpp"
+
+using namespace std;
+
+// Morton code of a voxel inside a brick: the bits of x, y and z
+// interleaved, indexed by the coordinate modulo BRICK_SIDE.
+static const unsigned int morton_spread[BRICK_SIDE] = { 0, 1, 8, 9, 64, 65, 72, 73 };
+
+static unsigned long long morton_code ( unsigned int x, unsigned int y, unsigned int z )
+{
+  unsigned long long code = 0;
+
+  for ( unsigned int bit = 0; bit < 21; bit++ )
+    {
+      code |= static_cast<unsigned long long> ( ( x >> bit ) & 1 ) << ( 3 * bit );
+      code |= static_cast<unsigned long long> ( ( y >> bit ) & 1 ) << ( 3 * bit + 1 );
+      code |= static_cast<unsigned long long> ( ( z >> bit ) & 1 ) << ( 3 * bit + 2 );
+    }
+  return code;
+}
+
+volume::volume ( unsigned int x, unsigned int y, unsigned int z_first, unsigned int z_last, volume_layout volume_layout )
+{
+  vector< pair<unsigned long long, unsigned int> > order;
+  unsigned int                                      brick;
+
+  size_x        = x;
+  size_y        = y;
+  z_begin       = z_first;
+  z_end         = z_last;
+  layout        = volume_layout;
+  brick_offsets = NULL;
+  bricks_x      = ( size_x + BRICK_SIDE - 1 ) >> BRICK_SHIFT;
+  bricks_y      = ( size_y + BRICK_SIDE - 1 ) >> BRICK_SHIFT;
+  bricks_z      = ( z_end - z_begin + BRICK_SIDE - 1 ) >> BRICK_SHIFT;
+
+  if ( layout == bricked_layout )
+    {
+      // rank the bricks by the Morton code of their coordinates, so
+      // that the storage is dense even when the slab is not a cube
+      for ( unsigned int bz = 0; bz < bricks_z; bz++ )
+	for ( unsigned int by = 0; by < bricks_y; by++ )
+	  for ( unsigned int bx = 0; bx < bricks_x; bx++ )
+	    {
+	      brick = ( bz * bricks_y + by ) * bricks_x + bx;
+	      order.push_back ( make_pair ( morton_code ( bx, by, bz ), brick ) );
+	    }
+      sort ( order.begin (), order.end () );
+      brick_offsets = new offset_t[order.size ()];
+      for ( unsigned int rank = 0; rank < order.size (); rank++ )
+	brick_offsets[order[rank].second] = static_cast<offset_t> ( rank ) << ( 3 * BRICK_SHIFT );
+    }
+
+  voxels = new attributes[number_of_stored_voxels ()];
+  memset ( voxels, 0, number_of_stored_voxels () * sizeof ( attributes ) );
+}
+
+volume::~volume ()
+{
+  delete[] voxels;
+  delete[] brick_offsets;
+}
+
+offset_t volume::number_of_voxels ( void )
+{
+  return static_cast<offset_t> ( size_x ) * size_y * ( z_end - z_begin );
+}
+
+offset_t volume::number_of_stored_voxels ( void )
+{
+  // partial bricks at the borders are stored whole
+  if ( layout == bricked_layout )
+    return static_cast<offset_t> ( bricks_x ) * bricks_y * bricks_z << ( 3 * BRICK_SHIFT );
+  return number_of_voxels ();
+}
+
+offset_t volume::index ( unsigned int x, unsigned int y, unsigned int z )
+{
+  offset_t index;
+
+  z -= z_begin;
+  if ( layout == bricked_layout )
+    {
+      index =  brick_offsets[( ( z >> BRICK_SHIFT ) * bricks_y + ( y >> BRICK_SHIFT ) ) * bricks_x + ( x >> BRICK_SHIFT )];
+      index += morton_spread[x & ( BRICK_SIDE - 1 )];
+      index += morton_spread[y & ( BRICK_SIDE - 1 )] << 1;
+      index += morton_spread[z & ( BRICK_SIDE - 1 )] << 2;
+      return index;
+    }
+  index =  static_cast<offset_t> ( z ) * size_x * size_y;
+  index += static_cast<offset_t> ( y ) * size_x;
+  index += x;
+  return index;
+}
+
+attributes* volume::at ( unsigned int x, unsigned int y, unsigned int z )
+{
+  return &( voxels[index ( x, y, z )] );
+}
+
+void volume::get_plane ( unsigned int z, attributes* plane )
+{
+  if ( layout == linear_layout )
+    {
+      memcpy ( plane, at ( 0, 0, z ), static_cast<offset_t> ( size_x ) * size_y * sizeof ( attributes ) );
+      return;
+    }
+  for ( unsigned int y = 0; y < size_y; y++ )
+    for ( unsigned int x = 0; x < size_x; x++ )
+      plane[static_cast<offset_t> ( y ) * size_x + x] = *( at ( x, y, z ) );
+}
+
+unsigned int slab_depth_for_budget ( unsigned int size_x, unsigned int size_y, unsigned int size_z, offset_t bytes_per_voxel, offset_t memory_budget, volume_layout* layout )
+{
+  offset_t depth;
+  offset_t plane_bytes;
+
+  // a bricked slab stores its partial bricks whole: it takes planes as
+  // wide as whole bricks, a whole brick deep at least, and is cut
+  // between bricks
+  if ( *layout == bricked_layout )
+    {
+      plane_bytes = static_cast<offset_t> ( ( size_x + BRICK_SIDE - 1 ) & ~( BRICK_SIDE - 1 ) ) *
+	( ( size_y + BRICK_SIDE - 1 ) & ~( BRICK_SIDE - 1 ) ) * bytes_per_voxel;
+      if ( plane_bytes == 0 )
+	return size_z;
+      depth = ( memory_budget / plane_bytes ) & ~static_cast<offset_t> ( BRICK_SIDE - 1 );
+      if ( depth >= size_z )
+	return size_z;
+      if ( depth >= BRICK_SIDE )
+	return static_cast<unsigned int> ( depth );
+      // not even one row of bricks fits: planes are smaller
+      *layout = linear_layout;
+    }
+
+  // at least one plane must fit, whatever the budget says
+  plane_bytes = static_cast<offset_t> ( size_x ) * size_y * bytes_per_voxel;
+  if ( plane_bytes == 0 )
+    return size_z;
+  depth = memory_budget / plane_bytes;
+  if ( depth < 1 )
+    depth = 1;
+  if ( depth > size_z )
+    depth = size_z;
+  return static_cast<unsigned int> ( depth );
+}
@@ -0,0 +1,72 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef VOLUME
+#define VOLUME
+
+#include "data_structures.hpp"
+
+// side of a brick, in voxels, for the bricked layout
+#define BRICK_SIDE  8
+#define BRICK_SHIFT 3
+
+enum volume_layout { linear_layout = 0,
+		     bricked_layout };
+
+// A slab of the sample held in memory: every voxel with
+// z_begin <= z < z_end. The whole volume is processed one slab at a
+// time, so that its size is bounded by the memory budget and not by
+// the size of the sample.
+//
+// In the linear layout voxels are stored plane by plane, row by row.
+// In the bricked layout they are stored in 8x8x8 bricks, bricks and
+// the voxels inside each brick in Morton order, so that neighbours in
+// any of the three directions are usually in the same cache lines.
+// Either way voxels are reached through at (), and get_plane ()
+// converts back to the linear layout of the output files. Arrays with
+// something else per voxel, number_of_stored_voxels () long, follow
+// the same layout through index ().
+class volume
+{
+ public:
+  unsigned int  size_x;
+  unsigned int  size_y;
+  unsigned int  z_begin;
+  unsigned int  z_end;
+  volume_layout layout;
+  attributes*   voxels;
+  volume  ( unsigned int size_x, unsigned int size_y, unsigned int z_begin, unsigned int z_end, volume_layout layout = linear_layout );
+  ~volume ();
+  offset_t    index     ( unsigned int x, unsigned int y, unsigned int z );
+  attributes* at        ( unsigned int x, unsigned int y, unsigned int z );
+  void        get_plane ( unsigned int z, attributes* plane );
+  offset_t    number_of_voxels ( void );
+  offset_t    number_of_stored_voxels ( void );
+ private:
+  unsigned int  bricks_x;
+  unsigned int  bricks_y;
+  unsigned int  bricks_z;
+  offset_t*     brick_offsets;
+};
+
+// the planes a slab can have within the budget; when not even one row
+// of bricks fits, the layout falls back to linear
+unsigned int slab_depth_for_budget ( unsigned int size_x, unsigned int size_y, unsigned int size_z, offset_t bytes_per_voxel, offset_t memory_budget, volume_layout* layout );
+
+#endif
@@ -0,0 +1,181 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "waveform.hpp"
+
+using namespace std;
+
+void pulse_pair_waveform ( const parameters& sequence, waveform* shape )
+{
+  waveform_segment pulse;
+
+  shape->segments.clear ();
+  pulse.value_begin = 1;
+  pulse.value_end   = 1;
+  pulse.begin       = sequence.t1;
+  pulse.end         = sequence.t1 + sequence.delta_lowercase;
+  shape->segments.push_back ( pulse );
+  pulse.begin       = sequence.t1 + sequence.delta_uppercase;
+  pulse.end         = sequence.t1 + sequence.delta_uppercase + sequence.delta_lowercase;
+  shape->segments.push_back ( pulse );
+  shape->refocus    = sequence.tau;
+  shape->echo       = sequence.tau_prime;
+}
+
+bool read_waveform ( const string& file_name, parameters* sequence, waveform* shape )
+{
+  ifstream                      waveform_file;
+  string                        line;
+  string                        kind;
+  waveform_segment              segment;
+  vector< pair<double, double> > samples;
+
+  pulse_pair_waveform ( *sequence, shape );
+  if ( file_name != "" )
+    {
+      waveform_file.open ( file_name.c_str () );
+      if ( ! waveform_file )
+	return false;
+      shape->segments.clear ();
+      while ( getline ( waveform_file, line ) )
+	{
+	  if ( line.find ( '#' ) != string::npos )
+	    line = line.substr ( 0, line.find ( '#' ) );
+	  if ( line.find_first_not_of ( " \t" ) == string::npos )
+	    continue;
+	  istringstream fields ( line );
+	  fields >> kind;
+	  if ( kind == "segment" )
+	    {
+	      if ( ! ( fields >> segment.begin >> segment.end >> segment.value_begin >> segment.value_end ) ||
+		   segment.end <= segment.begin )
+		return false;
+	      shape->segments.push_back ( segment );
+	    }
+	  else if ( kind == "sample" )
+	    {
+	      if ( ! ( fields >> segment.begin >> segment.value_begin ) ||
+		   ( ! samples.empty () && segment.begin <= samples.back ().first ) )
+		return false;
+	      samples.push_back ( make_pair ( segment.begin, segment.value_begin ) );
+	    }
+	  else if ( kind == "refocus" )
+	    {
+	      if ( ! ( fields >> shape->refocus ) )
+		return false;
+	    }
+	  else if ( kind == "echo" )
+	    {
+	      if ( ! ( fields >> shape->echo ) )
+		return false;
+	    }
+	  else
+	    return false;
+	}
+      // samples are joined by straight lines
+      for ( unsigned int i = 1; i < samples.size (); i++ )
+	{
+	  segment.begin       = samples[i - 1].first;
+	  segment.end         = samples[i].first;
+	  segment.value_begin = samples[i - 1].second;
+	  segment.value_end   = samples[i].second;
+	  shape->segments.push_back ( segment );
+	}
+      if ( shape->echo <= 0 || shape->refocus <= 0 || shape->refocus >= shape->echo )
+	return false;
+    }
+  sequence->waveform_hash = hash_waveform ( *shape );
+  return true;
+}
+
+hash_t hash_waveform ( const waveform& shape, hash_t hash )
+{
+  for ( unsigned int i = 0; i < shape.segments.size (); i++ )
+    hash = fnv1a ( &( shape.segments[i] ), sizeof ( waveform_segment ), hash );
+  hash = fnv1a ( &( shape.refocus ), sizeof ( shape.refocus ), hash );
+  return fnv1a ( &( shape.echo ), sizeof ( shape.echo ), hash );
+}
+
+double waveform_integral ( const waveform& shape, const parameters& sequence )
+{
+  vector<double> times;
+  double         begin;
+  double         end;
+  double         length;
+  double         value;       // of w at the beginning of the piece
+  double         slope;       // of w along the piece
+  double         gradient;    // at the beginning of the piece
+  double         half_slope;  // of the gradient
+  double         dephasing;   // F at the beginning of the piece
+  double         result;
+  bool           refocused;
+
+  // the pieces along which g is linear
+  times.push_back ( 0 );
+  times.push_back ( shape.echo );
+  times.push_back ( shape.refocus );
+  for ( unsigned int i = 0; i < shape.segments.size (); i++ )
+    {
+      if ( shape.segments[i].begin > 0 && shape.segments[i].begin < shape.echo )
+	times.push_back ( shape.segments[i].begin );
+      if ( shape.segments[i].end > 0 && shape.segments[i].end < shape.echo )
+	times.push_back ( shape.segments[i].end );
+    }
+  sort ( times.begin (), times.end () );
+  times.erase ( unique ( times.begin (), times.end () ), times.end () );
+
+  dephasing = 0;
+  result    = 0;
+  refocused = false;
+  for ( unsigned int p = 0; p + 1 < times.size (); p++ )
+    {
+      begin  = times[p];
+      end    = times[p + 1];
+      length = end - begin;
+      if ( ! refocused && begin >= shape.refocus )
+	{
+	  dephasing = - dephasing;
+	  refocused = true;
+	}
+      value = 0;
+      slope = 0;
+      for ( unsigned int i = 0; i < shape.segments.size (); i++ )
+	if ( shape.segments[i].begin <= begin && shape.segments[i].end >= end )
+	  {
+	    slope += ( shape.segments[i].value_end - shape.segments[i].value_begin ) / ( shape.segments[i].end - shape.segments[i].begin );
+	    value += shape.segments[i].value_begin + ( shape.segments[i].value_end - shape.segments[i].value_begin ) * ( begin - shape.segments[i].begin ) / ( shape.segments[i].end - shape.segments[i].begin );
+	  }
+      gradient   = sequence.gradient_zero + sequence.gradient * value;
+      half_slope = sequence.gradient * slope / 2;
+
+      // F ( begin + s ) = dephasing + gradient s + half_slope s^2
+      result += dephasing * dephasing * length
+	+ dephasing * gradient * length * length
+	+ ( gradient * gradient + 2 * dephasing * half_slope ) * pow ( length, 3 ) / 3
+	+ gradient * half_slope * pow ( length, 4 ) / 2
+	+ half_slope * half_slope * pow ( length, 5 ) / 5;
+      dephasing += gradient * length + half_slope * length * length;
+    }
+  return result;
+}
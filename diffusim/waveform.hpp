@@ -0,0 +1,77 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef WAVEFORM
+#define WAVEFORM
+
+#include <string>
+#include <vector>
+
+#include "content_hash.hpp"
+#include "sequence.hpp"
+
+// The shape of the diffusion gradient along the sequence, in units of
+// the gradient amplitude of the shell: the gradient at time t is
+//
+//   g ( t ) = gradient_zero + gradient * w ( t )
+//
+// where w is piecewise linear. A waveform file gives w either as
+// segments, linear from one value to the other and zero between them,
+// or as samples joined by straight lines ('#' starts a comment):
+//
+//   segment <begin> <end> <value at begin> <value at end>
+//   sample  <time> <value>
+//   refocus <time of the 180 degrees pulse>
+//   echo    <time of the echo>
+//
+// with times in seconds; refocus and echo default to tau and tau_prime
+// of the sequence. Ramps, bipolar and oscillating gradients are all
+// sums of such pieces. Without a file (an empty file name), w is the
+// pulse pair of experimental_parameters. The b values of a shell table
+// assume that pulse pair: give other waveforms gradient amplitudes
+// instead. read_waveform records the hash of the waveform in the
+// sequence, so that results of other waveforms are told apart (see
+// hash_sequence).
+typedef struct
+{
+  double begin;         // seconds
+  double end;           // seconds
+  double value_begin;
+  double value_end;
+} waveform_segment;
+
+typedef struct
+{
+  std::vector<waveform_segment> segments;
+  double                        refocus;  // seconds
+  double                        echo;     // seconds
+} waveform;
+
+void   pulse_pair_waveform ( const parameters& sequence, waveform* shape );
+bool   read_waveform       ( const std::string& file_name, parameters* sequence, waveform* shape );
+hash_t hash_waveform       ( const waveform& shape, hash_t hash = FNV_OFFSET_BASIS );
+
+// The integral up to the echo of the square of the dephasing F ( t ),
+// the integral of g up to t, whose sign the refocusing pulse inverts.
+// The attenuation of a voxel is exp ( - gamma^2 D waveform_integral ).
+// F is piecewise quadratic, so every piece is integrated exactly, once
+// per waveform and shell rather than once per voxel.
+double waveform_integral   ( const waveform& shape, const parameters& sequence );
+
+#endif
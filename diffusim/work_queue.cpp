@@ -0,0 +1,317 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <poll.h>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "work_queue.hpp"
+
+using namespace std;
+
+static vector<string> list_directory ( const string& directory )
+{
+  DIR*           handle;
+  struct dirent* entry;
+  vector<string> names;
+
+  handle = opendir ( directory.c_str () );
+  if ( handle == NULL )
+    return names;
+  while ( ( entry = readdir ( handle ) ) != NULL )
+    if ( entry->d_name[0] != '.' )
+      names.push_back ( entry->d_name );
+  closedir ( handle );
+  return names;
+}
+
+// <id>-<attempt>[-<host>-<pid>]
+static bool parse_lease_name ( const string& name, unsigned int* id, int* attempt )
+{
+  return sscanf ( name.c_str (), "%u-%d", id, attempt ) == 2;
+}
+
+static string lease_name ( unsigned int id, int attempt )
+{
+  stringstream name;
+
+  name << id << "-" << attempt;
+  return name.str ();
+}
+
+work_queue::work_queue ( const string& queue_directory )
+{
+  directory       = queue_directory;
+  attempts        = 3;
+  lease_seconds   = 60;
+  number_of_tasks = 0;
+}
+
+bool work_queue::create ( const vector<synthesis_task>& tasks, int number_of_attempts, int lease )
+{
+  const char* subdirectories[] = { "pending", "running", "done", "failed" };
+  ofstream    file;
+  string      temporary;
+
+  attempts        = number_of_attempts;
+  lease_seconds   = lease;
+  number_of_tasks = tasks.size ();
+  mkdir ( directory.c_str (), 0755 );
+  for ( int i = 0; i < 4; i++ )
+    if ( mkdir ( ( directory + "/" + subdirectories[i] ).c_str (), 0755 ) != 0 && errno != EEXIST )
+      return false;
+  // the settings go in first, so that a worker that sees a task can
+  // also read them
+  file.open ( ( directory + "/queue.txt" ).c_str (), ios::out | ios::trunc );
+  file << "tasks " << number_of_tasks << endl;
+  file << "attempts " << attempts << endl;
+  file << "lease " << lease_seconds << endl;
+  file.close ();
+  if ( ! file )
+    return false;
+  unlink ( ( directory + "/closed" ).c_str () );
+  for ( unsigned int t = 0; t < tasks.size (); t++ )
+    {
+      // written aside and renamed in, so that no one leases half a task
+      temporary = directory + "/." + lease_name ( tasks[t].id, 0 );
+      file.open ( temporary.c_str (), ios::out | ios::trunc );
+      file << format_task ( tasks[t] ) << endl;
+      file.close ();
+      if ( ! file || rename ( temporary.c_str (), ( directory + "/pending/" + lease_name ( tasks[t].id, 0 ) ).c_str () ) != 0 )
+	return false;
+    }
+  return true;
+}
+
+bool work_queue::load ( void )
+{
+  ifstream file;
+  string   key;
+  int      value;
+
+  file.open ( ( directory + "/queue.txt" ).c_str () );
+  if ( ! file )
+    return false;
+  while ( file >> key >> value )
+    {
+      if ( key == "tasks" )
+	number_of_tasks = value;
+      else if ( key == "attempts" )
+	attempts = value;
+      else if ( key == "lease" )
+	lease_seconds = value;
+    }
+  return true;
+}
+
+bool work_queue::claim ( synthesis_task& task, string& lease )
+{
+  vector<string> pending;
+  ifstream       file;
+  string         line;
+  char           host[256];
+  stringstream   owner;
+  unsigned int   id;
+  int            attempt;
+
+  if ( gethostname ( host, sizeof ( host ) ) != 0 )
+    snprintf ( host, sizeof ( host ), "unknown" );
+  host[sizeof ( host ) - 1] = '\0';
+  owner << "-" << host << "-" << getpid ();
+
+  // lowest ids first, the order of the task list; whoever renames a
+  // task first has it, the others go on to the next one
+  pending = list_directory ( directory + "/pending" );
+  sort ( pending.begin (), pending.end () );
+  for ( unsigned int i = 0; i < pending.size (); i++ )
+    {
+      if ( ! parse_lease_name ( pending[i], &id, &attempt ) )
+	continue;
+      // a rename keeps the time of the file, so it is touched first:
+      // otherwise the lease could look expired as soon as it is taken
+      lease = directory + "/running/" + pending[i] + owner.str ();
+      utimes ( ( directory + "/pending/" + pending[i] ).c_str (), NULL );
+      if ( rename ( ( directory + "/pending/" + pending[i] ).c_str (), lease.c_str () ) != 0 )
+	continue;
+      file.open ( lease.c_str () );
+      getline ( file, line );
+      file.close ();
+      if ( parse_task ( line, task ) )
+	return true;
+      // not a task: it will not get any better by retrying
+      rename ( lease.c_str (), ( directory + "/failed/" + pending[i] ).c_str () );
+    }
+  return false;
+}
+
+bool work_queue::heartbeat ( const string& lease )
+{
+  return utimes ( lease.c_str (), NULL ) == 0;
+}
+
+bool work_queue::complete ( const string& lease )
+{
+  return move_on ( lease, true );
+}
+
+bool work_queue::retry ( const string& lease )
+{
+  return move_on ( lease, false );
+}
+
+// false when the lease was lost, i.e. the task was taken back in the
+// meantime and is someone else's now
+bool work_queue::move_on ( const string& lease, bool succeeded )
+{
+  string       name;
+  string       target;
+  stringstream id_name;
+  unsigned int id;
+  int          attempt;
+
+  name = lease.substr ( lease.rfind ( '/' ) + 1 );
+  if ( ! parse_lease_name ( name, &id, &attempt ) )
+    return false;
+  id_name << id;
+  if ( succeeded )
+    target = directory + "/done/" + id_name.str ();
+  else if ( attempt + 1 < attempts )
+    target = directory + "/pending/" + lease_name ( id, attempt + 1 );
+  else
+    target = directory + "/failed/" + id_name.str ();
+  return rename ( lease.c_str (), target.c_str () ) == 0;
+}
+
+// the leases carry the time of the server that holds the queue, which
+// need not agree with this machine: "now" is taken from a file touched
+// on that same server, and this machine's clock only if that fails
+static time_t filesystem_now ( const string& directory )
+{
+  struct stat status;
+  ofstream    file;
+  string      probe;
+
+  probe = directory + "/clock";
+  if ( access ( probe.c_str (), F_OK ) != 0 )
+    {
+      file.open ( probe.c_str (), ios::out | ios::trunc );
+      file.close ();
+    }
+  if ( utimes ( probe.c_str (), NULL ) != 0 || stat ( probe.c_str (), &status ) != 0 )
+    return time ( NULL );
+  return status.st_mtime;
+}
+
+int work_queue::reclaim_expired ( void )
+{
+  vector<string> running;
+  struct stat    status;
+  string         lease;
+  time_t         now;
+  int            reclaimed;
+  unsigned int   id;
+  int            attempt;
+
+  reclaimed = 0;
+  now       = filesystem_now ( directory );
+  running   = list_directory ( directory + "/running" );
+  for ( unsigned int i = 0; i < running.size (); i++ )
+    {
+      lease = directory + "/running/" + running[i];
+      if ( ! parse_lease_name ( running[i], &id, &attempt ) || stat ( lease.c_str (), &status ) != 0 )
+	continue;
+      if ( now - status.st_mtime > lease_seconds && move_on ( lease, false ) )
+	reclaimed++;
+    }
+  return reclaimed;
+}
+
+void work_queue::count ( int* pending, int* running, int* done, int* failed )
+{
+  *pending = list_directory ( directory + "/pending" ).size ();
+  *running = list_directory ( directory + "/running" ).size ();
+  *done    = list_directory ( directory + "/done" ).size ();
+  *failed  = list_directory ( directory + "/failed" ).size ();
+}
+
+bool work_queue::closed ( void )
+{
+  return access ( ( directory + "/closed" ).c_str (), F_OK ) == 0;
+}
+
+// tells the workers that nothing else will come
+bool work_queue::close ( void )
+{
+  ofstream file;
+
+  file.open ( ( directory + "/closed" ).c_str (), ios::out | ios::trunc );
+  file.close ();
+  return static_cast<bool> ( file );
+}
+
+// inotify only sees changes made on this machine, so whoever waits
+// also looks again every timeout_seconds for the ones made elsewhere
+int work_queue::watch ( void )
+{
+  const char* subdirectories[] = { "pending", "running", "done", "failed" };
+  int         watch_fd;
+
+  watch_fd = inotify_init1 ( IN_NONBLOCK | IN_CLOEXEC );
+  if ( watch_fd < 0 )
+    return -1;
+  for ( int i = 0; i < 4; i++ )
+    if ( inotify_add_watch ( watch_fd, ( directory + "/" + subdirectories[i] ).c_str (), IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE ) < 0 )
+      {
+	::close ( watch_fd );
+	return -1;
+      }
+  // for the closed file
+  inotify_add_watch ( watch_fd, directory.c_str (), IN_CREATE );
+  return watch_fd;
+}
+
+bool work_queue::wait_for_change ( int watch_fd, int timeout_seconds )
+{
+  struct pollfd watched;
+  char          events[4096];
+
+  if ( watch_fd < 0 )
+    {
+      sleep ( timeout_seconds );
+      return false;
+    }
+  watched.fd     = watch_fd;
+  watched.events = POLLIN;
+  if ( poll ( &watched, 1, timeout_seconds * 1000 ) <= 0 )
+    return false;
+  while ( read ( watch_fd, events, sizeof ( events ) ) > 0 )
+    ;
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef WORK_QUEUE
+#define WORK_QUEUE
+
+#include <string>
+#include <vector>
+
+#include "task_list.hpp"
+
+// A queue of synthesis tasks kept in a directory that every worker can
+// see (the experiment directory, local or shared by the cluster nodes).
+// Each task is a file holding its task line, and its state is the
+// subdirectory it is in:
+//
+//   pending/<id>-<attempt>                 waiting for a worker
+//   running/<id>-<attempt>-<host>-<pid>    leased by that worker
+//   done/<id>, failed/<id>                 finished
+//
+// Every change of state is a single rename, which is atomic even over
+// NFS, so a task is leased by exactly one worker. The worker touches
+// its lease while the task runs; a lease that has not been touched for
+// lease_seconds is taken back by the coordinator and the task retried,
+// as is a task that failed, up to attempts times in all. The age of a
+// lease is measured against the file "clock", which the coordinator
+// touches, so that only the clock of the server holding the queue
+// counts.
+class work_queue
+{
+ public:
+  std::string directory;
+  int         attempts;
+  int         lease_seconds;
+  int         number_of_tasks;
+  work_queue ( const std::string& queue_directory );
+  bool create          ( const std::vector<synthesis_task>& tasks, int attempts, int lease_seconds );
+  bool load            ( void );
+  bool claim           ( synthesis_task& task, std::string& lease );
+  bool heartbeat       ( const std::string& lease );
+  bool complete        ( const std::string& lease );
+  bool retry           ( const std::string& lease );
+  int  reclaim_expired ( void );
+  void count           ( int* pending, int* running, int* done, int* failed );
+  bool closed          ( void );
+  bool close           ( void );
+  int  watch           ( void );
+  bool wait_for_change ( int watch_fd, int timeout_seconds );
+ private:
+  bool move_on         ( const std::string& lease, bool succeeded );
+};
+
+#endif
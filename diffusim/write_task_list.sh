@@ -0,0 +1,150 @@
+#!/bin/bash
+
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+
+# Writes one task per slice and direction (see task_list.hpp), for the
+# sample_adc_z*.bin files and directions.txt of the current directory,
+# or for the samples of another directory with -i. With the tensor and
+# compartment models, one task per slice computes all the directions at
+# once; the compartment model reads the sample_compartments_z*.bin file
+# of the slice too.
+
+usage=$(
+cat <<EOF 
+USAGE: $0 <PARAMETERS>
+PARAMETERS:
+\t -b size of the b0 in bytes, to write directly into the final 4D file
+\t -d number of gradient directions (obligatory with -b)
+\t -e experiment name (*)
+\t -g shell table: every task synthesizes all of its shells (see sequence.hpp)
+\t -i directory of the sample files (default: the current one)
+\t -m memory budget in MB for each process
+\t -o task list file name (*)
+\t -p gradient waveform file (see waveform.hpp)
+\t -r directory the results are written to (default: the current one)
+\t -s number of slices (obligatory with -b)
+\t -t number of steps per second (*)
+\t -x diffusion model: principal, tensor or compartments (see diffusion_model.hpp; all but principal need -b)
+(*) Indicates an obligatory option.
+EOF
+)
+
+memory_budget=64
+model=principal
+
+while getopts "b:d:e:g:i:m:o:p:r:s:t:x:" OPTION; do
+    case $OPTION in
+	b)  b0_size=$OPTARG
+	    ;;
+	d)  directions=$OPTARG
+	    ;;
+	e)  experiment_name=$OPTARG
+	    ;;
+	g)  shell_table=$OPTARG
+	    ;;
+	i)  sample_prefix=$OPTARG/
+	    ;;
+	m)  memory_budget=$OPTARG
+	    ;;
+	o)  task_list=$OPTARG
+	    ;;
+	p)  waveform=$OPTARG
+	    ;;
+	r)  result_prefix=$OPTARG/
+	    ;;
+	s)  slices=$OPTARG
+	    ;;
+	t)  steps_per_second=$OPTARG
+	    ;;
+	x)  model=$OPTARG
+	    ;;
+	*) 
+	    echo "Unrecognized option."
+	    echo -e "$usage"
+	    exit 1
+	    ;;
+    esac
+done
+
+parameters="experiment_name task_list steps_per_second"
+for param in $parameters; do
+    eval content=\$$param
+    if [ -z "$content" ]; then
+	echo "ERROR: Missing parameters."
+	echo -e "$usage"
+	exit 1
+    fi
+done
+
+if [ ! "$model" == "principal" ] && [ -z "$b0_size" ]; then
+    echo "ERROR: the $model model writes directly into the final 4D file, give -b."
+    echo -e "$usage"
+    exit 1
+fi
+
+rm -f $task_list
+task_id=0
+sample_files=`ls -1 --color=never ${sample_prefix}sample_adc*.bin | sed 's/^.*\///'`
+for sample in $sample_files; do
+    number=`echo $sample | sed 's/sample_adc_z//' | sed 's/.bin//'`
+    if [ ! "$model" == "principal" ]; then
+	# the first direction stands for the task, the others come from
+	# the table
+	line=`grep -m 1 -v '^[[:space:]]*$' directions.txt`
+	grad_x=`echo $line | awk '{ print $1 }'`
+	grad_y=`echo $line | awk '{ print $2 }'`
+	grad_z=`echo $line | awk '{ print $3 }'`
+	task_options="-memory $memory_budget -model $model -gradients directions.txt"
+	if [ "$model" == "compartments" ]; then
+	    task_options="$task_options -compartments ${sample_prefix}sample_compartments_z${number}.bin"
+	fi
+	if [ -n "$shell_table" ]; then
+	    task_options="$task_options -shells $shell_table"
+	fi
+	if [ -n "$waveform" ]; then
+	    task_options="$task_options -waveform $waveform"
+	fi
+	task_options="$task_options -destination ${result_prefix}${experiment_name}_synthetic.raw -direction 0 -slice $((10#$number)) -directions $directions -slices $slices -b0_size $b0_size"
+	echo "$task_id ${sample_prefix}$sample ${result_prefix}${experiment_name}_${number} $grad_x $grad_y $grad_z $steps_per_second $task_options" >> $task_list
+	task_id=$(($task_id + 1))
+	continue
+    fi
+    direction_index=0
+    while read line; do
+	grad_x=`echo $line | awk '{ print $1 }'`
+	grad_y=`echo $line | awk '{ print $2 }'`
+	grad_z=`echo $line | awk '{ print $3 }'`
+	task_options="-memory $memory_budget"
+	if [ -n "$shell_table" ]; then
+	    task_options="$task_options -shells $shell_table"
+	fi
+	if [ -n "$waveform" ]; then
+	    task_options="$task_options -waveform $waveform"
+	fi
+	if [ -n "$b0_size" ]; then
+	    # every chunk written at its offset in the final 4D file
+	    task_options="$task_options -destination ${result_prefix}${experiment_name}_synthetic.raw -direction $direction_index -slice $((10#$number)) -directions $directions -slices $slices -b0_size $b0_size"
+	fi
+	echo "$task_id ${sample_prefix}$sample ${result_prefix}${experiment_name}_${number}_${grad_x}_${grad_y}_${grad_z} $grad_x $grad_y $grad_z $steps_per_second $task_options" >> $task_list
+	task_id=$(($task_id + 1))
+	direction_index=$(($direction_index + 1))
+    done < directions.txt
+done
+
+exit 0
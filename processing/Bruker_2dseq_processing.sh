@@ -21,21 +21,25 @@
 usage=$(
 cat <<EOF 
 USAGE: $0 <PARAMETERS>
-PARAMETERS (all are obligatory):
-\t -b number_of_b_values
-\t -d number_of_directions (including trace, if any)
-\t -e experiment_name (equals directory name for files)
-\t -o output_pixel_size (in bytes)
-\t -p input_pixel_size (in bytes)
-\t -s number_of_slices
-\t -t number_of_traces
-\t -x size_x_dimension (in pixels)
-\t -y size_y_dimension (in pixels)
-\t -z number_of_b0_components
+PARAMETERS:
+\t -b number_of_b_values (*)
+\t -d number_of_directions (including trace, if any) (*)
+\t -e experiment_name (equals directory name for files) (*)
+\t -f offset added to each pixel after the slope (read from experiment_name_visu_pars when omitted, else 0)
+\t -l slope each pixel is multiplied by (read from experiment_name_visu_pars when omitted, else 1)
+\t -o output_pixel_type (int8, uint8, int16, uint16, int32, uint32, float32, or a size in bytes) (*)
+\t -p input_pixel_type (as above) (*)
+\t -r byte order of the 2dseq file (little or big; read from experiment_name_visu_pars when omitted)
+\t -s number_of_slices (*)
+\t -t number_of_traces (*)
+\t -x size_x_dimension (in pixels) (*)
+\t -y size_y_dimension (in pixels) (*)
+\t -z number_of_b0_components (*)
+(*) Indicates an obligatory option.
 EOF
 )
 
-while getopts "b:d:e:o:p:s:t:x:y:z:" OPTION; do
+while getopts "b:d:e:f:l:o:p:r:s:t:x:y:z:" OPTION; do
     case $OPTION in
 	b) 
 	    number_of_b_values=$OPTARG
@@ -46,11 +50,20 @@ while getopts "b:d:e:o:p:s:t:x:y:z:" OPTION; do
 	e)
 	    experiment=$OPTARG
 	    ;;
+	f)
+	    offset=$OPTARG
+	    ;;
+	l)
+	    slope=$OPTARG
+	    ;;
 	o)  
-	    output_pixel_size=$OPTARG
+	    output_pixel_type=$OPTARG
 	    ;;
 	p) 
-	    input_pixel_size=$OPTARG
+	    input_pixel_type=$OPTARG
+	    ;;
+	r)
+	    byte_order=$OPTARG
 	    ;;
 	s) 
 	    number_of_slices=$OPTARG
@@ -78,8 +91,8 @@ done
 if [ -z "$number_of_b_values" -o \
     -z "$number_of_directions" -o \
     -z "$experiment" -o \
-    -z "$input_pixel_size" -o \
-    -z "$output_pixel_size" -o \
+    -z "$input_pixel_type" -o \
+    -z "$output_pixel_type" -o \
     -z "$number_of_slices" -o \
     -z "$number_of_traces" -o \
     -z "$size_x_dimension" -o \
@@ -92,10 +105,82 @@ fi
 
 refined_directions=$(($number_of_directions-$number_of_traces))
 
+# the header says in which byte order the 2dseq was written
+visu_pars=$experiment/${experiment}_visu_pars
+if [ -z "$byte_order" -a -f "$visu_pars" ]; then
+    byte_order=`grep --color=never '^##\$VisuCoreByteOrder=' $visu_pars | sed 's/.*=//' | tr -d '\r '`
+fi
+if [ -z "$byte_order" ]; then
+    byte_order=little
+fi
+
+# and how the stored pixels map to the reconstructed values: a single
+# value for the whole series is used as is, one that varies per frame
+# cannot be undone with a single slope and offset
+visu_pars_scalar () {
+    awk -v name="$1" '
+	$0 ~ "^##\\$" name "=" { found = 1; values = $0; sub ( /^[^=]*=/, "", values ); if ( values ~ /^\(/ ) values = ""; next }
+	found && /^(##|\$\$)/ { exit }
+	found { values = values " " $0 }
+	END {
+	    gsub ( /\r/, "", values )
+	    count = split ( values, tokens, " " )
+	    for ( i = 1; i <= count; i++ ) {
+		value = tokens[i]
+		# "@n*(value)" stands for n frames with the same value
+		if ( value ~ /^@[0-9]+\*\(.*\)$/ ) {
+		    sub ( /^@[0-9]+\*\(/, "", value )
+		    sub ( /\)$/, "", value )
+		}
+		if ( i == 1 )
+		    first = value
+		else if ( value + 0 != first + 0 ) {
+		    print "varies"
+		    exit
+		}
+	    }
+	    if ( count > 0 )
+		print first
+	}' $visu_pars
+}
+if [ -z "$slope" -a -f "$visu_pars" ]; then
+    slope=`visu_pars_scalar VisuCoreDataSlope`
+fi
+if [ -z "$offset" -a -f "$visu_pars" ]; then
+    offset=`visu_pars_scalar VisuCoreDataOffs`
+fi
+if [ "$slope" == "varies" -o "$offset" == "varies" ]; then
+    echo "ERROR: the slope or offset in $visu_pars varies per frame; give single values with -l and -f."
+    exit 1
+fi
+if [ -z "$slope" ]; then
+    slope=1
+fi
+if [ -z "$offset" ]; then
+    offset=0
+fi
+
+# the later steps only move bytes around, they need the output pixel size
+case $output_pixel_type in
+    int8|uint8|1)
+	output_pixel_size=1
+	;;
+    int16|uint16|2)
+	output_pixel_size=2
+	;;
+    int32|uint32|float32|4)
+	output_pixel_size=4
+	;;
+    *)
+	echo "Unknown output pixel type $output_pixel_type."
+	exit 1
+	;;
+esac
+
 echo "Supposing that $experiment/directions.txt and $experiment/directions.dat exist and are ok."
 
 echo "Spliting data in b0 and remainder... "
-./Bruker_split_b0_remainder.exe $experiment/${experiment}_acquisition.2dseq $number_of_b_values $number_of_directions $number_of_slices $input_pixel_size $number_of_b0_components $size_x_dimension $size_y_dimension $experiment/${experiment}_b0.raw $experiment/${experiment}_b0_remainder.raw $output_pixel_size
+./Bruker_split_b0_remainder.exe $experiment/${experiment}_acquisition.2dseq $number_of_b_values $number_of_directions $number_of_slices $input_pixel_type $number_of_b0_components $size_x_dimension $size_y_dimension $experiment/${experiment}_b0.raw $experiment/${experiment}_b0_remainder.raw $output_pixel_type -slope $slope -offset $offset -byte_order $byte_order || exit 1
 echo "Done."
 
 echo "Splitting remainder in trace(s) and remainder... " 
@@ -115,5 +200,12 @@ done
 
 echo "Done. Final files have name prefix $experiment/${experiment}_b_value_series_result-."
 
+echo "Writing each series as NIfTI... "
+volumes=$(($number_of_b0_components+$refined_directions))
+for file in `ls -1 --color=never $experiment/${experiment}_b_value_series_result-*.raw`; do
+    ./raw_to_nifti.exe $file `echo $file | sed 's/\.raw$/.nii.gz/'` $size_x_dimension $size_y_dimension $number_of_slices $volumes $output_pixel_type || exit 1
+done
+echo "Done."
+
 exit
 
@@ -19,42 +19,74 @@
 */
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdlib>
 
+#include "block_io.hpp"
+#include "pixel_conversion.hpp"
+
 using namespace std;
 
+// Converts number_of_pixels pixels from the reader to the writer, a
+// whole I/O block at a time.
+bool copy_pixels ( block_reader& input, pixel_type input_type, block_writer& output, pixel_type output_type, streamoff number_of_pixels, double slope, double offset )
+{
+  char*     input_buffer;
+  char*     output_buffer;
+  streamoff pixels_per_block;
+  streamoff pixels;
+  bool      ok = true;
+
+  pixels_per_block = BLOCK_IO_BUFFER_SIZE / pixel_type_size ( input_type );
+  input_buffer  = new char[pixels_per_block * pixel_type_size ( input_type )];
+  output_buffer = new char[pixels_per_block * pixel_type_size ( output_type )];
+  while ( ok && number_of_pixels > 0 )
+    {
+      pixels = number_of_pixels < pixels_per_block ? number_of_pixels : pixels_per_block;
+      ok = input.read ( input_buffer, pixels * pixel_type_size ( input_type ) );
+      if ( ok )
+	convert_pixels ( input_buffer, input_type, output_buffer, output_type, pixels, slope, offset );
+      ok = ok && output.write ( output_buffer, pixels * pixel_type_size ( output_type ) );
+      number_of_pixels -= pixels;
+    }
+  delete[] input_buffer;
+  delete[] output_buffer;
+  return ok;
+}
+
 int main (int argc, char** argv)
 {
-  char         buffer[128];
-  fstream      remainder_file;
-  ifstream     input_file;
-  int          expected_file_size;      // in bytes
-  int          file_size;               // in bytes
-  int          input_file_size;
+  block_reader input_file;
+  block_writer output_file;
+  block_writer remainder_file;
+  bool         direct;
+  double       offset;
+  double       slope;
+  streamoff    expected_file_size;      // in bytes
+  streamoff    input_file_size;
   int          output_pixel_size;
+  pixel_type   output_type;
+  pixel_type   input_type;
   int          number_of_b_values;
   int          number_of_directions;
   int          number_of_slices;
   int          number_of_b0_components;
-  int          offset_b0;
-  int          output_file_size;        // in bytes
+  streamoff    offset_b0;
   int          input_pixel_size;              // in bytes
-  int          remainder_file_size;     // in bytes
-  int          output_remainder_file_size;     // in bytes
+  streamoff    remainder_file_size;     // in bytes
+  streamoff    output_remainder_file_size;     // in bytes
   int          size_x_dimension;        // in pixels
   int          size_y_dimension;        // in pixels
-  ofstream     output_file;
   string       input_file_name;
   string       output_file_name;
   string       remainder_file_name;
   
   // sanity
-  if ( argc < 11 )
+  if ( argc < 12 )
     {
       cout << "ERROR" << endl;
-      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace, if any) number_of_slices input_pixel_size(in bytes) number_of_b0_components size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name remainder_file_name output_pixel_size(in bytes)" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace, if any) number_of_slices input_pixel_type number_of_b0_components size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name remainder_file_name output_pixel_type [-slope value] [-offset value] [-direct] [-byte_order little|big]" << endl;
+      cout << "Pixel types: int8, uint8, int16, uint16, int32, uint32, float32 (or 1, 2, 4 for signed integers of that many bytes)." << endl;
       exit (1);
     }
 
@@ -63,95 +95,93 @@ int main (int argc, char** argv)
   number_of_b_values      = atoi ( argv[2] );
   number_of_directions    = atoi ( argv[3] );
   number_of_slices        = atoi ( argv[4] );
-  input_pixel_size        = atoi ( argv[5] );
+  input_type              = pixel_type_from_name ( argv[5] );
   number_of_b0_components = atoi ( argv[6] );
   size_x_dimension        = atoi ( argv[7] );
   size_y_dimension        = atoi ( argv[8] );
   output_file_name        =        argv[9];
   remainder_file_name     =        argv[10];
-  output_pixel_size       = atoi ( argv[11] );
+  output_type             = pixel_type_from_name ( argv[11] );
+  direct                  = direct_requested ( argc, argv, 12 );
+  slope                   = 1.0;
+  offset                  = 0.0;
+  for ( int i = 12; i + 1 < argc; i++ )
+    {
+      if ( string ( argv[i] ) == "-slope" )
+	slope  = atof ( argv[++i] );
+      else if ( string ( argv[i] ) == "-offset" )
+	offset = atof ( argv[++i] );
+    }
+  if ( input_type == unknown_pixel || output_type == unknown_pixel )
+    {
+      cout << "ERROR: unknown pixel type." << endl;
+      exit (1);
+    }
+  input_pixel_size  = pixel_type_size ( input_type );
+  output_pixel_size = pixel_type_size ( output_type );
+  cout << "Converting " << pixel_type_name ( input_type ) << " to " << pixel_type_name ( output_type ) << ", slope " << slope << ", offset " << offset << "." << endl;
 
   // check that sizes match
-  offset_b0 = number_of_b0_components * number_of_slices * input_pixel_size * size_x_dimension * size_y_dimension;
-  remainder_file_size = number_of_b_values * number_of_slices * input_pixel_size * size_x_dimension * size_y_dimension * number_of_directions;
-  output_remainder_file_size = number_of_b_values * number_of_slices * output_pixel_size * size_x_dimension * size_y_dimension * number_of_directions;
+  offset_b0 = static_cast<streamoff> ( number_of_b0_components ) * number_of_slices * input_pixel_size * size_x_dimension * size_y_dimension;
+  remainder_file_size = static_cast<streamoff> ( number_of_b_values ) * number_of_slices * input_pixel_size * size_x_dimension * size_y_dimension * number_of_directions;
+  output_remainder_file_size = static_cast<streamoff> ( number_of_b_values ) * number_of_slices * output_pixel_size * size_x_dimension * size_y_dimension * number_of_directions;
   expected_file_size = offset_b0 + remainder_file_size;
 
   cout << "Expected b0 size:         " << offset_b0 << endl;
   cout << "Expected remainder size:  " << remainder_file_size << endl;
-  cout << "Expected input file size: " << expected_file_size << endl;
-
-  input_file.open (input_file_name.c_str ());
-  input_file.seekg (0, ios::end);
-  input_file_size = input_file.tellg ();
 
-  cout << "Input file size:          " << input_file_size << " ";
-  if ( input_file_size != expected_file_size )
+  if ( ! input_file.open ( input_file_name, direct ) )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR opening input_file." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
-
-  output_file.open (output_file_name.c_str (), fstream::binary | fstream::out | fstream::trunc );
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 12 ), input_pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  input_file_size = input_file.size ();
+  if ( ! check_size ( "input file", input_file_size, expected_file_size ) )
+    exit (1);
 
   // copy the first direction (which encodes B0)
-  input_file.seekg(0, ios::beg);
-  while (input_file.tellg () < offset_b0)
+  expected_file_size = static_cast<streamoff> ( number_of_b0_components ) * number_of_slices * output_pixel_size * size_x_dimension * size_y_dimension;
+  if ( ! output_file.open ( output_file_name, direct, expected_file_size ) )
     {
-      input_file.read   (buffer, input_pixel_size);
-      output_file.write (buffer, output_pixel_size);
+      cout << "ERROR opening output_file." << endl;
+      exit (1);
+    }
+  if ( ! copy_pixels ( input_file, input_type, output_file, output_type, offset_b0 / input_pixel_size, slope, offset ) )
+    {
+      cout << "ERROR copying the B0." << endl;
+      exit (1);
     }
-  output_file.close ();
 
   // copy the remainder (everything but the B0)
-  remainder_file.open (remainder_file_name.c_str (), fstream::binary | fstream::out | fstream::in | fstream::trunc );
-  if ( ! remainder_file )
+  if ( ! remainder_file.open ( remainder_file_name, direct, output_remainder_file_size ) )
     {
       cout << "ERROR opening remainder_file." << endl;
       exit (1);
     }
 
-  // since the file is already at offset_b0 position...
-  while (input_file.tellg () < input_file_size )
+  // since the reader is already at offset_b0 position...
+  if ( ! copy_pixels ( input_file, input_type, remainder_file, output_type, remainder_file_size / input_pixel_size, slope, offset ) )
     {
-      input_file.read      ( buffer, input_pixel_size );
-      remainder_file.write ( buffer, output_pixel_size );
+      cout << "ERROR copying the remainder." << endl;
+      exit (1);
     }
   input_file.close ();
 
-  // verify remainder file size
-  remainder_file.seekg ( 0, ios::end );
-  file_size = remainder_file.tellg ();
-  remainder_file.close ();
-  //cout << "Expected remainder file size: " << remainder_file_size << endl;
-  cout << "Remainder file size:      " << file_size << " ";
-  if ( file_size != output_remainder_file_size )
-    {
-      cout << "FAIL" << endl;
-      exit (1);
-    }
-  else
-    cout << "OK" << endl;
+  // verify file sizes on the open descriptors
+  if ( ! check_size ( "remainder file", remainder_file.size (), output_remainder_file_size ) )
+    exit (1);
+  if ( ! check_size ( "output file", output_file.size (), expected_file_size ) )
+    exit (1);
 
-  // verify output file size
-  expected_file_size = number_of_b0_components * number_of_slices * output_pixel_size * size_x_dimension * size_y_dimension;
-  input_file.open (output_file_name.c_str ());
-  input_file.seekg (0, ios::end);
-  output_file_size = input_file.tellg ();
-  //cout << "Expected output file size: " << expected_file_size << endl;
-  cout << "Output file size:         " << output_file_size << " ";
-  if ( output_file_size != expected_file_size )
+  if ( ! remainder_file.close () || ! output_file.close () )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR closing the output files." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
-
-  input_file.close ();
   return 0;
 }
@@ -18,68 +18,59 @@
 # Author can be reached at rborges@if.usp.br
 */
 
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <cstdlib>
 
+#include "block_io.hpp"
+
 using namespace std;
 
 int main (int argc, char** argv)
 {
-  char         buffer[256];
-  ifstream     b0_file;
-  ifstream     remainder_file;
-  int          b0_file_size;
-  int          file_size;
-  int          length;
-  int          output_file_size;
-  int          remainder_file_size;
-  fstream      output_file;
+  block_reader b0_file;
+  block_reader remainder_file;
+  block_writer output_file;
+  bool         direct;
+  streamoff    b0_file_size;
+  streamoff    output_file_size;
+  streamoff    remainder_file_size;
   string       b0_file_name;
   string       output_file_name;
   string       remainder_file_name;
-  stringstream string_buffer;
   
   if (argc < 4)
     {
       cout << "ERROR: too few arguments." << endl;
-      cout << "USAGE: " << argv[0] << " b0_file_name remainder_file_name output_file_name" << endl;
+      cout << "USAGE: " << argv[0] << " b0_file_name remainder_file_name output_file_name [-direct]" << endl;
       exit (1);
     }
 
   b0_file_name        = argv[1];
   remainder_file_name = argv[2];
   output_file_name    = argv[3];
+  direct              = direct_requested ( argc, argv, 4 );
 
   // sanity
-  b0_file.open ( b0_file_name.c_str () );
-  b0_file.seekg ( 0, ios::end );
-  b0_file_size = b0_file.tellg ();
-  remainder_file.open ( remainder_file_name.c_str () );
-  remainder_file.seekg ( 0, ios::end );
-  remainder_file_size = remainder_file.tellg ();
-  output_file_size = b0_file_size + remainder_file_size;
+  if ( ! b0_file.open ( b0_file_name, direct ) || ! remainder_file.open ( remainder_file_name, direct ) )
+    {
+      cout << "ERROR opening the input files." << endl;
+      exit (1);
+    }
+  b0_file_size        = b0_file.size ();
+  remainder_file_size = remainder_file.size ();
+  output_file_size    = b0_file_size + remainder_file_size;
 
-  // copy b0 to beginning of output file
-  output_file.open ( output_file_name.c_str (), fstream::binary | fstream::trunc | fstream::in | fstream::out );
-  output_file.seekp ( 0, ios::beg );
-  b0_file.seekg ( 0, ios::beg );
-  while ( b0_file.tellg () < b0_file_size )
+  // copy b0 to beginning of output file, then append the remainder
+  if ( ! output_file.open ( output_file_name, direct, output_file_size ) )
     {
-      length = 2;
-      b0_file.read (buffer, length);
-      output_file.write (buffer, length);
+      cout << "ERROR opening output_file." << endl;
+      exit (1);
     }
-  
-  // append remainder to output file
-  remainder_file.seekg ( 0, ios::beg );
-  while ( remainder_file.tellg () < remainder_file_size )
+  if ( ! copy_blocks ( b0_file, output_file, b0_file_size ) || ! copy_blocks ( remainder_file, output_file, remainder_file_size ) )
     {
-      length = 2;
-      remainder_file.read (buffer, length);
-      output_file.write (buffer, length);
+      cout << "ERROR copying to output_file." << endl;
+      exit (1);
     }
 
   // cleanup
@@ -87,15 +78,12 @@ int main (int argc, char** argv)
   remainder_file.close ();
 
   // sanity
-  output_file.seekg ( 0, ios::end );
-  file_size = output_file.tellg ();
-  output_file.close ();
-  cout << "Expected output file size: " << output_file_size << endl;
-  cout << "Output file size:          " << file_size << " ";
-  if ( file_size != output_file_size )
-    cout << "FAIL" << endl;
-  else
-    cout << "OK" << endl;
+  check_size ( "output file", output_file.size (), output_file_size );
+  if ( ! output_file.close () )
+    {
+      cout << "ERROR closing output_file." << endl;
+      exit (1);
+    }
 
   return 0;
 }
@@ -0,0 +1,357 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "block_io.hpp"
+
+using namespace std;
+
+static char* allocate_buffer ( void )
+{
+  void* buffer;
+
+  if ( posix_memalign ( &buffer, BLOCK_IO_ALIGNMENT, BLOCK_IO_BUFFER_SIZE ) != 0 )
+    {
+      cout << "ERROR: cannot allocate I/O buffer." << endl;
+      exit (1);
+    }
+  return static_cast<char*> ( buffer );
+}
+
+static streamoff descriptor_size ( int fd )
+{
+  struct stat status;
+
+  if ( fd < 0 || fstat ( fd, &status ) != 0 )
+    return -1;
+  return status.st_size;
+}
+
+block_reader::block_reader ()
+{
+  fd            = -1;
+  swap_size     = 0;
+  buffer        = NULL;
+  buffer_offset = 0;
+  buffer_fill   = 0;
+  position      = 0;
+}
+
+block_reader::~block_reader ()
+{
+  close ();
+}
+
+bool block_reader::open ( const string& file_name, bool direct )
+{
+  close ();
+  fd = ::open ( file_name.c_str (), O_RDONLY | ( direct ? O_DIRECT : 0 ) );
+  if ( fd < 0 && direct )
+    fd = ::open ( file_name.c_str (), O_RDONLY );
+  if ( fd < 0 )
+    return false;
+  posix_fadvise ( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+  buffer = allocate_buffer ();
+  return true;
+}
+
+void block_reader::close ( void )
+{
+  if ( fd >= 0 )
+    ::close ( fd );
+  free ( buffer );
+  fd            = -1;
+  buffer        = NULL;
+  buffer_offset = 0;
+  buffer_fill   = 0;
+  position      = 0;
+}
+
+streamoff block_reader::size ( void )
+{
+  return descriptor_size ( fd );
+}
+
+streamoff block_reader::tell ( void )
+{
+  return position;
+}
+
+void block_reader::seek ( streamoff offset )
+{
+  position = offset;
+}
+
+bool block_reader::fill ( streamoff offset )
+{
+  ssize_t result;
+
+  // aligned offset and length, whether or not O_DIRECT is in use
+  buffer_offset = offset - offset % BLOCK_IO_ALIGNMENT;
+  buffer_fill   = 0;
+  while ( buffer_fill < BLOCK_IO_BUFFER_SIZE )
+    {
+      result = pread ( fd, buffer + buffer_fill, BLOCK_IO_BUFFER_SIZE - buffer_fill, buffer_offset + buffer_fill );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result < 0 )
+	return false;
+      if ( result == 0 )
+	break;
+      buffer_fill += result;
+      // a short read that is not at a block boundary is the end of file
+      if ( buffer_fill % BLOCK_IO_ALIGNMENT != 0 )
+	break;
+    }
+  if ( swap_size > 1 )
+    swap_bytes ( buffer, buffer_fill / swap_size, swap_size );
+  // ask for the next window while this one is being used
+  posix_fadvise ( fd, buffer_offset + buffer_fill, BLOCK_IO_BUFFER_SIZE, POSIX_FADV_WILLNEED );
+  return buffer_fill > offset - buffer_offset;
+}
+
+bool block_reader::read ( char* destination, streamoff length )
+{
+  streamoff available;
+
+  while ( length > 0 )
+    {
+      if ( position < buffer_offset || position >= buffer_offset + buffer_fill )
+	if ( ! fill ( position ) )
+	  return false;
+      available = buffer_offset + buffer_fill - position;
+      if ( available > length )
+	available = length;
+      memcpy ( destination, buffer + ( position - buffer_offset ), available );
+      destination += available;
+      position    += available;
+      length      -= available;
+    }
+  return true;
+}
+
+bool block_reader::set_byte_order ( byte_order order, int element_size )
+{
+  if ( order == unknown_byte_order )
+    return false;
+  swap_size = byte_order_differs ( order ) ? element_size : 0;
+  // anything already buffered was read in the old order
+  buffer_offset = 0;
+  buffer_fill   = 0;
+  return true;
+}
+
+bool block_reader::read_at ( char* destination, streamoff length, streamoff offset )
+{
+  seek ( offset );
+  return read ( destination, length );
+}
+
+block_writer::block_writer ()
+{
+  fd          = -1;
+  direct      = false;
+  buffer      = NULL;
+  buffer_fill = 0;
+  position    = 0;
+}
+
+block_writer::~block_writer ()
+{
+  close ();
+}
+
+bool block_writer::open ( const string& file_name, bool use_direct, streamoff final_size )
+{
+  close ();
+  direct = use_direct;
+  fd = ::open ( file_name.c_str (), O_WRONLY | O_CREAT | O_TRUNC | ( direct ? O_DIRECT : 0 ), 0644 );
+  if ( fd < 0 && direct )
+    {
+      direct = false;
+      fd = ::open ( file_name.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    }
+  if ( fd < 0 )
+    return false;
+  // reserve the space up front when the final size is known
+  if ( final_size > 0 && posix_fallocate ( fd, 0, final_size ) != 0 )
+    if ( ftruncate ( fd, final_size ) != 0 )
+      return false;
+  buffer = allocate_buffer ();
+  return true;
+}
+
+bool block_writer::drop_direct ( void )
+{
+  int flags;
+
+  if ( ! direct )
+    return true;
+  flags = fcntl ( fd, F_GETFL );
+  if ( flags < 0 || fcntl ( fd, F_SETFL, flags & ~O_DIRECT ) != 0 )
+    return false;
+  direct = false;
+  return true;
+}
+
+bool block_writer::flush ( void )
+{
+  ssize_t   result;
+  streamoff written = 0;
+
+  // O_DIRECT needs whole blocks: an unaligned tail goes buffered
+  if ( buffer_fill % BLOCK_IO_ALIGNMENT != 0 && ! drop_direct () )
+    return false;
+  while ( written < buffer_fill )
+    {
+      result = pwrite ( fd, buffer + written, buffer_fill - written, position + written );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result <= 0 )
+	return false;
+      written += result;
+    }
+  position    += buffer_fill;
+  buffer_fill =  0;
+  return true;
+}
+
+bool block_writer::close ( void )
+{
+  bool ok = true;
+
+  if ( fd >= 0 )
+    {
+      ok = flush ();
+      // drop any preallocated space that was not written
+      if ( ok && descriptor_size ( fd ) > position && ftruncate ( fd, position ) != 0 )
+	ok = false;
+      ::close ( fd );
+    }
+  free ( buffer );
+  fd          = -1;
+  buffer      = NULL;
+  buffer_fill = 0;
+  position    = 0;
+  return ok;
+}
+
+streamoff block_writer::size ( void )
+{
+  // not the size of the file, which is preallocated: the end of what
+  // was actually written
+  if ( ! flush () )
+    return -1;
+  return position;
+}
+
+bool block_writer::write ( const char* source, streamoff length )
+{
+  streamoff room;
+
+  while ( length > 0 )
+    {
+      room = BLOCK_IO_BUFFER_SIZE - buffer_fill;
+      if ( room > length )
+	room = length;
+      memcpy ( buffer + buffer_fill, source, room );
+      buffer_fill += room;
+      source      += room;
+      length      -= room;
+      if ( buffer_fill == BLOCK_IO_BUFFER_SIZE && ! flush () )
+	return false;
+    }
+  return true;
+}
+
+bool block_writer::write_at ( const char* source, streamoff length, streamoff offset )
+{
+  ssize_t result;
+
+  if ( ! drop_direct () )
+    return false;
+  while ( length > 0 )
+    {
+      result = pwrite ( fd, source, length, offset );
+      if ( result < 0 && errno == EINTR )
+	continue;
+      if ( result <= 0 )
+	return false;
+      source += result;
+      offset += result;
+      length -= result;
+    }
+  if ( offset > position )
+    position = offset;
+  return true;
+}
+
+bool copy_blocks ( block_reader& input, block_writer& output, streamoff length )
+{
+  char*     buffer;
+  streamoff chunk;
+  bool      ok = true;
+
+  buffer = allocate_buffer ();
+  while ( ok && length > 0 )
+    {
+      chunk = length < BLOCK_IO_BUFFER_SIZE ? length : BLOCK_IO_BUFFER_SIZE;
+      ok = input.read ( buffer, chunk ) && output.write ( buffer, chunk );
+      length -= chunk;
+    }
+  free ( buffer );
+  return ok;
+}
+
+bool check_size ( const string& label, streamoff size, streamoff expected_size )
+{
+  string capitalized = label;
+
+  capitalized[0] = toupper ( capitalized[0] );
+  cout << "Expected " << label << " size: " << expected_size << endl;
+  cout << capitalized << " size:          " << size << " ";
+  if ( size != expected_size )
+    {
+      cout << "FAIL" << endl;
+      return false;
+    }
+  cout << "OK" << endl;
+  return true;
+}
+
+bool direct_requested ( int argc, char** argv, int first_option )
+{
+  for ( int i = first_option; i < argc; i++ )
+    if ( string ( argv[i] ) == "-direct" )
+      return true;
+  return false;
+}
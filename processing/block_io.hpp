@@ -0,0 +1,91 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef BLOCK_IO
+#define BLOCK_IO
+
+#include <ios>
+#include <string>
+
+#include "byte_order.hpp"
+
+// Reads and writes go through buffers of this size, aligned so that
+// they can also be used with O_DIRECT.
+#define BLOCK_IO_BUFFER_SIZE ( 8 * 1024 * 1024 )
+#define BLOCK_IO_ALIGNMENT   4096
+
+// Sequential or random reads of a raw file, in large aligned blocks.
+// The file is opened once; its size comes from the open descriptor.
+// When the file is in the other byte order, each block is swapped as
+// it is read, so callers always see host order.
+class block_reader
+{
+ public:
+  block_reader  ();
+  ~block_reader ();
+  bool           open    ( const std::string& file_name, bool direct = false );
+  void           close   ( void );
+  std::streamoff size    ( void );
+  std::streamoff tell    ( void );
+  void           seek    ( std::streamoff offset );
+  bool           read    ( char* destination, std::streamoff length );
+  bool           read_at ( char* destination, std::streamoff length, std::streamoff offset );
+  bool           set_byte_order ( byte_order order, int element_size );
+ private:
+  int            fd;
+  int            swap_size;
+  char*          buffer;
+  std::streamoff buffer_offset;
+  std::streamoff buffer_fill;
+  std::streamoff position;
+  bool           fill    ( std::streamoff offset );
+};
+
+// Sequential writes through a large aligned buffer, plus random
+// writes at explicit offsets. With O_DIRECT, random writes and the
+// unaligned tail of the file fall back to buffered I/O. size () is the
+// end of the furthest write, whatever space open () reserved.
+class block_writer
+{
+ public:
+  block_writer  ();
+  ~block_writer ();
+  bool           open     ( const std::string& file_name, bool direct = false, std::streamoff final_size = -1 );
+  bool           close    ( void );
+  bool           flush    ( void );
+  std::streamoff size     ( void );
+  bool           write    ( const char* source, std::streamoff length );
+  bool           write_at ( const char* source, std::streamoff length, std::streamoff offset );
+ private:
+  int            fd;
+  bool           direct;
+  char*          buffer;
+  std::streamoff buffer_fill;
+  std::streamoff position;
+  bool           drop_direct ( void );
+};
+
+// Copies length bytes from the reader's position to the writer.
+bool copy_blocks      ( block_reader& input, block_writer& output, std::streamoff length );
+// Prints the usual "Expected ... / ... OK|FAIL" lines and says if the sizes match.
+bool check_size       ( const std::string& label, std::streamoff size, std::streamoff expected_size );
+// True when "-direct" is among the trailing arguments.
+bool direct_requested ( int argc, char** argv, int first_option );
+
+#endif
@@ -0,0 +1,77 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include "block_queue.hpp"
+
+block_queue::block_queue ( int queue_capacity )
+{
+  capacity = queue_capacity;
+  blocks   = new data_block[capacity];
+  first    = 0;
+  count    = 0;
+  closed   = false;
+  pthread_mutex_init ( &mutex, NULL );
+  pthread_cond_init ( &not_empty, NULL );
+  pthread_cond_init ( &not_full, NULL );
+}
+
+block_queue::~block_queue ()
+{
+  pthread_cond_destroy ( &not_full );
+  pthread_cond_destroy ( &not_empty );
+  pthread_mutex_destroy ( &mutex );
+  delete[] blocks;
+}
+
+void block_queue::push ( data_block block )
+{
+  pthread_mutex_lock ( &mutex );
+  while ( count == capacity )
+    pthread_cond_wait ( &not_full, &mutex );
+  blocks[( first + count ) % capacity] = block;
+  count++;
+  pthread_cond_signal ( &not_empty );
+  pthread_mutex_unlock ( &mutex );
+}
+
+bool block_queue::pop ( data_block* block )
+{
+  pthread_mutex_lock ( &mutex );
+  while ( count == 0 && ! closed )
+    pthread_cond_wait ( &not_empty, &mutex );
+  if ( count == 0 )
+    {
+      pthread_mutex_unlock ( &mutex );
+      return false;
+    }
+  *block = blocks[first];
+  first  = ( first + 1 ) % capacity;
+  count--;
+  pthread_cond_signal ( &not_full );
+  pthread_mutex_unlock ( &mutex );
+  return true;
+}
+
+void block_queue::close ( void )
+{
+  pthread_mutex_lock ( &mutex );
+  closed = true;
+  pthread_cond_broadcast ( &not_empty );
+  pthread_mutex_unlock ( &mutex );
+}
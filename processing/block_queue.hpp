@@ -0,0 +1,56 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef BLOCK_QUEUE
+#define BLOCK_QUEUE
+
+#include <ios>
+#include <pthread.h>
+
+typedef struct
+{
+  char*          data;
+  std::streamoff length;
+} data_block;
+
+// A bounded first-in first-out queue of blocks between one producer
+// and one consumer thread. push () waits while the queue is full and
+// pop () while it is empty, so memory use stays bounded and the two
+// sides run at the pace of the slower one.
+class block_queue
+{
+ public:
+  block_queue  ( int capacity );
+  ~block_queue ();
+  void push  ( data_block block );
+  bool pop   ( data_block* block );
+  // no more blocks will be pushed; pop () returns false once empty
+  void close ( void );
+ private:
+  data_block*     blocks;
+  int             capacity;
+  int             first;
+  int             count;
+  bool            closed;
+  pthread_mutex_t mutex;
+  pthread_cond_t  not_empty;
+  pthread_cond_t  not_full;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstring>
+#include <stdint.h>
+
+#if defined ( __x86_64__ ) || defined ( __i386__ )
+#define BYTE_ORDER_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#include "byte_order.hpp"
+
+using namespace std;
+
+byte_order byte_order_from_name ( const string& name )
+{
+  if ( name == "little" || name == "littleEndian" )
+    return little_endian_byte_order;
+  if ( name == "big" || name == "bigEndian" )
+    return big_endian_byte_order;
+  if ( name == "native" )
+    return native_byte_order;
+  return unknown_byte_order;
+}
+
+byte_order byte_order_requested ( int argc, char** argv, int first_option )
+{
+  for ( int i = first_option; i + 1 < argc; i++ )
+    if ( string ( argv[i] ) == "-byte_order" )
+      return byte_order_from_name ( argv[i + 1] );
+  return native_byte_order;
+}
+
+bool byte_order_differs ( byte_order order )
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return order == little_endian_byte_order;
+#else
+  return order == big_endian_byte_order;
+#endif
+}
+
+template <typename element_t> static inline element_t swap_element ( element_t value );
+
+template <> inline uint16_t swap_element ( uint16_t value ) { return __builtin_bswap16 ( value ); }
+template <> inline uint32_t swap_element ( uint32_t value ) { return __builtin_bswap32 ( value ); }
+template <> inline uint64_t swap_element ( uint64_t value ) { return __builtin_bswap64 ( value ); }
+
+template <typename element_t> static void swap_scalar ( char* data, long long number_of_elements )
+{
+  element_t value;
+
+  // memcpy keeps this correct for unaligned data; it compiles to plain loads
+  for ( long long i = 0; i < number_of_elements; i++ )
+    {
+      memcpy ( &value, data + i * sizeof ( element_t ), sizeof ( element_t ) );
+      value = swap_element ( value );
+      memcpy ( data + i * sizeof ( element_t ), &value, sizeof ( element_t ) );
+    }
+}
+
+#ifdef BYTE_ORDER_SSSE3
+// One shuffle reverses every element in 16 bytes. Built for SSSE3
+// whatever the compiler flags, and only called when the CPU has it.
+__attribute__ (( target ( "ssse3" ) ))
+static long long swap_ssse3 ( char* data, long long bytes, int element_size )
+{
+  __m128i   mask;
+  long long done;
+
+  if ( element_size == 2 )
+    mask = _mm_setr_epi8 ( 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 );
+  else if ( element_size == 4 )
+    mask = _mm_setr_epi8 ( 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 );
+  else
+    mask = _mm_setr_epi8 ( 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 );
+  for ( done = 0; done + 16 <= bytes; done += 16 )
+    {
+      __m128i block = _mm_loadu_si128 ( reinterpret_cast<__m128i*> ( data + done ) );
+      _mm_storeu_si128 ( reinterpret_cast<__m128i*> ( data + done ), _mm_shuffle_epi8 ( block, mask ) );
+    }
+  return done;
+}
+#endif
+
+void swap_bytes ( char* data, long long number_of_elements, int element_size )
+{
+  long long done = 0;
+
+#ifdef BYTE_ORDER_SSSE3
+  if ( ( element_size == 2 || element_size == 4 || element_size == 8 ) && __builtin_cpu_supports ( "ssse3" ) )
+    done = swap_ssse3 ( data, number_of_elements * element_size, element_size ) / element_size;
+#endif
+  data               += done * element_size;
+  number_of_elements -= done;
+  switch ( element_size )
+    {
+    case 2:
+      swap_scalar<uint16_t> ( data, number_of_elements );
+      break;
+    case 4:
+      swap_scalar<uint32_t> ( data, number_of_elements );
+      break;
+    case 8:
+      swap_scalar<uint64_t> ( data, number_of_elements );
+      break;
+    default:
+      break;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef BYTE_ORDER_SWAP
+#define BYTE_ORDER_SWAP
+
+#include <string>
+
+enum byte_order { native_byte_order = 0,
+		  little_endian_byte_order,
+		  big_endian_byte_order,
+		  unknown_byte_order };
+
+// Accepts little, big and native, plus the littleEndian and bigEndian
+// of the Bruker VisuCoreByteOrder parameter.
+byte_order  byte_order_from_name ( const std::string& name );
+// The value of "-byte_order order" among the trailing arguments, or
+// native_byte_order if there is none.
+byte_order  byte_order_requested ( int argc, char** argv, int first_option );
+// True when data in this order has to be swapped on this host.
+bool        byte_order_differs   ( byte_order order );
+// Reverses the bytes of each of number_of_elements elements of
+// element_size (2, 4 or 8) bytes, in place.
+void        swap_bytes           ( char* data, long long number_of_elements, int element_size );
+
+#endif
@@ -0,0 +1,410 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "block_io.hpp"
+#include "pixel_conversion.hpp"
+
+using namespace std;
+
+// Compares a synthetic series (diffusim's ${name}_synthetic.raw) with
+// the acquired one (a b_value_series_result file): for the first b0
+// volume of each and then for every direction, and within each region
+// of the labels file written by mask_generator (mask_labels.raw, one
+// unsigned short per voxel, 0 for the background), it prints
+//   voxels, means, bias (synthetic - acquired), RMSE, correlation and
+//   SNR (mean acquired signal over the standard deviation of the
+//   difference).
+// Both files are read once, in order, a chunk at a time; each chunk is
+// split between one thread per core, every thread keeping its own
+// running moments (Welford), which are then merged (Chan et al.), so
+// memory does not grow with the size of the files.
+
+typedef unsigned short region_label;
+
+typedef struct
+{
+  double count;
+  double mean_synthetic;
+  double mean_acquired;
+  double m2_synthetic;
+  double m2_acquired;
+  double comoment;
+} running_moments;
+
+typedef struct
+{
+  streamoff                first_voxel;
+  streamoff                last_voxel;
+  const float*             synthetic;
+  const float*             acquired;
+  const region_label*      labels;
+  vector<running_moments>* moments;
+} compare_job;
+
+void   accumulate     ( running_moments& moments, double synthetic, double acquired );
+void   clear_moments  ( running_moments& moments );
+void*  compare_thread ( void* argument );
+void   merge_moments  ( running_moments& total, const running_moments& part );
+string number_name    ( int number );
+void   print_moments  ( ostream& output, const string& volume, const string& region, const running_moments& moments );
+
+int main (int argc, char** argv)
+{
+  block_reader                      acquired_file;
+  block_reader                      labels_file;
+  block_reader                      synthetic_file;
+  char*                             raw_acquired;
+  char*                             raw_synthetic;
+  float*                            acquired;
+  float*                            synthetic;
+  int                               number_of_acquired_b0_volumes;
+  int                               number_of_directions;
+  int                               number_of_regions;
+  int                               number_of_slices;
+  int                               number_of_synthetic_b0_volumes;
+  int                               size_x;
+  int                               size_y;
+  int                               threads;
+  ofstream                          output_file;
+  pixel_type                        acquired_type;
+  pixel_type                        synthetic_type;
+  pthread_t*                        workers;
+  region_label*                     labels;
+  streamoff                         chunk_voxels;
+  streamoff                         memory_budget;
+  streamoff                         volume_voxels;
+  string                            acquired_file_name;
+  string                            labels_file_name;
+  string                            output_file_name;
+  string                            synthetic_file_name;
+  vector<compare_job>               jobs;
+  vector< vector<running_moments> > partial;
+  vector< vector<running_moments> > totals;  // per volume, per region
+
+  if ( argc < 12 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " synthetic_file_name acquired_file_name size_x size_y number_of_slices number_of_directions synthetic_b0_volumes acquired_b0_volumes synthetic_pixel_type acquired_pixel_type output_file_name [-labels mask_labels.raw] [-memory MB] [-byte_order little|big(of the acquired file)] [-direct]" << endl;
+      exit (1);
+    }
+
+  synthetic_file_name            =        argv[1];
+  acquired_file_name             =        argv[2];
+  size_x                         = atoi ( argv[3] );
+  size_y                         = atoi ( argv[4] );
+  number_of_slices               = atoi ( argv[5] );
+  number_of_directions           = atoi ( argv[6] );
+  number_of_synthetic_b0_volumes = atoi ( argv[7] );
+  number_of_acquired_b0_volumes  = atoi ( argv[8] );
+  synthetic_type                 = pixel_type_from_name ( argv[9] );
+  acquired_type                  = pixel_type_from_name ( argv[10] );
+  output_file_name               =        argv[11];
+  memory_budget                  = 64;
+  for ( int i = 12; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-labels" )
+	labels_file_name = argv[++i];
+      else if ( string ( argv[i] ) == "-memory" )
+	memory_budget = atoll ( argv[++i] );
+    }
+  memory_budget *= 1024 * 1024;
+  if ( synthetic_type == unknown_pixel || acquired_type == unknown_pixel )
+    {
+      cout << "ERROR: unknown pixel type." << endl;
+      exit (1);
+    }
+  volume_voxels = static_cast<streamoff> ( size_x ) * size_y * number_of_slices;
+
+  if ( ! synthetic_file.open ( synthetic_file_name, direct_requested ( argc, argv, 12 ) ) )
+    {
+      cout << "ERROR opening synthetic file." << endl;
+      exit (1);
+    }
+  if ( ! acquired_file.open ( acquired_file_name, direct_requested ( argc, argv, 12 ) ) )
+    {
+      cout << "ERROR opening acquired file." << endl;
+      exit (1);
+    }
+  if ( ! acquired_file.set_byte_order ( byte_order_requested ( argc, argv, 12 ), pixel_type_size ( acquired_type ) ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "synthetic file", synthetic_file.size (), volume_voxels * ( number_of_synthetic_b0_volumes + number_of_directions ) * pixel_type_size ( synthetic_type ) ) ||
+       ! check_size ( "acquired file", acquired_file.size (), volume_voxels * ( number_of_acquired_b0_volumes + number_of_directions ) * pixel_type_size ( acquired_type ) ) )
+    exit (1);
+
+  chunk_voxels = memory_budget / ( 2 * sizeof ( float ) + pixel_type_size ( synthetic_type ) + pixel_type_size ( acquired_type ) + sizeof ( region_label ) );
+  if ( chunk_voxels < BLOCK_IO_ALIGNMENT )
+    chunk_voxels = BLOCK_IO_ALIGNMENT;
+  if ( chunk_voxels > volume_voxels )
+    chunk_voxels = volume_voxels;
+  raw_synthetic = new char[chunk_voxels * pixel_type_size ( synthetic_type )];
+  raw_acquired  = new char[chunk_voxels * pixel_type_size ( acquired_type )];
+  synthetic     = new float[chunk_voxels];
+  acquired      = new float[chunk_voxels];
+  labels        = new region_label[chunk_voxels];
+
+  // the regions are the labels present in the labels file
+  number_of_regions = 1;
+  for ( streamoff i = 0; i < chunk_voxels; i++ )
+    labels[i] = 0;
+  if ( labels_file_name != "" )
+    {
+      if ( ! labels_file.open ( labels_file_name ) )
+	{
+	  cout << "ERROR opening labels file." << endl;
+	  exit (1);
+	}
+      if ( ! check_size ( "labels file", labels_file.size (), volume_voxels * sizeof ( region_label ) ) )
+	exit (1);
+      for ( streamoff done = 0; done < volume_voxels; done += chunk_voxels )
+	{
+	  streamoff length = volume_voxels - done < chunk_voxels ? volume_voxels - done : chunk_voxels;
+
+	  if ( ! labels_file.read_at ( reinterpret_cast<char*> ( labels ), length * sizeof ( region_label ), done * sizeof ( region_label ) ) )
+	    {
+	      cout << "ERROR reading labels file." << endl;
+	      exit (1);
+	    }
+	  for ( streamoff i = 0; i < length; i++ )
+	    if ( labels[i] >= number_of_regions )
+	      number_of_regions = labels[i] + 1;
+	}
+    }
+
+  threads = sysconf ( _SC_NPROCESSORS_ONLN );
+  if ( threads < 1 )
+    threads = 1;
+  workers = new pthread_t[threads];
+  jobs.resize ( threads );
+  partial.resize ( threads, vector<running_moments> ( number_of_regions ) );
+  totals.resize ( 1 + number_of_directions, vector<running_moments> ( number_of_regions ) );
+  for ( unsigned int v = 0; v < totals.size (); v++ )
+    for ( int r = 0; r < number_of_regions; r++ )
+      clear_moments ( totals[v][r] );
+
+  // volume 0 is the first b0 of each file, then the directions
+  for ( int v = 0; v <= number_of_directions; v++ )
+    {
+      streamoff synthetic_offset = v == 0 ? 0 : volume_voxels * ( number_of_synthetic_b0_volumes + v - 1 );
+      streamoff acquired_offset  = v == 0 ? 0 : volume_voxels * ( number_of_acquired_b0_volumes + v - 1 );
+
+      cout << "Comparing " << ( v == 0 ? string ( "b0" ) : "direction " + number_name ( v - 1 ) ) << "." << endl;
+      for ( streamoff done = 0; done < volume_voxels; done += chunk_voxels )
+	{
+	  streamoff length = volume_voxels - done < chunk_voxels ? volume_voxels - done : chunk_voxels;
+
+	  if ( ! synthetic_file.read_at ( raw_synthetic, length * pixel_type_size ( synthetic_type ), ( synthetic_offset + done ) * pixel_type_size ( synthetic_type ) ) ||
+	       ! acquired_file.read_at ( raw_acquired, length * pixel_type_size ( acquired_type ), ( acquired_offset + done ) * pixel_type_size ( acquired_type ) ) ||
+	       ( labels_file_name != "" && ! labels_file.read_at ( reinterpret_cast<char*> ( labels ), length * sizeof ( region_label ), done * sizeof ( region_label ) ) ) )
+	    {
+	      cout << "ERROR reading input files." << endl;
+	      exit (1);
+	    }
+	  convert_pixels ( raw_synthetic, synthetic_type, reinterpret_cast<char*> ( synthetic ), float32_pixel, length );
+	  convert_pixels ( raw_acquired, acquired_type, reinterpret_cast<char*> ( acquired ), float32_pixel, length );
+
+	  for ( int t = 0; t < threads; t++ )
+	    {
+	      for ( int r = 0; r < number_of_regions; r++ )
+		clear_moments ( partial[t][r] );
+	      jobs[t].first_voxel = length * t / threads;
+	      jobs[t].last_voxel  = length * ( t + 1 ) / threads;
+	      jobs[t].synthetic   = synthetic;
+	      jobs[t].acquired    = acquired;
+	      jobs[t].labels      = labels;
+	      jobs[t].moments     = &( partial[t] );
+	      if ( pthread_create ( &( workers[t] ), NULL, compare_thread, &( jobs[t] ) ) != 0 )
+		{
+		  cout << "ERROR creating thread." << endl;
+		  exit (1);
+		}
+	    }
+	  for ( int t = 0; t < threads; t++ )
+	    {
+	      pthread_join ( workers[t], NULL );
+	      for ( int r = 0; r < number_of_regions; r++ )
+		merge_moments ( totals[v][r], partial[t][r] );
+	    }
+	}
+    }
+  synthetic_file.close ();
+  acquired_file.close ();
+  labels_file.close ();
+
+  output_file.open ( output_file_name.c_str (), ios::out | ios::trunc );
+  if ( ! output_file )
+    {
+      cout << "ERROR opening output file." << endl;
+      exit (1);
+    }
+  output_file << "# volume region voxels mean_synthetic mean_acquired bias rmse correlation snr" << endl;
+  {
+    vector<running_moments> directions_by_region ( number_of_regions );
+    running_moments         all_directions;
+
+    clear_moments ( all_directions );
+    for ( int r = 0; r < number_of_regions; r++ )
+      clear_moments ( directions_by_region[r] );
+    for ( int v = 0; v <= number_of_directions; v++ )
+      {
+	string          volume = v == 0 ? string ( "b0" ) : number_name ( v - 1 );
+	running_moments all_regions;
+
+	clear_moments ( all_regions );
+	for ( int r = 0; r < number_of_regions; r++ )
+	  {
+	    merge_moments ( all_regions, totals[v][r] );
+	    if ( v > 0 )
+	      merge_moments ( directions_by_region[r], totals[v][r] );
+	    if ( totals[v][r].count > 0 && number_of_regions > 1 )
+	      print_moments ( output_file, volume, number_name ( r ), totals[v][r] );
+	  }
+	print_moments ( output_file, volume, "all", all_regions );
+	if ( v > 0 )
+	  merge_moments ( all_directions, all_regions );
+      }
+    for ( int r = 0; r < number_of_regions; r++ )
+      if ( directions_by_region[r].count > 0 && number_of_regions > 1 )
+	print_moments ( output_file, "directions", number_name ( r ), directions_by_region[r] );
+    print_moments ( output_file, "directions", "all", all_directions );
+    print_moments ( cout, "directions", "all", all_directions );
+  }
+  output_file.close ();
+  cout << "Wrote " << output_file_name << "." << endl;
+
+  delete[] workers;
+  delete[] labels;
+  delete[] acquired;
+  delete[] synthetic;
+  delete[] raw_acquired;
+  delete[] raw_synthetic;
+  return 0;
+}
+
+void* compare_thread ( void* argument )
+{
+  compare_job*             job = static_cast<compare_job*> ( argument );
+  vector<running_moments>& moments = *( job->moments );
+
+  for ( streamoff i = job->first_voxel; i < job->last_voxel; i++ )
+    accumulate ( moments[job->labels[i]], job->synthetic[i], job->acquired[i] );
+  return NULL;
+}
+
+void clear_moments ( running_moments& moments )
+{
+  moments.count          = 0;
+  moments.mean_synthetic = 0;
+  moments.mean_acquired  = 0;
+  moments.m2_synthetic   = 0;
+  moments.m2_acquired    = 0;
+  moments.comoment       = 0;
+}
+
+// one more pair of voxels, updating the means and the sums of squared
+// deviations without ever subtracting large sums
+void accumulate ( running_moments& moments, double synthetic, double acquired )
+{
+  double delta_synthetic;
+  double delta_acquired;
+
+  moments.count          += 1;
+  delta_synthetic         = synthetic - moments.mean_synthetic;
+  delta_acquired          = acquired - moments.mean_acquired;
+  moments.mean_synthetic += delta_synthetic / moments.count;
+  moments.mean_acquired  += delta_acquired / moments.count;
+  moments.m2_synthetic   += delta_synthetic * ( synthetic - moments.mean_synthetic );
+  moments.m2_acquired    += delta_acquired * ( acquired - moments.mean_acquired );
+  moments.comoment       += delta_synthetic * ( acquired - moments.mean_acquired );
+}
+
+void merge_moments ( running_moments& total, const running_moments& part )
+{
+  double count;
+  double delta_synthetic;
+  double delta_acquired;
+  double weight;
+
+  if ( part.count == 0 )
+    return;
+  if ( total.count == 0 )
+    {
+      total = part;
+      return;
+    }
+  count                 = total.count + part.count;
+  delta_synthetic       = part.mean_synthetic - total.mean_synthetic;
+  delta_acquired        = part.mean_acquired - total.mean_acquired;
+  weight                = total.count * part.count / count;
+  total.mean_synthetic += delta_synthetic * part.count / count;
+  total.mean_acquired  += delta_acquired * part.count / count;
+  total.m2_synthetic   += part.m2_synthetic + delta_synthetic * delta_synthetic * weight;
+  total.m2_acquired    += part.m2_acquired + delta_acquired * delta_acquired * weight;
+  total.comoment       += part.comoment + delta_synthetic * delta_acquired * weight;
+  total.count           = count;
+}
+
+void print_moments ( ostream& output, const string& volume, const string& region, const running_moments& moments )
+{
+  char   line[256];
+  double bias;
+  double correlation;
+  double deviation;
+  double rmse;
+  double snr;
+
+  bias        = moments.mean_synthetic - moments.mean_acquired;
+  deviation   = 0;
+  correlation = 0;
+  snr         = 0;
+  if ( moments.count > 0 )
+    {
+      deviation = ( moments.m2_synthetic + moments.m2_acquired - 2 * moments.comoment ) / moments.count;
+      deviation = deviation > 0 ? sqrt ( deviation ) : 0;
+    }
+  rmse = sqrt ( bias * bias + deviation * deviation );
+  if ( moments.m2_synthetic > 0 && moments.m2_acquired > 0 )
+    correlation = moments.comoment / sqrt ( moments.m2_synthetic * moments.m2_acquired );
+  if ( deviation > 0 )
+    snr = moments.mean_acquired / deviation;
+  snprintf ( line, sizeof ( line ), "%s %s %.0f %.6g %.6g %.6g %.6g %.6f %.6g", volume.c_str (), region.c_str (), moments.count,
+	     moments.mean_synthetic, moments.mean_acquired, bias, rmse, correlation, snr );
+  output << line << endl;
+}
+
+string number_name ( int number )
+{
+  stringstream name;
+
+  name << number;
+  return name.str ();
+}
@@ -16,4 +16,14 @@
 #
 # Author can be reached at rborges@if.usp.br
 
-g++ -Wall -o Bruker_split_b0_remainder.exe Bruker_split_b0_remainder.cpp
+g++ -Wall -O3 -o Bruker_split_b0_remainder.exe byte_order.cpp block_io.cpp pixel_conversion.cpp Bruker_split_b0_remainder.cpp
+g++ -Wall -o Bruker_split_b0_remainder_integer.exe byte_order.cpp block_io.cpp Bruker_split_b0_remainder_integer.cpp
+g++ -Wall -o split_b0_remainder.exe byte_order.cpp block_io.cpp split_b0_remainder.cpp
+g++ -Wall -o remove_trace.exe byte_order.cpp block_io.cpp remove_trace.cpp
+g++ -Wall -o split_raw_by_b-value.exe byte_order.cpp block_io.cpp block_queue.cpp split_raw_by_b-value.cpp -lpthread
+g++ -Wall -o append_b0_in_front.exe byte_order.cpp block_io.cpp append_b0_in_front.cxx
+g++ -Wall -o split_dwi.exe byte_order.cpp block_io.cpp par_index.cpp split_dwi.cpp
+g++ -Wall -o par_info.exe par_index.cpp par_info.cpp
+g++ -Wall -O2 -o raw_to_nifti.exe byte_order.cpp block_io.cpp pixel_conversion.cpp nifti_writer.cpp raw_to_nifti.cpp -lz -lpthread
+g++ -Wall -O3 -o fit_tensor.exe byte_order.cpp block_io.cpp pixel_conversion.cpp nifti_writer.cpp fit_tensor.cpp -lz -lpthread
+g++ -Wall -O3 -o compare_dwi.exe byte_order.cpp block_io.cpp pixel_conversion.cpp compare_dwi.cpp -lpthread
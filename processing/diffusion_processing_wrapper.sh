@@ -21,20 +21,26 @@
 usage=$(
 cat <<EOF 
 USAGE: $0 <PARAMETERS>
-PARAMETERS (all are obligatory):
-\t -b number_of_b_values
-\t -d number_of_directions (including trace, if any)
-\t -e experiment_name (equals directory name for files)
-\t -p pixel_size (in bytes)
-\t -s number_of_slices
-\t -t number_of_traces
-\t -x size_x_dimension (in pixels)
-\t -y size_y_dimension (in pixels)
-\t -z number_of_b0_components
+PARAMETERS:
+\t -b number_of_b_values (+)
+\t -d number_of_directions (including trace, if any) (+)
+\t -e experiment_name (equals directory name for files) (*)
+\t -p pixel_size (in bytes) (+)
+\t -r byte order of the .REC file (little or big, default little)
+\t -s number_of_slices (+)
+\t -t number_of_traces (+)
+\t -x size_x_dimension (in pixels) (+)
+\t -y size_y_dimension (in pixels) (+)
+\t -z number_of_b0_components (+)
+(*) Indicates an obligatory option.
+(+) Only needed to split without the .PAR: given all together, they
+    override the layout read from it.
 EOF
 )
 
-while getopts "b:d:e:p:s:t:x:y:z:" OPTION; do
+byte_order=little
+
+while getopts "b:d:e:p:r:s:t:x:y:z:" OPTION; do
     case $OPTION in
 	b) 
 	    number_of_b_values=$OPTARG
@@ -48,6 +54,9 @@ while getopts "b:d:e:p:s:t:x:y:z:" OPTION; do
 	p) 
 	    pixel_size=$OPTARG
 	    ;;
+	r)
+	    byte_order=$OPTARG
+	    ;;
 	s) 
 	    number_of_slices=$OPTARG
 	    ;;
@@ -71,39 +80,55 @@ while getopts "b:d:e:p:s:t:x:y:z:" OPTION; do
     esac
 done
 
+if [ -z "$experiment" ]; then
+    echo "Missing parameters."
+    echo -e "$usage"
+    exit 1
+fi
+
+manual_layout=yes
 if [ -z "$number_of_b_values" -o \
     -z "$number_of_directions" -o \
-    -z "$experiment" -o \
     -z "$pixel_size" -o \
     -z "$number_of_slices" -o \
     -z "$number_of_traces" -o \
     -z "$size_x_dimension" -o \
     -z "$size_y_dimension" -o \
     -z "$number_of_b0_components" ]; then
-    echo "Missing parameters."
-    echo -e "$usage"
-    exit 1
+    manual_layout=no
 fi
 
-refined_directions=$(($number_of_directions-$number_of_traces))
+voxel_size="1 1 1"
+if [ "$manual_layout" = "no" ]; then
+    par_info=`./par_info.exe $experiment/${experiment}_acquisition.par` || exit 1
+    echo "$par_info"
+    number_of_b_values=`echo "$par_info" | awk '/^b_values/ { print $2 }'`
+    number_of_slices=`echo "$par_info" | awk '/^slices/ { print $2 }'`
+    number_of_b0_components=`echo "$par_info" | awk '/^b0_components/ { print $2 }'`
+    pixel_size=`echo "$par_info" | awk '/^pixel_size/ { print $2 }'`
+    size_x_dimension=`echo "$par_info" | awk '/^size_x/ { print $2 }'`
+    size_y_dimension=`echo "$par_info" | awk '/^size_y/ { print $2 }'`
+    voxel_size=`echo "$par_info" | awk '/^voxel_size/ { print $2 " " $3 " " $4 }'`
+    refined_directions=`echo "$par_info" | awk '/^directions/ { print $2 }'`
+else
+    refined_directions=$(($number_of_directions-$number_of_traces))
+fi
 
 echo "Extracting gradient directions... "
 ./extract_gradient_directions_from_PAR.sh $experiment/${experiment}_acquisition.par $experiment/${experiment}_gradient_directions.dat
 echo "Done."
-echo "Spliting data in b0 and remainder... "
-./split_b0_remainder.exe $experiment/${experiment}_acquisition.rec $number_of_b_values $number_of_directions $number_of_slices $pixel_size $number_of_b0_components $size_x_dimension $size_y_dimension $experiment/${experiment}_b0.raw $experiment/${experiment}_b0_remainder.raw
-echo "Done."
-echo "Splitting remainder in trace(s) and remainder... " 
-./remove_trace.exe ${experiment}/${experiment}_b0_remainder.raw $number_of_b_values $number_of_directions $number_of_traces $number_of_slices $pixel_size $size_x_dimension $size_y_dimension ${experiment}/${experiment}_traces.raw ${experiment}/${experiment}_traces_remainder.raw
-echo "Done."
-echo "Splitting remainder in b-value files... "
-./split_raw_by_b-value.exe ${experiment}/${experiment}_traces_remainder.raw $number_of_b_values $refined_directions $number_of_slices $pixel_size $size_x_dimension $size_y_dimension ${experiment}/${experiment}_b_value_series-
-echo "Done."
-echo "Appending the b0 data as a prefix in each b-value file... "
-files=`ls -1 --color=never $experiment/${experiment}_b_value_series-*`
-for file in $files; do
-    file_name=`echo $file | sed 's/_b_value_series-\(.*\)/_b_value_series_result-\1/'`
-    ./append_b0_in_front.exe ${experiment}/${experiment}_b0.raw $file $file_name
+echo "Splitting data in b0, traces and b-value series, in a single pass... "
+if [ "$manual_layout" = "no" ]; then
+    ./split_dwi.exe -par $experiment/${experiment}_acquisition.par $experiment/${experiment}_acquisition.rec ${experiment}/${experiment}_traces.raw ${experiment}/${experiment}_b_value_series_result- -byte_order $byte_order || exit 1
+else
+    ./split_dwi.exe $experiment/${experiment}_acquisition.rec $number_of_b_values $number_of_directions $number_of_traces $number_of_slices $pixel_size $number_of_b0_components $size_x_dimension $size_y_dimension ${experiment}/${experiment}_traces.raw ${experiment}/${experiment}_b_value_series_result- -byte_order $byte_order || exit 1
+fi
+echo "Done. Final files have name prefix $experiment/${experiment}_b_value_series_result-."
+
+echo "Writing each series as NIfTI... "
+volumes=$(($number_of_b0_components+$refined_directions))
+for file in `ls -1 --color=never $experiment/${experiment}_b_value_series_result-*.raw`; do
+    ./raw_to_nifti.exe $file `echo $file | sed 's/\.raw$/.nii.gz/'` $size_x_dimension $size_y_dimension $number_of_slices $volumes $pixel_size -voxel_size $voxel_size || exit 1
 done
 echo "Done."
 
@@ -26,9 +26,6 @@ fi
 input_file_name=$1
 output_file_name=$2
 
-#grep -v "^#" $input_file_name | awk '{ print $46 " " $47 " " $48 }' | grep -v "^[[:space:]]*$" | uniq | grep -v "0.000 0.000 0.000" > /tmp/temp_file
-grep -v "^#" $input_file_name | awk '{ print $48 " " $46 " " $47 }' | grep -v "^[[:space:]]*$" | uniq | grep -v "0.000 0.000 0.000" > /tmp/temp_file
-number_of_lines=`wc -l /tmp/temp_file | cut -d" " -f 1`
-echo "$number_of_lines" > $output_file_name
-cat /tmp/temp_file >> $output_file_name
-rm /tmp/temp_file
+# par_info parses the image lines and writes one "rl ap fh" line per
+# gradient direction (PAR columns 48, 46 and 47), after their count.
+./par_info.exe $input_file_name -directions $output_file_name > /dev/null || exit 1
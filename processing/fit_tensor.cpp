@@ -0,0 +1,605 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "block_io.hpp"
+#include "nifti_writer.hpp"
+#include "pixel_conversion.hpp"
+
+using namespace std;
+
+// Fits a diffusion tensor to every voxel of a b-value series, laid out
+// as [b0 components][direction 0] ... [direction n-1], each a volume of
+// all slices, with the log-linear model
+//   ln S = ln S0 - b g'Dg
+// by least squares. The pseudo-inverse of the design matrix is computed
+// once; the ordinary fit is then the same matrix product for every
+// voxel, done over whole rows of voxels so that it vectorizes, and the
+// optional weighted fit (weights S^2 from the ordinary fit) solves one
+// small system per voxel. Slabs of slices are read in turn and their
+// voxels split between one thread per core.
+//
+// Outputs, as NIfTI: prefix_tensor (Dxx Dxy Dxz Dyy Dyz Dzz, in mm^2/s),
+// prefix_fa, prefix_md and prefix_v1 (principal eigenvector).
+
+#define TENSOR_UNKNOWNS 7
+
+typedef struct
+{
+  int           first_voxel;
+  int           last_voxel;
+  int           slab_voxels;
+  int           measurements;
+  bool          weighted;
+  double        threshold;
+  const double* design;          // measurements x TENSOR_UNKNOWNS
+  const float*  pseudo_inverse;  // TENSOR_UNKNOWNS x measurements
+  const float*  signal;          // measurements x slab_voxels
+  float*        log_signal;      // measurements x slab_voxels
+  float*        beta;            // TENSOR_UNKNOWNS x slab_voxels
+  float*        tensor;          // 6 x slab_voxels
+  float*        fa;
+  float*        md;
+  float*        v1;              // 3 x slab_voxels
+} fit_job;
+
+bool  invert_matrix         ( double* matrix, int size );
+bool  read_directions       ( const string& file_name, vector<double>& directions );
+void  eigen_symmetric_3x3   ( const double tensor[6], double values[3], double vectors[3][3] );
+void* fit_thread            ( void* argument );
+bool  write_nifti_volumes   ( const string& file_name, nifti_description description, const float* data );
+
+int main (int argc, char** argv)
+{
+  block_reader      input_file;
+  char*             raw;
+  double            b_value;
+  double            threshold;
+  double            voxel_size[3];
+  double*           design;
+  double*           normal;
+  float*            beta;
+  float*            fa;
+  float*            log_signal;
+  float*            md;
+  float*            pseudo_inverse;
+  float*            signal;
+  float*            tensor;
+  float*            v1;
+  int               measurements;
+  int               number_of_b0_components;
+  int               number_of_directions;
+  int               number_of_slices;
+  int               size_x;
+  int               size_y;
+  int               slab_depth;
+  int               threads;
+  bool              weighted;
+  nifti_description description;
+  pixel_type        type;
+  pthread_t*        workers;
+  streamoff         memory_budget;
+  streamoff         plane_voxels;
+  streamoff         volume_size;             // in bytes
+  string            directions_file_name;
+  string            input_file_name;
+  string            output_prefix;
+  vector<double>    directions;
+  vector<fit_job>   jobs;
+
+  if ( argc < 10 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name directions_file_name size_x size_y number_of_slices number_of_b0_components b_value(in s/mm^2) pixel_type output_prefix [-weighted] [-threshold b0_signal] [-memory MB] [-voxel_size x y z] [-byte_order little|big]" << endl;
+      exit (1);
+    }
+
+  input_file_name         =        argv[1];
+  directions_file_name    =        argv[2];
+  size_x                  = atoi ( argv[3] );
+  size_y                  = atoi ( argv[4] );
+  number_of_slices        = atoi ( argv[5] );
+  number_of_b0_components = atoi ( argv[6] );
+  b_value                 = atof ( argv[7] );
+  type                    = pixel_type_from_name ( argv[8] );
+  output_prefix           =        argv[9];
+  weighted                = false;
+  threshold               = 0;
+  memory_budget           = 256;
+  for ( int i = 0; i < 3; i++ )
+    voxel_size[i] = 1.0;
+  for ( int i = 10; i < argc; i++ )
+    {
+      if ( string ( argv[i] ) == "-weighted" )
+	weighted = true;
+      else if ( string ( argv[i] ) == "-threshold" && i + 1 < argc )
+	threshold = atof ( argv[++i] );
+      else if ( string ( argv[i] ) == "-memory" && i + 1 < argc )
+	memory_budget = atoll ( argv[++i] );
+      else if ( string ( argv[i] ) == "-voxel_size" && i + 3 < argc )
+	for ( int j = 0; j < 3; j++ )
+	  voxel_size[j] = atof ( argv[++i] );
+    }
+  memory_budget *= 1024 * 1024;
+  if ( type == unknown_pixel )
+    {
+      cout << "ERROR: unknown pixel type." << endl;
+      exit (1);
+    }
+  if ( ! read_directions ( directions_file_name, directions ) )
+    exit (1);
+  number_of_directions = directions.size () / 3;
+  measurements         = number_of_b0_components + number_of_directions;
+  plane_voxels         = static_cast<streamoff> ( size_x ) * size_y;
+  volume_size          = plane_voxels * number_of_slices * pixel_type_size ( type );
+
+  if ( ! input_file.open ( input_file_name ) )
+    {
+      cout << "ERROR opening input_file." << endl;
+      exit (1);
+    }
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 10 ), pixel_type_size ( type ) ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), volume_size * measurements ) )
+    exit (1);
+
+  // design matrix: ln S0, then Dxx Dyy Dzz Dxy Dxz Dyz
+  design = new double[measurements * TENSOR_UNKNOWNS];
+  memset ( design, 0, measurements * TENSOR_UNKNOWNS * sizeof ( double ) );
+  for ( int m = 0; m < measurements; m++ )
+    {
+      double* row = design + m * TENSOR_UNKNOWNS;
+      double  gx = 0, gy = 0, gz = 0, norm;
+
+      row[0] = 1;
+      if ( m < number_of_b0_components )
+	continue;
+      gx   = directions[3 * ( m - number_of_b0_components )];
+      gy   = directions[3 * ( m - number_of_b0_components ) + 1];
+      gz   = directions[3 * ( m - number_of_b0_components ) + 2];
+      norm = sqrt ( gx * gx + gy * gy + gz * gz );
+      if ( norm == 0 )
+	continue;
+      gx /= norm;
+      gy /= norm;
+      gz /= norm;
+      row[1] = -b_value * gx * gx;
+      row[2] = -b_value * gy * gy;
+      row[3] = -b_value * gz * gz;
+      row[4] = -2 * b_value * gx * gy;
+      row[5] = -2 * b_value * gx * gz;
+      row[6] = -2 * b_value * gy * gz;
+    }
+
+  // pseudo-inverse (X'X)^-1 X', once for all voxels
+  normal = new double[TENSOR_UNKNOWNS * TENSOR_UNKNOWNS];
+  for ( int i = 0; i < TENSOR_UNKNOWNS; i++ )
+    for ( int j = 0; j < TENSOR_UNKNOWNS; j++ )
+      {
+	normal[i * TENSOR_UNKNOWNS + j] = 0;
+	for ( int m = 0; m < measurements; m++ )
+	  normal[i * TENSOR_UNKNOWNS + j] += design[m * TENSOR_UNKNOWNS + i] * design[m * TENSOR_UNKNOWNS + j];
+      }
+  if ( ! invert_matrix ( normal, TENSOR_UNKNOWNS ) )
+    {
+      cout << "ERROR: the directions do not determine a tensor (at least 6 non-coplanar ones are needed)." << endl;
+      exit (1);
+    }
+  pseudo_inverse = new float[TENSOR_UNKNOWNS * measurements];
+  for ( int i = 0; i < TENSOR_UNKNOWNS; i++ )
+    for ( int m = 0; m < measurements; m++ )
+      {
+	double value = 0;
+
+	for ( int j = 0; j < TENSOR_UNKNOWNS; j++ )
+	  value += normal[i * TENSOR_UNKNOWNS + j] * design[m * TENSOR_UNKNOWNS + j];
+	pseudo_inverse[i * measurements + m] = value;
+      }
+
+  // whole outputs in memory, the input one slab at a time
+  tensor = new float[6 * plane_voxels * number_of_slices];
+  fa     = new float[plane_voxels * number_of_slices];
+  md     = new float[plane_voxels * number_of_slices];
+  v1     = new float[3 * plane_voxels * number_of_slices];
+  slab_depth = memory_budget / ( plane_voxels * ( measurements * ( 2 * sizeof ( float ) + pixel_type_size ( type ) ) + ( TENSOR_UNKNOWNS + 10 ) * sizeof ( float ) ) );
+  if ( slab_depth < 1 )
+    slab_depth = 1;
+  if ( slab_depth > number_of_slices )
+    slab_depth = number_of_slices;
+  raw        = new char[slab_depth * plane_voxels * pixel_type_size ( type )];
+  signal     = new float[measurements * slab_depth * plane_voxels];
+  log_signal = new float[measurements * slab_depth * plane_voxels];
+  beta       = new float[TENSOR_UNKNOWNS * slab_depth * plane_voxels];
+  float* slab_tensor = new float[6 * slab_depth * plane_voxels];
+  float* slab_v1     = new float[3 * slab_depth * plane_voxels];
+
+  threads = sysconf ( _SC_NPROCESSORS_ONLN );
+  if ( threads < 1 )
+    threads = 1;
+  workers = new pthread_t[threads];
+  jobs.resize ( threads );
+
+  for ( int z_begin = 0; z_begin < number_of_slices; z_begin += slab_depth )
+    {
+      int depth       = number_of_slices - z_begin < slab_depth ? number_of_slices - z_begin : slab_depth;
+      int slab_voxels = depth * plane_voxels;
+
+      cout << "Fitting slices " << z_begin << " to " << z_begin + depth - 1 << " of " << number_of_slices << "." << endl;
+      for ( int m = 0; m < measurements; m++ )
+	{
+	  if ( ! input_file.read_at ( raw, static_cast<streamoff> ( slab_voxels ) * pixel_type_size ( type ),
+				      m * volume_size + z_begin * plane_voxels * pixel_type_size ( type ) ) )
+	    {
+	      cout << "ERROR reading input_file." << endl;
+	      exit (1);
+	    }
+	  convert_pixels ( raw, type, reinterpret_cast<char*> ( signal + static_cast<streamoff> ( m ) * slab_voxels ), float32_pixel, slab_voxels );
+	}
+
+      for ( int t = 0; t < threads; t++ )
+	{
+	  jobs[t].first_voxel    = static_cast<streamoff> ( slab_voxels ) * t / threads;
+	  jobs[t].last_voxel     = static_cast<streamoff> ( slab_voxels ) * ( t + 1 ) / threads;
+	  jobs[t].slab_voxels    = slab_voxels;
+	  jobs[t].measurements   = measurements;
+	  jobs[t].weighted       = weighted;
+	  jobs[t].threshold      = threshold;
+	  jobs[t].design         = design;
+	  jobs[t].pseudo_inverse = pseudo_inverse;
+	  jobs[t].signal         = signal;
+	  jobs[t].log_signal     = log_signal;
+	  jobs[t].beta           = beta;
+	  jobs[t].tensor         = slab_tensor;
+	  jobs[t].fa             = fa + static_cast<streamoff> ( z_begin ) * plane_voxels;
+	  jobs[t].md             = md + static_cast<streamoff> ( z_begin ) * plane_voxels;
+	  jobs[t].v1             = slab_v1;
+	  if ( pthread_create ( &( workers[t] ), NULL, fit_thread, &( jobs[t] ) ) != 0 )
+	    {
+	      cout << "ERROR creating thread." << endl;
+	      exit (1);
+	    }
+	}
+      for ( int t = 0; t < threads; t++ )
+	pthread_join ( workers[t], NULL );
+
+      // component-major slabs go to their place in each output volume
+      for ( int c = 0; c < 6; c++ )
+	memcpy ( tensor + ( c * number_of_slices + z_begin ) * plane_voxels, slab_tensor + c * slab_voxels, slab_voxels * sizeof ( float ) );
+      for ( int c = 0; c < 3; c++ )
+	memcpy ( v1 + ( c * number_of_slices + z_begin ) * plane_voxels, slab_v1 + c * slab_voxels, slab_voxels * sizeof ( float ) );
+    }
+  input_file.close ();
+
+  description.size_x  = size_x;
+  description.size_y  = size_y;
+  description.size_z  = number_of_slices;
+  description.type    = float32_pixel;
+  for ( int i = 0; i < 3; i++ )
+    description.voxel_size[i] = voxel_size[i];
+  description.volumes = 6;
+  if ( ! write_nifti_volumes ( output_prefix + "_tensor.nii.gz", description, tensor ) )
+    exit (1);
+  description.volumes = 3;
+  if ( ! write_nifti_volumes ( output_prefix + "_v1.nii.gz", description, v1 ) )
+    exit (1);
+  description.volumes = 1;
+  if ( ! write_nifti_volumes ( output_prefix + "_fa.nii.gz", description, fa ) || ! write_nifti_volumes ( output_prefix + "_md.nii.gz", description, md ) )
+    exit (1);
+
+  delete[] workers;
+  delete[] slab_v1;
+  delete[] slab_tensor;
+  delete[] beta;
+  delete[] log_signal;
+  delete[] signal;
+  delete[] raw;
+  delete[] v1;
+  delete[] md;
+  delete[] fa;
+  delete[] tensor;
+  delete[] pseudo_inverse;
+  delete[] normal;
+  delete[] design;
+  return 0;
+}
+
+void* fit_thread ( void* argument )
+{
+  fit_job*     job = static_cast<fit_job*> ( argument );
+  const int    n = job->slab_voxels;
+  const int    first = job->first_voxel;
+  const int    last = job->last_voxel;
+  double       a[TENSOR_UNKNOWNS * TENSOR_UNKNOWNS];
+  double       rhs[TENSOR_UNKNOWNS];
+  double       d[6];
+  double       values[3];
+  double       vectors[3][3];
+  double       s0;
+  double       trace;
+  double       norm;
+
+  // logarithm of the signal; non-positive signal is taken as 1
+  for ( int m = 0; m < job->measurements; m++ )
+    {
+      const float* in  = job->signal + static_cast<streamoff> ( m ) * n;
+      float*       out = job->log_signal + static_cast<streamoff> ( m ) * n;
+
+      for ( int v = first; v < last; v++ )
+	out[v] = logf ( in[v] > 1.0f ? in[v] : 1.0f );
+    }
+
+  // ordinary least squares: beta = P ln S, for a row of voxels at a time
+  for ( int p = 0; p < TENSOR_UNKNOWNS; p++ )
+    {
+      float* out = job->beta + static_cast<streamoff> ( p ) * n;
+
+      for ( int v = first; v < last; v++ )
+	out[v] = 0;
+      for ( int m = 0; m < job->measurements; m++ )
+	{
+	  const float  coefficient = job->pseudo_inverse[p * job->measurements + m];
+	  const float* in          = job->log_signal + static_cast<streamoff> ( m ) * n;
+
+	  for ( int v = first; v < last; v++ )
+	    out[v] += coefficient * in[v];
+	}
+    }
+
+  for ( int v = first; v < last; v++ )
+    {
+      double beta[TENSOR_UNKNOWNS];
+
+      for ( int p = 0; p < TENSOR_UNKNOWNS; p++ )
+	beta[p] = job->beta[static_cast<streamoff> ( p ) * n + v];
+      s0 = job->signal[v];
+      if ( s0 <= job->threshold )
+	{
+	  for ( int c = 0; c < 6; c++ )
+	    job->tensor[static_cast<streamoff> ( c ) * n + v] = 0;
+	  for ( int c = 0; c < 3; c++ )
+	    job->v1[static_cast<streamoff> ( c ) * n + v] = 0;
+	  job->fa[v] = 0;
+	  job->md[v] = 0;
+	  continue;
+	}
+
+      // weighted least squares, weights from the ordinary fit
+      if ( job->weighted )
+	{
+	  memset ( a, 0, sizeof ( a ) );
+	  memset ( rhs, 0, sizeof ( rhs ) );
+	  for ( int m = 0; m < job->measurements; m++ )
+	    {
+	      const double* row = job->design + m * TENSOR_UNKNOWNS;
+	      double        predicted = 0;
+	      double        weight;
+
+	      for ( int p = 0; p < TENSOR_UNKNOWNS; p++ )
+		predicted += row[p] * beta[p];
+	      weight = exp ( 2 * predicted );
+	      for ( int i = 0; i < TENSOR_UNKNOWNS; i++ )
+		{
+		  rhs[i] += weight * row[i] * job->log_signal[static_cast<streamoff> ( m ) * n + v];
+		  for ( int j = 0; j < TENSOR_UNKNOWNS; j++ )
+		    a[i * TENSOR_UNKNOWNS + j] += weight * row[i] * row[j];
+		}
+	    }
+	  if ( invert_matrix ( a, TENSOR_UNKNOWNS ) )
+	    for ( int i = 0; i < TENSOR_UNKNOWNS; i++ )
+	      {
+		beta[i] = 0;
+		for ( int j = 0; j < TENSOR_UNKNOWNS; j++ )
+		  beta[i] += a[i * TENSOR_UNKNOWNS + j] * rhs[j];
+	      }
+	}
+
+      // Dxx Dxy Dxz Dyy Dyz Dzz
+      d[0] = beta[1];
+      d[1] = beta[4];
+      d[2] = beta[5];
+      d[3] = beta[2];
+      d[4] = beta[6];
+      d[5] = beta[3];
+      for ( int c = 0; c < 6; c++ )
+	job->tensor[static_cast<streamoff> ( c ) * n + v] = d[c];
+      eigen_symmetric_3x3 ( d, values, vectors );
+      trace = values[0] + values[1] + values[2];
+      norm  = values[0] * values[0] + values[1] * values[1] + values[2] * values[2];
+      job->md[v] = trace / 3;
+      job->fa[v] = 0;
+      if ( norm > 0 )
+	job->fa[v] = sqrt ( 0.5 * ( ( values[0] - values[1] ) * ( values[0] - values[1] ) +
+				    ( values[1] - values[2] ) * ( values[1] - values[2] ) +
+				    ( values[2] - values[0] ) * ( values[2] - values[0] ) ) / norm );
+      for ( int c = 0; c < 3; c++ )
+	job->v1[static_cast<streamoff> ( c ) * n + v] = vectors[0][c];
+    }
+  return NULL;
+}
+
+// Gauss-Jordan with partial pivoting, in place
+bool invert_matrix ( double* matrix, int size )
+{
+  vector<double> inverse ( size * size, 0.0 );
+  double         pivot_value;
+  double         factor;
+  int            pivot;
+
+  for ( int i = 0; i < size; i++ )
+    inverse[i * size + i] = 1;
+  for ( int column = 0; column < size; column++ )
+    {
+      pivot = column;
+      for ( int row = column + 1; row < size; row++ )
+	if ( fabs ( matrix[row * size + column] ) > fabs ( matrix[pivot * size + column] ) )
+	  pivot = row;
+      if ( fabs ( matrix[pivot * size + column] ) < 1e-300 )
+	return false;
+      for ( int k = 0; k < size; k++ )
+	{
+	  swap ( matrix[pivot * size + k], matrix[column * size + k] );
+	  swap ( inverse[pivot * size + k], inverse[column * size + k] );
+	}
+      pivot_value = matrix[column * size + column];
+      for ( int k = 0; k < size; k++ )
+	{
+	  matrix[column * size + k]  /= pivot_value;
+	  inverse[column * size + k] /= pivot_value;
+	}
+      for ( int row = 0; row < size; row++ )
+	{
+	  if ( row == column )
+	    continue;
+	  factor = matrix[row * size + column];
+	  for ( int k = 0; k < size; k++ )
+	    {
+	      matrix[row * size + k]  -= factor * matrix[column * size + k];
+	      inverse[row * size + k] -= factor * inverse[column * size + k];
+	    }
+	}
+    }
+  memcpy ( matrix, &( inverse[0] ), size * size * sizeof ( double ) );
+  return true;
+}
+
+// Jacobi rotations; values sorted in decreasing order, vectors[i] is
+// the unit eigenvector of values[i].
+void eigen_symmetric_3x3 ( const double tensor[6], double values[3], double vectors[3][3] )
+{
+  double a[3][3] = { { tensor[0], tensor[1], tensor[2] },
+		     { tensor[1], tensor[3], tensor[4] },
+		     { tensor[2], tensor[4], tensor[5] } };
+  double v[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+  double off;
+  double theta;
+  double t;
+  double c;
+  double s;
+  int    order[3] = { 0, 1, 2 };
+
+  for ( int sweep = 0; sweep < 50; sweep++ )
+    {
+      off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+      if ( off < 1e-30 * ( a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2] ) || off == 0 )
+	break;
+      for ( int p = 0; p < 2; p++ )
+	for ( int q = p + 1; q < 3; q++ )
+	  {
+	    if ( a[p][q] == 0 )
+	      continue;
+	    theta = ( a[q][q] - a[p][p] ) / ( 2 * a[p][q] );
+	    t     = ( theta >= 0 ? 1 : -1 ) / ( fabs ( theta ) + sqrt ( theta * theta + 1 ) );
+	    c     = 1 / sqrt ( t * t + 1 );
+	    s     = t * c;
+	    for ( int k = 0; k < 3; k++ )
+	      {
+		double akp = a[k][p];
+		double akq = a[k][q];
+		a[k][p] = c * akp - s * akq;
+		a[k][q] = s * akp + c * akq;
+	      }
+	    for ( int k = 0; k < 3; k++ )
+	      {
+		double apk = a[p][k];
+		double aqk = a[q][k];
+		a[p][k] = c * apk - s * aqk;
+		a[q][k] = s * apk + c * aqk;
+	      }
+	    for ( int k = 0; k < 3; k++ )
+	      {
+		double vkp = v[k][p];
+		double vkq = v[k][q];
+		v[k][p] = c * vkp - s * vkq;
+		v[k][q] = s * vkp + c * vkq;
+	      }
+	  }
+    }
+  for ( int i = 0; i < 2; i++ )
+    for ( int j = i + 1; j < 3; j++ )
+      if ( a[order[j]][order[j]] > a[order[i]][order[i]] )
+	swap ( order[i], order[j] );
+  for ( int i = 0; i < 3; i++ )
+    {
+      values[i] = a[order[i]][order[i]];
+      for ( int k = 0; k < 3; k++ )
+	vectors[i][k] = v[k][order[i]];
+    }
+}
+
+// Either "count" followed by count lines "x y z" (gradient_directions.dat)
+// or only the "x y z" lines (directions.txt).
+bool read_directions ( const string& file_name, vector<double>& directions )
+{
+  ifstream       file;
+  string         line;
+  vector<double> values;
+  double         value;
+
+  file.open ( file_name.c_str () );
+  if ( ! file )
+    {
+      cout << "ERROR opening " << file_name << "." << endl;
+      return false;
+    }
+  directions.clear ();
+  while ( getline ( file, line ) )
+    {
+      istringstream fields ( line );
+
+      values.clear ();
+      while ( fields >> value )
+	values.push_back ( value );
+      if ( values.size () == 3 )
+	directions.insert ( directions.end (), values.begin (), values.end () );
+    }
+  if ( directions.empty () )
+    {
+      cout << "ERROR: no directions in " << file_name << "." << endl;
+      return false;
+    }
+  return true;
+}
+
+bool write_nifti_volumes ( const string& file_name, nifti_description description, const float* data )
+{
+  nifti_writer output;
+
+  if ( ! output.open ( file_name, description )
+       || ! output.write ( reinterpret_cast<const char*> ( data ), static_cast<streamoff> ( description.size_x ) * description.size_y * description.size_z * description.volumes * sizeof ( float ) )
+       || ! output.close () )
+    {
+      cout << "ERROR writing " << file_name << "." << endl;
+      return false;
+    }
+  cout << "Wrote " << file_name << "." << endl;
+  return true;
+}
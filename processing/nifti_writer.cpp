@@ -0,0 +1,192 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "nifti_writer.hpp"
+
+using namespace std;
+
+// catches a compiler that pads the header
+typedef char nifti_header_size_check[sizeof ( nifti_1_header ) == 348 ? 1 : -1];
+
+#define NIFTI_VOX_OFFSET 352
+
+static const short nifti_datatypes[] = { 256, 2, 4, 512, 8, 768, 16 };
+
+typedef struct
+{
+  const char*    input;
+  std::streamoff input_length;
+  int            level;
+  char*          output;
+  std::streamoff output_length;
+  bool           ok;
+} gzip_job;
+
+static void* gzip_thread ( void* argument )
+{
+  gzip_job* job = static_cast<gzip_job*> ( argument );
+  z_stream  stream;
+
+  // each chunk is a complete gzip member (windowBits + 16)
+  memset ( &stream, 0, sizeof ( stream ) );
+  job->ok     = false;
+  job->output = NULL;
+  if ( deflateInit2 ( &stream, job->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    return NULL;
+  job->output_length = deflateBound ( &stream, job->input_length );
+  job->output        = new char[job->output_length];
+  stream.next_in     = reinterpret_cast<Bytef*> ( const_cast<char*> ( job->input ) );
+  stream.avail_in    = job->input_length;
+  stream.next_out    = reinterpret_cast<Bytef*> ( job->output );
+  stream.avail_out   = job->output_length;
+  job->ok            = deflate ( &stream, Z_FINISH ) == Z_STREAM_END;
+  job->output_length = stream.total_out;
+  deflateEnd ( &stream );
+  return NULL;
+}
+
+nifti_writer::nifti_writer ()
+{
+  compressed = false;
+  level      = 6;
+  threads    = 1;
+  last_fill  = 0;
+}
+
+nifti_writer::~nifti_writer ()
+{
+  for ( unsigned int i = 0; i < chunks.size (); i++ )
+    delete[] chunks[i];
+}
+
+bool nifti_writer::open ( const string& file_name, const nifti_description& description, int compression_level )
+{
+  nifti_1_header header;
+  char           extension[4] = { 0, 0, 0, 0 };
+  streamoff      data_size;
+
+  compressed = file_name.size () > 3 && file_name.compare ( file_name.size () - 3, 3, ".gz" ) == 0;
+  level      = compression_level;
+  threads    = sysconf ( _SC_NPROCESSORS_ONLN );
+  if ( threads < 1 )
+    threads = 1;
+
+  memset ( &header, 0, sizeof ( header ) );
+  header.sizeof_hdr = sizeof ( header );
+  header.regular    = 'r';
+  header.dim[0]     = description.volumes > 1 ? 4 : 3;
+  header.dim[1]     = description.size_x;
+  header.dim[2]     = description.size_y;
+  header.dim[3]     = description.size_z;
+  header.dim[4]     = description.volumes;
+  for ( int i = 5; i < 8; i++ )
+    header.dim[i] = 1;
+  header.datatype   = nifti_datatypes[description.type];
+  header.bitpix     = 8 * pixel_type_size ( description.type );
+  header.pixdim[0]  = 1;
+  for ( int i = 0; i < 3; i++ )
+    header.pixdim[i + 1] = description.voxel_size[i];
+  header.pixdim[4]  = 1;
+  header.vox_offset = NIFTI_VOX_OFFSET;
+  header.xyzt_units = 2 | 8; // mm and seconds
+  strncpy ( header.descrip, "diffusim", sizeof ( header.descrip ) );
+  // voxel indices scaled by the voxel size, no rotation
+  header.qform_code = 1;
+  header.sform_code = 1;
+  header.srow_x[0]  = description.voxel_size[0];
+  header.srow_y[1]  = description.voxel_size[1];
+  header.srow_z[2]  = description.voxel_size[2];
+  memcpy ( header.magic, "n+1", 4 );
+
+  data_size = NIFTI_VOX_OFFSET + static_cast<streamoff> ( description.size_x ) * description.size_y * description.size_z * description.volumes * pixel_type_size ( description.type );
+  if ( ! output.open ( file_name, false, compressed ? -1 : data_size ) )
+    return false;
+  return write ( reinterpret_cast<char*> ( &header ), sizeof ( header ) ) && write ( extension, sizeof ( extension ) );
+}
+
+bool nifti_writer::write ( const char* data, streamoff length )
+{
+  streamoff room;
+
+  if ( ! compressed )
+    return output.write ( data, length );
+  while ( length > 0 )
+    {
+      if ( chunks.empty () || last_fill == NIFTI_GZIP_CHUNK )
+	{
+	  if ( static_cast<int> ( chunks.size () ) == threads && ! compress_chunks () )
+	    return false;
+	  chunks.push_back ( new char[NIFTI_GZIP_CHUNK] );
+	  last_fill = 0;
+	}
+      room = NIFTI_GZIP_CHUNK - last_fill;
+      if ( room > length )
+	room = length;
+      memcpy ( chunks.back () + last_fill, data, room );
+      last_fill += room;
+      data      += room;
+      length    -= room;
+    }
+  return true;
+}
+
+// compresses the pending chunks, one thread each, and writes them in order
+bool nifti_writer::compress_chunks ( void )
+{
+  vector<gzip_job>  jobs ( chunks.size () );
+  vector<pthread_t> workers ( chunks.size () );
+  vector<bool>      started ( chunks.size () );
+  bool              ok = true;
+
+  for ( unsigned int i = 0; i < chunks.size (); i++ )
+    {
+      jobs[i].input        = chunks[i];
+      jobs[i].input_length = i + 1 == chunks.size () ? last_fill : NIFTI_GZIP_CHUNK;
+      jobs[i].level        = level;
+      started[i] = pthread_create ( &( workers[i] ), NULL, gzip_thread, &( jobs[i] ) ) == 0;
+      // without a thread, compress it here
+      if ( ! started[i] )
+	gzip_thread ( &( jobs[i] ) );
+    }
+  for ( unsigned int i = 0; i < chunks.size (); i++ )
+    {
+      if ( started[i] )
+	pthread_join ( workers[i], NULL );
+      ok = ok && jobs[i].ok && output.write ( jobs[i].output, jobs[i].output_length );
+      delete[] jobs[i].output;
+      delete[] chunks[i];
+    }
+  chunks.clear ();
+  last_fill = 0;
+  return ok;
+}
+
+bool nifti_writer::close ( void )
+{
+  bool ok = true;
+
+  if ( compressed && ! chunks.empty () )
+    ok = compress_chunks ();
+  return output.close () && ok;
+}
@@ -0,0 +1,114 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef NIFTI_WRITER
+#define NIFTI_WRITER
+
+#include <ios>
+#include <string>
+#include <vector>
+
+#include "block_io.hpp"
+#include "pixel_conversion.hpp"
+
+// The NIfTI-1 header, as in nifti1.h: 348 bytes, followed in a .nii by
+// 4 bytes of extension flags and the voxels from byte 352 on.
+typedef struct
+{
+  int   sizeof_hdr;
+  char  data_type[10];
+  char  db_name[18];
+  int   extents;
+  short session_error;
+  char  regular;
+  char  dim_info;
+  short dim[8];
+  float intent_p1;
+  float intent_p2;
+  float intent_p3;
+  short intent_code;
+  short datatype;
+  short bitpix;
+  short slice_start;
+  float pixdim[8];
+  float vox_offset;
+  float scl_slope;
+  float scl_inter;
+  short slice_end;
+  char  slice_code;
+  char  xyzt_units;
+  float cal_max;
+  float cal_min;
+  float slice_duration;
+  float toffset;
+  int   glmax;
+  int   glmin;
+  char  descrip[80];
+  char  aux_file[24];
+  short qform_code;
+  short sform_code;
+  float quatern_b;
+  float quatern_c;
+  float quatern_d;
+  float qoffset_x;
+  float qoffset_y;
+  float qoffset_z;
+  float srow_x[4];
+  float srow_y[4];
+  float srow_z[4];
+  char  intent_name[16];
+  char  magic[4];
+} nifti_1_header;
+
+typedef struct
+{
+  int        size_x;        // in voxels
+  int        size_y;
+  int        size_z;
+  int        volumes;
+  double     voxel_size[3]; // in mm
+  pixel_type type;
+} nifti_description;
+
+// Writes a .nii, or a .nii.gz when the name ends in .gz. Voxels are
+// given in file order (x fastest, then y, z and volume) through any
+// number of write () calls. A .nii.gz is a series of gzip members of
+// NIFTI_GZIP_CHUNK bytes each, compressed by as many threads as there
+// are cores; gzip readers take the members as one stream.
+#define NIFTI_GZIP_CHUNK ( 4 * 1024 * 1024 )
+
+class nifti_writer
+{
+ public:
+  nifti_writer  ();
+  ~nifti_writer ();
+  bool open  ( const std::string& file_name, const nifti_description& description, int level = 6 );
+  bool write ( const char* data, std::streamoff length );
+  bool close ( void );
+ private:
+  block_writer       output;
+  bool               compressed;
+  int                level;
+  int                threads;
+  std::vector<char*> chunks;
+  std::streamoff     last_fill;
+  bool               compress_chunks ( void );
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include "par_index.hpp"
+
+using namespace std;
+
+#define PAR_IMAGE_COLUMNS 48
+
+static bool by_index_in_rec ( const par_image& a, const par_image& b )
+{
+  return a.index_in_rec < b.index_in_rec;
+}
+
+// position of value in a sorted vector of distinct values
+template <typename value_t> static int rank_of ( const vector<value_t>& values, const value_t& value )
+{
+  return lower_bound ( values.begin (), values.end (), value ) - values.begin ();
+}
+
+// position of value in a vector kept in order of first appearance
+template <typename value_t> static int appearance_of ( vector<value_t>& values, const value_t& value )
+{
+  typename vector<value_t>::iterator found = find ( values.begin (), values.end (), value );
+
+  if ( found != values.end () )
+    return found - values.begin ();
+  values.push_back ( value );
+  return values.size () - 1;
+}
+
+bool par_index::read ( const string& par_file_name )
+{
+  double                      value;
+  ifstream                    par_file;
+  par_image                   image;
+  streamoff                   offset;
+  streamoff                   expected_images;
+  string                      line;
+  vector<double>              columns;
+  vector<int>                 slices;
+  vector<int>                 direction_keys;
+  vector<int>                 trace_keys;
+  vector<par_image>           all_images;
+  vector< pair<double, int> > b_values;
+  vector< pair<int, int> >    b0_keys;
+
+  par_file.open ( par_file_name.c_str () );
+  if ( ! par_file )
+    {
+      cout << "ERROR opening " << par_file_name << "." << endl;
+      return false;
+    }
+
+  // the image lines are the ones made only of numbers
+  while ( getline ( par_file, line ) )
+    {
+      if ( line.empty () || line[0] == '#' || line[0] == '.' )
+	continue;
+      istringstream fields ( line );
+      columns.clear ();
+      while ( fields >> value )
+	columns.push_back ( value );
+      if ( columns.size () < PAR_IMAGE_COLUMNS || ! fields.eof () )
+	continue;
+      image.slice           = static_cast<int> ( columns[0] );
+      image.image_type      = static_cast<int> ( columns[4] );
+      image.index_in_rec    = static_cast<int> ( columns[6] );
+      image.pixel_bits      = static_cast<int> ( columns[7] );
+      image.size_x          = static_cast<int> ( columns[9] );
+      image.size_y          = static_cast<int> ( columns[10] );
+      image.thickness       = columns[22];
+      image.gap             = columns[23];
+      image.spacing_x       = columns[28];
+      image.spacing_y       = columns[29];
+      image.b_factor        = columns[33];
+      image.b_number        = static_cast<int> ( columns[41] );
+      image.gradient_number = static_cast<int> ( columns[42] );
+      image.ap              = columns[45];
+      image.fh              = columns[46];
+      image.rl              = columns[47];
+      image.size            = static_cast<streamoff> ( image.size_x ) * image.size_y * image.pixel_bits / 8;
+      all_images.push_back ( image );
+    }
+  par_file.close ();
+  if ( all_images.empty () )
+    {
+      cout << "ERROR: no image lines in " << par_file_name << "." << endl;
+      return false;
+    }
+
+  // images are stored in the .REC in the order of their index
+  sort ( all_images.begin (), all_images.end (), by_index_in_rec );
+  offset = 0;
+  for ( unsigned int i = 0; i < all_images.size (); i++ )
+    {
+      all_images[i].offset = offset;
+      offset += all_images[i].size;
+    }
+  rec_size = offset;
+
+  images.clear ();
+  for ( unsigned int i = 0; i < all_images.size (); i++ )
+    if ( all_images[i].image_type == 0 )
+      images.push_back ( all_images[i] );
+  if ( images.empty () )
+    {
+      cout << "ERROR: no magnitude images in " << par_file_name << "." << endl;
+      return false;
+    }
+  size_x     = images[0].size_x;
+  size_y     = images[0].size_y;
+  pixel_size = images[0].pixel_bits / 8;
+  voxel_size[0] = images[0].spacing_x;
+  voxel_size[1] = images[0].spacing_y;
+  voxel_size[2] = images[0].thickness + images[0].gap;
+
+  // classify the images and collect the distinct keys
+  directions.clear ();
+  for ( unsigned int i = 0; i < images.size (); i++ )
+    {
+      par_image& current = images[i];
+
+      if ( current.size_x != size_x || current.size_y != size_y || current.pixel_bits / 8 != pixel_size )
+	{
+	  cout << "ERROR: images of different sizes in " << par_file_name << "." << endl;
+	  return false;
+	}
+      slices.push_back ( current.slice );
+      if ( current.b_factor == 0 )
+	{
+	  current.image_class = b0_image;
+	  current.component   = appearance_of ( b0_keys, make_pair ( current.b_number, current.gradient_number ) );
+	  continue;
+	}
+      b_values.push_back ( make_pair ( current.b_factor, current.b_number ) );
+      if ( current.ap == 0 && current.fh == 0 && current.rl == 0 )
+	{
+	  current.image_class = trace_image;
+	  current.component   = appearance_of ( trace_keys, current.gradient_number );
+	}
+      else
+	{
+	  current.image_class = direction_image;
+	  current.component   = appearance_of ( direction_keys, current.gradient_number );
+	  if ( current.component == static_cast<int> ( directions.size () ) )
+	    {
+	      par_direction direction = { current.rl, current.ap, current.fh };
+	      directions.push_back ( direction );
+	    }
+	}
+    }
+  sort ( slices.begin (), slices.end () );
+  slices.erase ( unique ( slices.begin (), slices.end () ), slices.end () );
+  sort ( b_values.begin (), b_values.end () );
+  b_values.erase ( unique ( b_values.begin (), b_values.end () ), b_values.end () );
+  for ( unsigned int i = 0; i < images.size (); i++ )
+    {
+      images[i].slice_rank = rank_of ( slices, images[i].slice );
+      images[i].b_rank     = 0;
+      if ( images[i].image_class != b0_image )
+	images[i].b_rank = rank_of ( b_values, make_pair ( images[i].b_factor, images[i].b_number ) );
+    }
+  number_of_slices        = slices.size ();
+  number_of_b_values      = b_values.size ();
+  number_of_directions    = direction_keys.size ();
+  number_of_traces        = trace_keys.size ();
+  number_of_b0_components = b0_keys.size ();
+
+  // every combination must be there, once
+  expected_images = static_cast<streamoff> ( number_of_slices ) * ( number_of_b0_components + number_of_b_values * ( number_of_directions + number_of_traces ) );
+  if ( static_cast<streamoff> ( images.size () ) != expected_images )
+    {
+      cout << "ERROR: " << par_file_name << " has " << images.size () << " magnitude images, expected " << expected_images << "." << endl;
+      return false;
+    }
+  return true;
+}
+
+streamoff par_index::volume_size ( void )
+{
+  return static_cast<streamoff> ( number_of_slices ) * size_x * size_y * pixel_size;
+}
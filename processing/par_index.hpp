@@ -0,0 +1,90 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef PAR_INDEX
+#define PAR_INDEX
+
+#include <ios>
+#include <string>
+#include <vector>
+
+enum par_image_class { b0_image = 0,
+		       direction_image,
+		       trace_image };
+
+// One line of the image information of a PAR (v4.x) file, with where
+// the image is in the .REC and where it belongs in the dataset.
+typedef struct
+{
+  int             slice;           // column 1
+  int             image_type;      // column 5: 0 magnitude, 1 real, 2 imaginary, 3 phase
+  int             index_in_rec;    // column 7
+  int             pixel_bits;      // column 8
+  int             size_x;          // column 10
+  int             size_y;          // column 11
+  double          thickness;       // column 23, in mm
+  double          gap;             // column 24, in mm
+  double          spacing_x;       // column 29, in mm
+  double          spacing_y;       // column 30, in mm
+  double          b_factor;        // column 34
+  int             b_number;        // column 42
+  int             gradient_number; // column 43
+  double          ap;              // column 46
+  double          fh;              // column 47
+  double          rl;              // column 48
+  std::streamoff  offset;          // in the .REC, in bytes
+  std::streamoff  size;            // in bytes
+  par_image_class image_class;
+  int             slice_rank;      // position of the slice among the slices
+  int             b_rank;          // position of the b-value among the b-values > 0
+  int             component;       // position among the images of its class
+} par_image;
+
+typedef struct
+{
+  double rl;
+  double ap;
+  double fh;
+} par_direction;
+
+// Index of the magnitude images of a PAR/REC dataset. A b0 image has
+// b = 0, a trace image has b > 0 and no gradient direction, and the
+// rest are direction images. Components are numbered in .REC order:
+// b0 components by (b number, gradient number), directions and traces
+// by gradient number.
+class par_index
+{
+ public:
+  std::vector<par_image>     images;     // in .REC order
+  std::vector<par_direction> directions; // one per direction component
+  int                        number_of_slices;
+  int                        number_of_b_values;
+  int                        number_of_directions;
+  int                        number_of_traces;
+  int                        number_of_b0_components;
+  int                        size_x;
+  int                        size_y;
+  int                        pixel_size;    // in bytes
+  double                     voxel_size[3]; // in mm, slice thickness plus gap in z
+  std::streamoff             rec_size;      // of every image, magnitude or not
+  bool                       read        ( const std::string& par_file_name );
+  std::streamoff             volume_size ( void );
+};
+
+#endif
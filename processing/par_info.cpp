@@ -0,0 +1,79 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "par_index.hpp"
+
+using namespace std;
+
+// Prints the dimensions of a PAR/REC dataset, one "name value" per
+// line, so that the wrappers do not need them by hand, and optionally
+// writes its gradient directions (rl ap fh) in the format of
+// extract_gradient_directions_from_PAR.sh: the count, then one per line.
+
+int main (int argc, char** argv)
+{
+  FILE*     directions_file;
+  par_index index;
+  string    directions_file_name;
+  string    par_file_name;
+
+  if ( argc < 2 )
+    {
+      cout << "USAGE: " << argv[0] << " par_file_name [-directions output_file_name]" << endl;
+      exit (1);
+    }
+
+  par_file_name = argv[1];
+  for ( int i = 2; i < argc - 1; i++ )
+    if ( string ( argv[i] ) == "-directions" )
+      directions_file_name = argv[++i];
+
+  if ( ! index.read ( par_file_name ) )
+    exit (1);
+
+  cout << "slices "        << index.number_of_slices        << endl;
+  cout << "size_x "        << index.size_x                  << endl;
+  cout << "size_y "        << index.size_y                  << endl;
+  cout << "pixel_size "    << index.pixel_size              << endl;
+  cout << "b_values "      << index.number_of_b_values      << endl;
+  cout << "directions "    << index.number_of_directions    << endl;
+  cout << "traces "        << index.number_of_traces        << endl;
+  cout << "b0_components " << index.number_of_b0_components << endl;
+  cout << "rec_size "      << index.rec_size                << endl;
+  cout << "voxel_size "    << index.voxel_size[0] << " " << index.voxel_size[1] << " " << index.voxel_size[2] << endl;
+
+  if ( directions_file_name.empty () )
+    return 0;
+  directions_file = fopen ( directions_file_name.c_str (), "w" );
+  if ( directions_file == NULL )
+    {
+      cout << "ERROR opening " << directions_file_name << "." << endl;
+      exit (1);
+    }
+  fprintf ( directions_file, "%u\n", static_cast<unsigned int> ( index.directions.size () ) );
+  for ( unsigned int i = 0; i < index.directions.size (); i++ )
+    fprintf ( directions_file, "%.3f %.3f %.3f\n", index.directions[i].rl, index.directions[i].ap, index.directions[i].fh );
+  fclose ( directions_file );
+  return 0;
+}
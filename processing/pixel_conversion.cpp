@@ -0,0 +1,191 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pixel_conversion.hpp"
+
+using namespace std;
+
+static const char* pixel_type_names[] = { "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32" };
+static const int   pixel_type_sizes[] = { 1, 1, 2, 2, 4, 4, 4 };
+
+pixel_type pixel_type_from_name ( const string& name )
+{
+  for ( int type = int8_pixel; type < unknown_pixel; type++ )
+    if ( name == pixel_type_names[type] )
+      return static_cast<pixel_type> ( type );
+  if ( name == "1" )
+    return int8_pixel;
+  if ( name == "2" )
+    return int16_pixel;
+  if ( name == "4" )
+    return int32_pixel;
+  return unknown_pixel;
+}
+
+const char* pixel_type_name ( pixel_type type )
+{
+  if ( type < int8_pixel || type >= unknown_pixel )
+    return "unknown";
+  return pixel_type_names[type];
+}
+
+int pixel_type_size ( pixel_type type )
+{
+  if ( type < int8_pixel || type >= unknown_pixel )
+    return 0;
+  return pixel_type_sizes[type];
+}
+
+template <typename output_t> static inline output_t saturate ( double value )
+{
+  if ( ! numeric_limits<output_t>::is_integer )
+    return static_cast<output_t> ( value );
+  if ( value != value )
+    return 0;
+  value = nearbyint ( value );
+  if ( value <= static_cast<double> ( numeric_limits<output_t>::min () ) )
+    return numeric_limits<output_t>::min ();
+  if ( value >= static_cast<double> ( numeric_limits<output_t>::max () ) )
+    return numeric_limits<output_t>::max ();
+  return static_cast<output_t> ( value );
+}
+
+template <typename output_t> static inline output_t saturate_integer ( int64_t value )
+{
+  if ( value < static_cast<int64_t> ( numeric_limits<output_t>::min () ) )
+    return numeric_limits<output_t>::min ();
+  if ( value > static_cast<int64_t> ( numeric_limits<output_t>::max () ) )
+    return numeric_limits<output_t>::max ();
+  return static_cast<output_t> ( value );
+}
+
+// The loops below have no dependencies between iterations and are
+// written so that the compiler can vectorize them.
+template <typename input_t, typename output_t>
+static void convert_block ( const input_t* input, output_t* output, long long number_of_pixels, double slope, double offset )
+{
+  bool exact;
+
+  exact = slope == 1.0 && offset == 0.0 && numeric_limits<input_t>::is_integer && numeric_limits<output_t>::is_integer;
+  if ( exact )
+    {
+      for ( long long i = 0; i < number_of_pixels; i++ )
+	output[i] = saturate_integer<output_t> ( static_cast<int64_t> ( input[i] ) );
+      return;
+    }
+  for ( long long i = 0; i < number_of_pixels; i++ )
+    output[i] = saturate<output_t> ( static_cast<double> ( input[i] ) * slope + offset );
+}
+
+// The most common case, 32 bit 2dseq data stored as 16 bit: a signed
+// saturating pack does eight pixels per instruction pair.
+static void convert_int32_to_int16 ( const int32_t* input, int16_t* output, long long number_of_pixels )
+{
+  long long i = 0;
+
+#ifdef __SSE2__
+  for ( ; i + 8 <= number_of_pixels; i += 8 )
+    {
+      __m128i low  = _mm_loadu_si128 ( reinterpret_cast<const __m128i*> ( input + i ) );
+      __m128i high = _mm_loadu_si128 ( reinterpret_cast<const __m128i*> ( input + i + 4 ) );
+      _mm_storeu_si128 ( reinterpret_cast<__m128i*> ( output + i ), _mm_packs_epi32 ( low, high ) );
+    }
+#endif
+  convert_block<int32_t, int16_t> ( input + i, output + i, number_of_pixels - i, 1.0, 0.0 );
+}
+
+template <typename input_t>
+static void convert_from ( const input_t* input, char* output, pixel_type output_type, long long number_of_pixels, double slope, double offset )
+{
+  switch ( output_type )
+    {
+    case int8_pixel:
+      convert_block ( input, reinterpret_cast<int8_t*>   ( output ), number_of_pixels, slope, offset );
+      break;
+    case uint8_pixel:
+      convert_block ( input, reinterpret_cast<uint8_t*>  ( output ), number_of_pixels, slope, offset );
+      break;
+    case int16_pixel:
+      convert_block ( input, reinterpret_cast<int16_t*>  ( output ), number_of_pixels, slope, offset );
+      break;
+    case uint16_pixel:
+      convert_block ( input, reinterpret_cast<uint16_t*> ( output ), number_of_pixels, slope, offset );
+      break;
+    case int32_pixel:
+      convert_block ( input, reinterpret_cast<int32_t*>  ( output ), number_of_pixels, slope, offset );
+      break;
+    case uint32_pixel:
+      convert_block ( input, reinterpret_cast<uint32_t*> ( output ), number_of_pixels, slope, offset );
+      break;
+    case float32_pixel:
+      convert_block ( input, reinterpret_cast<float*>    ( output ), number_of_pixels, slope, offset );
+      break;
+    default:
+      break;
+    }
+}
+
+void convert_pixels ( const char* input, pixel_type input_type, char* output, pixel_type output_type, long long number_of_pixels, double slope, double offset )
+{
+  if ( input_type == output_type && slope == 1.0 && offset == 0.0 )
+    {
+      memcpy ( output, input, number_of_pixels * pixel_type_size ( input_type ) );
+      return;
+    }
+  if ( input_type == int32_pixel && output_type == int16_pixel && slope == 1.0 && offset == 0.0 )
+    {
+      convert_int32_to_int16 ( reinterpret_cast<const int32_t*> ( input ), reinterpret_cast<int16_t*> ( output ), number_of_pixels );
+      return;
+    }
+  switch ( input_type )
+    {
+    case int8_pixel:
+      convert_from ( reinterpret_cast<const int8_t*>   ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case uint8_pixel:
+      convert_from ( reinterpret_cast<const uint8_t*>  ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case int16_pixel:
+      convert_from ( reinterpret_cast<const int16_t*>  ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case uint16_pixel:
+      convert_from ( reinterpret_cast<const uint16_t*> ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case int32_pixel:
+      convert_from ( reinterpret_cast<const int32_t*>  ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case uint32_pixel:
+      convert_from ( reinterpret_cast<const uint32_t*> ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    case float32_pixel:
+      convert_from ( reinterpret_cast<const float*>    ( input ), output, output_type, number_of_pixels, slope, offset );
+      break;
+    default:
+      break;
+    }
+}
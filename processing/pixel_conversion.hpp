@@ -0,0 +1,47 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#ifndef PIXEL_CONVERSION
+#define PIXEL_CONVERSION
+
+#include <string>
+
+enum pixel_type { int8_pixel = 0,
+		  uint8_pixel,
+		  int16_pixel,
+		  uint16_pixel,
+		  int32_pixel,
+		  uint32_pixel,
+		  float32_pixel,
+		  unknown_pixel };
+
+// Accepts int8, uint8, int16, uint16, int32, uint32 and float32, and,
+// as the tools used to take a size in bytes, 1, 2 and 4 for the signed
+// integer of that size.
+pixel_type  pixel_type_from_name ( const std::string& name );
+const char* pixel_type_name      ( pixel_type type );
+int         pixel_type_size      ( pixel_type type );
+
+// Converts number_of_pixels pixels, output = input * slope + offset,
+// rounded to the nearest integer and saturated to the range of the
+// output type (NaN becomes 0). Without scaling, integer to integer
+// conversions never go through floating point.
+void convert_pixels ( const char* input, pixel_type input_type, char* output, pixel_type output_type, long long number_of_pixels, double slope = 1.0, double offset = 0.0 );
+
+#endif
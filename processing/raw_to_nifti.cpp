@@ -0,0 +1,117 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "block_io.hpp"
+#include "nifti_writer.hpp"
+
+using namespace std;
+
+// Wraps a headerless raw series (x fastest, then y, slices and volumes)
+// in a NIfTI-1 file, .nii or .nii.gz, so that it can be opened by the
+// analysis tools without a manual conversion.
+
+int main (int argc, char** argv)
+{
+  block_reader      input_file;
+  char*             buffer;
+  int               level;
+  nifti_description description;
+  nifti_writer      output_file;
+  streamoff         chunk;
+  streamoff         expected_file_size;      // in bytes
+  streamoff         remaining;
+  string            input_file_name;
+  string            output_file_name;
+
+  if ( argc < 8 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name output_file_name(.nii or .nii.gz) size_x size_y number_of_slices number_of_volumes pixel_type [-voxel_size x y z(in mm)] [-level gzip_level] [-byte_order little|big] [-direct]" << endl;
+      exit (1);
+    }
+
+  input_file_name        =        argv[1];
+  output_file_name       =        argv[2];
+  description.size_x     = atoi ( argv[3] );
+  description.size_y     = atoi ( argv[4] );
+  description.size_z     = atoi ( argv[5] );
+  description.volumes    = atoi ( argv[6] );
+  description.type       = pixel_type_from_name ( argv[7] );
+  for ( int i = 0; i < 3; i++ )
+    description.voxel_size[i] = 1.0;
+  level = 6;
+  for ( int i = 8; i < argc - 1; i++ )
+    {
+      if ( string ( argv[i] ) == "-voxel_size" && i + 3 < argc )
+	{
+	  for ( int j = 0; j < 3; j++ )
+	    description.voxel_size[j] = atof ( argv[++i] );
+	}
+      else if ( string ( argv[i] ) == "-level" )
+	level = atoi ( argv[++i] );
+    }
+  if ( description.type == unknown_pixel )
+    {
+      cout << "ERROR: unknown pixel type." << endl;
+      exit (1);
+    }
+
+  expected_file_size = static_cast<streamoff> ( description.size_x ) * description.size_y * description.size_z * description.volumes * pixel_type_size ( description.type );
+  if ( ! input_file.open ( input_file_name, direct_requested ( argc, argv, 8 ) ) )
+    {
+      cout << "ERROR opening input_file." << endl;
+      exit (1);
+    }
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 8 ), pixel_type_size ( description.type ) ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), expected_file_size ) )
+    exit (1);
+
+  if ( ! output_file.open ( output_file_name, description, level ) )
+    {
+      cout << "ERROR opening " << output_file_name << "." << endl;
+      exit (1);
+    }
+  buffer = new char[BLOCK_IO_BUFFER_SIZE];
+  for ( remaining = expected_file_size; remaining > 0; remaining -= chunk )
+    {
+      chunk = remaining < BLOCK_IO_BUFFER_SIZE ? remaining : BLOCK_IO_BUFFER_SIZE;
+      if ( ! input_file.read ( buffer, chunk ) || ! output_file.write ( buffer, chunk ) )
+	{
+	  cout << "ERROR converting " << input_file_name << "." << endl;
+	  exit (1);
+	}
+    }
+  delete[] buffer;
+  input_file.close ();
+  if ( ! output_file.close () )
+    {
+      cout << "ERROR closing " << output_file_name << "." << endl;
+      exit (1);
+    }
+  cout << "Wrote " << output_file_name << "." << endl;
+  return 0;
+}
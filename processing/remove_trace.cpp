@@ -19,28 +19,27 @@
 */
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdlib>
 
+#include "block_io.hpp"
+
 using namespace std;
 
 int main (int argc, char** argv)
 {
-  char         buffer[128];
-  fstream      traces_file;
-  fstream      remainder_file;
-  ifstream     input_file;
-  int          file_size;               // in bytes
-  int          input_file_size;
-  int          length;
+  block_reader input_file;
+  block_writer traces_file;
+  block_writer remainder_file;
+  bool         direct;
+  streamoff    input_file_size;
   int          number_of_b_values;
   int          number_of_directions;
   int          number_of_slices;
   int          number_of_traces;
-  int          traces_file_size;        // in bytes
+  streamoff    traces_file_size;        // in bytes
   int          pixel_size;              // in bytes
-  int          remainder_file_size;     // in bytes
+  streamoff    remainder_file_size;     // in bytes
   int          size_x_dimension;        // in pixels
   int          size_y_dimension;        // in pixels
   string       input_file_name;
@@ -51,7 +50,7 @@ int main (int argc, char** argv)
   if ( argc < 11 )
     {
       cout << "ERROR" << endl;
-      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace) number_of_traces number_of_slices pixel_size(in bytes) size_x_dimension(in pixels) size_y_dimension(in pixels) traces_file_name remainder_file_name" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace) number_of_traces number_of_slices pixel_size(in bytes) size_x_dimension(in pixels) size_y_dimension(in pixels) traces_file_name remainder_file_name [-direct] [-byte_order little|big]" << endl;
       exit (1);
     }
 
@@ -66,81 +65,64 @@ int main (int argc, char** argv)
   size_y_dimension        = atoi ( argv[8] );
   traces_file_name        =        argv[9];
   remainder_file_name     =        argv[10];
+  direct                  = direct_requested ( argc, argv, 11 );
 
   // compute file sizes
-  input_file_size     = number_of_b_values * number_of_directions * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
-  traces_file_size    = number_of_b_values * number_of_traces     * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
+  input_file_size     = static_cast<streamoff> ( number_of_b_values ) * number_of_directions * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
+  traces_file_size    = static_cast<streamoff> ( number_of_b_values ) * number_of_traces     * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
   remainder_file_size = input_file_size - traces_file_size;
 
   // check input size
-  input_file.open ( input_file_name.c_str() );
-  input_file.seekg (0, ios::end);
-  file_size = input_file.tellg ();
-
-  cout << "Expected input file size: " << input_file_size << endl;
-  cout << "Input file size:          " << file_size << " ";
-  if ( input_file_size != file_size )
+  if ( ! input_file.open ( input_file_name, direct ) )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR opening input_file." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 11 ), pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), input_file_size ) )
+    exit (1);
 
   // copy the last directions (which encodes the traces)
-  traces_file.open (traces_file_name.c_str (), fstream::binary | fstream::trunc | fstream::in | fstream::out );
-  input_file.seekg(remainder_file_size, ios::beg);
-  length = 2;
-  while (input_file.tellg () < input_file_size)
+  if ( ! traces_file.open ( traces_file_name, direct, traces_file_size ) )
+    {
+      cout << "ERROR opening traces_file." << endl;
+      exit (1);
+    }
+  input_file.seek ( remainder_file_size );
+  if ( ! copy_blocks ( input_file, traces_file, traces_file_size ) )
     {
-      input_file.read   (buffer, length);
-      traces_file.write (buffer, length);
+      cout << "ERROR copying the traces." << endl;
+      exit (1);
     }
 
   // copy the remainder (everything but the traces)
-  remainder_file.open (remainder_file_name.c_str (), fstream::binary | fstream::out | fstream::in | fstream::trunc );
-  if ( ! remainder_file )
+  if ( ! remainder_file.open ( remainder_file_name, direct, remainder_file_size ) )
     {
       cout << "ERROR opening remainder_file." << endl;
       exit (1);
     }
-  input_file.seekg(0, ios::beg);
-  length = 2;
-  while (input_file.tellg () < remainder_file_size )
+  input_file.seek ( 0 );
+  if ( ! copy_blocks ( input_file, remainder_file, remainder_file_size ) )
     {
-      input_file.read      ( buffer, length );
-      remainder_file.write ( buffer, length );
+      cout << "ERROR copying the remainder." << endl;
+      exit (1);
     }
   input_file.close ();
 
-  // verify traces file size
-  traces_file.seekg (0, ios::end);
-  file_size = traces_file.tellg ();
-  traces_file.close ();
-  cout << "Expected traces file size: " << traces_file_size << endl;
-  cout << "Traces file size:          " << file_size << " ";
-  if ( traces_file_size != file_size )
-    {
-      cout << "FAIL" << endl;
-      exit (1);
-    }
-  else
-    cout << "OK" << endl;
+  // verify file sizes on the open descriptors
+  if ( ! check_size ( "traces file", traces_file.size (), traces_file_size ) )
+    exit (1);
+  if ( ! check_size ( "remainder file", remainder_file.size (), remainder_file_size ) )
+    exit (1);
 
-  // verify remainder file size
-  remainder_file.seekg ( 0, ios::end );
-  file_size = remainder_file.tellg ();
-  remainder_file.close ();
-  cout << "Expected remainder file size: " << remainder_file_size << endl;
-  cout << "Remainder file size:          " << file_size << " ";
-  if ( file_size != remainder_file_size )
+  if ( ! traces_file.close () || ! remainder_file.close () )
     {
-      cout << "FAIL" << endl;
+      cout << "ERROR closing the output files." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
-
   return 0;
 }
@@ -19,32 +19,29 @@
 */
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdlib>
 
+#include "block_io.hpp"
+
 using namespace std;
 
 int main (int argc, char** argv)
 {
-  char         buffer[128];
-  fstream     remainder_file;
-  ifstream     input_file;
-  int          expected_file_size; // in bytes
-  int          file_size;               // in bytes
-  int          input_file_size;
-  int          length;
+  block_reader input_file;
+  block_writer output_file;
+  block_writer remainder_file;
+  bool         direct;
+  streamoff    expected_file_size; // in bytes
   int          number_of_b_values;
   int          number_of_directions;
   int          number_of_slices;
   int          number_of_b0_components;
-  int          offset_begin;
-  int          output_file_size;        // in bytes
+  streamoff    offset_begin;
   int          pixel_size;              // in bytes
-  int          remainder_file_size;     // in bytes
+  streamoff    remainder_file_size;     // in bytes
   int          size_x_dimension;        // in pixels
   int          size_y_dimension;        // in pixels
-  ofstream     output_file;
   string       input_file_name;
   string       output_file_name;
   string       remainder_file_name;
@@ -53,7 +50,7 @@ int main (int argc, char** argv)
   if ( argc < 11 )
     {
       cout << "ERROR" << endl;
-      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace, if any) number_of_slices pixel_size(in bytes) number_of_b0_components size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name remainder_file_name" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace, if any) number_of_slices pixel_size(in bytes) number_of_b0_components size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name remainder_file_name [-direct] [-byte_order little|big]" << endl;
       exit (1);
     }
 
@@ -69,86 +66,63 @@ int main (int argc, char** argv)
   output_file_name        =        argv[9];
   remainder_file_name     =        argv[10];
 
+  direct                  = direct_requested ( argc, argv, 11 );
+
   // check that sizes match
-  offset_begin = number_of_b_values * number_of_directions    * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
+  offset_begin = static_cast<streamoff> ( number_of_b_values ) * number_of_directions    * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
   remainder_file_size = offset_begin;
-  expected_file_size = offset_begin + number_of_b0_components * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
-
-  cout << "Expected input file size: " << expected_file_size << endl;
+  expected_file_size = offset_begin + static_cast<streamoff> ( number_of_b0_components ) * number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
 
-  input_file.open (input_file_name.c_str ());
-  input_file.seekg (0, ios::end);
-  input_file_size = input_file.tellg ();
-
-  cout << "Input file size:          " << input_file_size << " ";
-  if ( input_file_size != expected_file_size )
+  if ( ! input_file.open ( input_file_name, direct ) )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR opening input_file." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
-
-  output_file.open (output_file_name.c_str ());
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 11 ), pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), expected_file_size ) )
+    exit (1);
 
   // copy the last direction (which encodes B0)
-  input_file.seekg(offset_begin, ios::beg);
-  length = 2;
-  while (input_file.tellg () < input_file_size)
+  if ( ! output_file.open ( output_file_name, direct, expected_file_size - offset_begin ) )
     {
-      input_file.read   (buffer, length);
-      output_file.write (buffer, length);
+      cout << "ERROR opening output_file." << endl;
+      exit (1);
+    }
+  input_file.seek ( offset_begin );
+  if ( ! copy_blocks ( input_file, output_file, expected_file_size - offset_begin ) )
+    {
+      cout << "ERROR copying the B0." << endl;
+      exit (1);
     }
-  output_file.close ();
 
   // copy the remainder (everything but the B0)
-  remainder_file.open (remainder_file_name.c_str (), fstream::binary | fstream::out | fstream::in | fstream::trunc );
-  if ( ! remainder_file )
+  if ( ! remainder_file.open ( remainder_file_name, direct, remainder_file_size ) )
     {
       cout << "ERROR opening remainder_file." << endl;
       exit (1);
     }
-
-  input_file.seekg(0, ios::beg);
-  length = 2;
-  while (input_file.tellg () < remainder_file_size )
+  input_file.seek ( 0 );
+  if ( ! copy_blocks ( input_file, remainder_file, remainder_file_size ) )
     {
-      input_file.read      ( buffer, length );
-      remainder_file.write ( buffer, length );
+      cout << "ERROR copying the remainder." << endl;
+      exit (1);
     }
   input_file.close ();
 
-  // verify remainder file size
-  remainder_file.seekg ( 0, ios::end );
-  file_size = remainder_file.tellg ();
-  remainder_file.close ();
-  cout << "Expected remainder file size: " << remainder_file_size << endl;
-  cout << "Remainder file size:          " << file_size << " ";
-  if ( file_size != remainder_file_size )
-    {
-      cout << "FAIL" << endl;
-      exit (1);
-    }
-  else
-    cout << "OK" << endl;
+  // verify file sizes on the open descriptors
+  if ( ! check_size ( "remainder file", remainder_file.size (), remainder_file_size ) )
+    exit (1);
+  if ( ! check_size ( "output file", output_file.size (), expected_file_size - offset_begin ) )
+    exit (1);
 
-  // verify output file size
-  expected_file_size = expected_file_size - offset_begin;
-  input_file.open (output_file_name.c_str ());
-  input_file.seekg (0, ios::end);
-  output_file_size = input_file.tellg ();
-  cout << "Expected output file size: " << expected_file_size << endl;
-  cout << "Output file size:          " << output_file_size << " ";
-  if ( output_file_size != expected_file_size )
+  if ( ! remainder_file.close () || ! output_file.close () )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR closing the output files." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
-
-  input_file.close ();
   return 0;
 }
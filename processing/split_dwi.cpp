@@ -0,0 +1,386 @@
+/*
+# Diffusynth - Synthesize DWI images from T2 images.
+# Copyright (C) 2013 Renato Callado Borges
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Author can be reached at rborges@if.usp.br
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "block_io.hpp"
+#include "par_index.hpp"
+
+using namespace std;
+
+// Splits a whole acquisition in a single pass: the input is read once,
+// sequentially, and every volume in it is written once, straight to its
+// place in the final files. It replaces the chain split_b0_remainder,
+// remove_trace, split_raw_by_b-value and append_b0_in_front.
+//
+// Input layout (each block is one volume of all slices):
+//   [direction 0: b-value 0 .. b-value n-1] ... [trace directions] [b0 components]
+// or, with -b0_first, the b0 components come first.
+// Output layout of each b-value file:
+//   [b0 components][direction 0] ... [last direction that is not a trace]
+// and the traces file keeps the trace directions in their input order.
+//
+// With -par, the layout is not assumed: the PAR file is indexed and
+// each magnitude image is read from its own offset in the .REC, so the
+// dimensions need not be given and images of other types are skipped.
+
+int split_by_par ( int argc, char** argv );
+
+int main (int argc, char** argv)
+{
+  block_reader  input_file;
+  block_writer* output_file;
+  block_writer  traces_file;
+  bool          b0_first;
+  bool          direct;
+  char*         buffer;
+  int           number_of_b_values;
+  int           number_of_b0_components;
+  int           number_of_directions;
+  int           number_of_slices;
+  int           number_of_traces;
+  int           pixel_size;              // in bytes
+  int           refined_directions;
+  int           size_x_dimension;        // in pixels
+  int           size_y_dimension;        // in pixels
+  streamoff     b0_size;                 // in bytes
+  streamoff     block;
+  streamoff     block_offset;
+  streamoff     chunk;
+  streamoff     direction;
+  streamoff     expected_file_size;      // in bytes
+  streamoff     input_offset;
+  streamoff     length;
+  streamoff     output_file_size;        // in bytes
+  streamoff     remainder_size;          // in bytes
+  streamoff     traces_file_size;        // in bytes
+  streamoff     volume_size;             // in bytes
+  string        file_name;
+  string        input_file_name;
+  string        output_file_name_prefix;
+  string        traces_file_name;
+  stringstream  streambuf;
+
+  if ( argc > 1 && string ( argv[1] ) == "-par" )
+    return split_by_par ( argc, argv );
+
+  // sanity
+  if ( argc < 12 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " -par par_file_name input_file_name traces_file_name output_file_name_prefix [-direct] [-byte_order little|big]" << endl;
+      cout << "   or: " << argv[0] << " input_file_name number_of_b_values number_of_directions(including trace) number_of_traces number_of_slices pixel_size(in bytes) number_of_b0_components size_x_dimension(in pixels) size_y_dimension(in pixels) traces_file_name output_file_name_prefix [-b0_first] [-direct] [-byte_order little|big]" << endl;
+      exit (1);
+    }
+
+  // parsing input
+  input_file_name         =        argv[1];
+  number_of_b_values      = atoi ( argv[2] );
+  number_of_directions    = atoi ( argv[3] );
+  number_of_traces        = atoi ( argv[4] );
+  number_of_slices        = atoi ( argv[5] );
+  pixel_size              = atoi ( argv[6] );
+  number_of_b0_components = atoi ( argv[7] );
+  size_x_dimension        = atoi ( argv[8] );
+  size_y_dimension        = atoi ( argv[9] );
+  traces_file_name        =        argv[10];
+  output_file_name_prefix =        argv[11];
+  b0_first                = false;
+  for (int i = 12; i < argc; i++)
+    if ( string ( argv[i] ) == "-b0_first" )
+      b0_first = true;
+  direct                  = direct_requested ( argc, argv, 12 );
+  refined_directions      = number_of_directions - number_of_traces;
+
+  // compute file sizes
+  volume_size        = static_cast<streamoff> ( number_of_slices ) * pixel_size * size_x_dimension * size_y_dimension;
+  b0_size            = volume_size * number_of_b0_components;
+  remainder_size     = volume_size * number_of_b_values * number_of_directions;
+  traces_file_size   = volume_size * number_of_b_values * number_of_traces;
+  output_file_size   = b0_size + volume_size * refined_directions;
+  expected_file_size = b0_size + remainder_size;
+
+  // check input size
+  if ( ! input_file.open ( input_file_name, direct ) )
+    {
+      cout << "ERROR opening input_file." << endl;
+      exit (1);
+    }
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 12 ), pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), expected_file_size ) )
+    exit (1);
+
+  // create every output at its final size
+  output_file = new block_writer[number_of_b_values];
+  for (int i = 0; i < number_of_b_values; i++)
+    {
+      streambuf.str ("");
+      streambuf.width (3);
+      streambuf.fill ('0');
+      streambuf << i;
+      file_name = output_file_name_prefix + streambuf.str () + ".raw";
+      if ( ! output_file[i].open ( file_name, direct, output_file_size ) )
+	{
+	  cout << "ERROR opening " << file_name << "." << endl;
+	  exit (1);
+	}
+    }
+  if ( ! traces_file.open ( traces_file_name, direct, traces_file_size ) )
+    {
+      cout << "ERROR opening traces_file." << endl;
+      exit (1);
+    }
+
+  // one sequential pass: route each piece of each volume to its place
+  buffer = new char[BLOCK_IO_BUFFER_SIZE];
+  input_offset = 0;
+  while ( input_offset < expected_file_size )
+    {
+      length = expected_file_size - input_offset;
+      if ( length > BLOCK_IO_BUFFER_SIZE )
+	length = BLOCK_IO_BUFFER_SIZE;
+      if ( ! input_file.read ( buffer, length ) )
+	{
+	  cout << "ERROR reading input_file." << endl;
+	  exit (1);
+	}
+      for ( streamoff position = 0; position < length; position += chunk )
+	{
+	  block        = ( input_offset + position ) / volume_size;
+	  block_offset = ( input_offset + position ) % volume_size;
+	  chunk        = volume_size - block_offset;
+	  if ( chunk > length - position )
+	    chunk = length - position;
+	  if ( b0_first )
+	    block -= number_of_b0_components;
+	  if ( block < 0 || block >= static_cast<streamoff> ( number_of_b_values ) * number_of_directions )
+	    {
+	      // b0 component: it goes in front of every b-value series
+	      if ( block >= 0 )
+		block -= static_cast<streamoff> ( number_of_b_values ) * number_of_directions;
+	      else
+		block += number_of_b0_components;
+	      for (int i = 0; i < number_of_b_values; i++)
+		if ( ! output_file[i].write_at ( buffer + position, chunk, block * volume_size + block_offset ) )
+		  {
+		    cout << "ERROR writing output " << i << "." << endl;
+		    exit (1);
+		  }
+	      continue;
+	    }
+	  direction = block / number_of_b_values;
+	  if ( direction < refined_directions )
+	    {
+	      if ( ! output_file[block % number_of_b_values].write_at ( buffer + position, chunk,
+								       b0_size + direction * volume_size + block_offset ) )
+		{
+		  cout << "ERROR writing output " << block % number_of_b_values << "." << endl;
+		  exit (1);
+		}
+	    }
+	  else
+	    {
+	      if ( ! traces_file.write_at ( buffer + position, chunk,
+					    ( block - static_cast<streamoff> ( refined_directions ) * number_of_b_values ) * volume_size + block_offset ) )
+		{
+		  cout << "ERROR writing traces_file." << endl;
+		  exit (1);
+		}
+	    }
+	}
+      input_offset += length;
+    }
+  delete[] buffer;
+  input_file.close ();
+
+  // verify output file sizes on the open descriptors
+  for (int i = 0; i < number_of_b_values; i++)
+    {
+      stringstream label;
+
+      label << "output " << i << " file";
+      check_size ( label.str (), output_file[i].size (), output_file_size );
+      if ( ! output_file[i].close () )
+	cout << "ERROR closing output " << i << "." << endl;
+    }
+  if ( ! check_size ( "traces file", traces_file.size (), traces_file_size ) )
+    exit (1);
+  if ( ! traces_file.close () )
+    {
+      cout << "ERROR closing traces_file." << endl;
+      exit (1);
+    }
+
+  delete[] output_file;
+  return 0;
+}
+
+int split_by_par ( int argc, char** argv )
+{
+  block_reader  input_file;
+  block_writer* output_file;
+  block_writer  traces_file;
+  bool          direct;
+  char*         buffer;
+  par_index     index;
+  streamoff     b0_size;                 // in bytes
+  streamoff     image_size;              // in bytes
+  streamoff     output_file_size;        // in bytes
+  streamoff     position;
+  streamoff     traces_file_size;        // in bytes
+  string        file_name;
+  string        input_file_name;
+  string        output_file_name_prefix;
+  string        par_file_name;
+  string        traces_file_name;
+  stringstream  streambuf;
+
+  if ( argc < 6 )
+    {
+      cout << "ERROR" << endl;
+      cout << "USAGE: " << argv[0] << " -par par_file_name input_file_name traces_file_name output_file_name_prefix [-direct] [-byte_order little|big]" << endl;
+      exit (1);
+    }
+
+  par_file_name           = argv[2];
+  input_file_name         = argv[3];
+  traces_file_name        = argv[4];
+  output_file_name_prefix = argv[5];
+  direct                  = direct_requested ( argc, argv, 6 );
+
+  if ( ! index.read ( par_file_name ) )
+    exit (1);
+  cout << "Dataset: " << index.number_of_slices << " slices of " << index.size_x << "x" << index.size_y << ", "
+       << index.number_of_b0_components << " b0, " << index.number_of_b_values << " b-values, "
+       << index.number_of_directions << " directions, " << index.number_of_traces << " traces." << endl;
+
+  // compute file sizes
+  image_size       = static_cast<streamoff> ( index.size_x ) * index.size_y * index.pixel_size;
+  b0_size          = index.volume_size () * index.number_of_b0_components;
+  output_file_size = b0_size + index.volume_size () * index.number_of_directions;
+  traces_file_size = index.volume_size () * index.number_of_b_values * index.number_of_traces;
+
+  // check input size
+  if ( ! input_file.open ( input_file_name, direct ) )
+    {
+      cout << "ERROR opening input_file." << endl;
+      exit (1);
+    }
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 6 ), index.pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), index.rec_size ) )
+    exit (1);
+
+  // create every output at its final size
+  output_file = new block_writer[index.number_of_b_values];
+  for (int i = 0; i < index.number_of_b_values; i++)
+    {
+      streambuf.str ("");
+      streambuf.width (3);
+      streambuf.fill ('0');
+      streambuf << i;
+      file_name = output_file_name_prefix + streambuf.str () + ".raw";
+      if ( ! output_file[i].open ( file_name, direct, output_file_size ) )
+	{
+	  cout << "ERROR opening " << file_name << "." << endl;
+	  exit (1);
+	}
+    }
+  if ( ! traces_file.open ( traces_file_name, direct, traces_file_size ) )
+    {
+      cout << "ERROR opening traces_file." << endl;
+      exit (1);
+    }
+
+  // the index is in .REC order, so the reads only go forward
+  buffer = new char[image_size];
+  for ( unsigned int i = 0; i < index.images.size (); i++ )
+    {
+      const par_image& image = index.images[i];
+
+      if ( ! input_file.read_at ( buffer, image_size, image.offset ) )
+	{
+	  cout << "ERROR reading image " << image.index_in_rec << "." << endl;
+	  exit (1);
+	}
+      switch ( image.image_class )
+	{
+	case b0_image:
+	  // it goes in front of every b-value series
+	  position = ( static_cast<streamoff> ( image.component ) * index.number_of_slices + image.slice_rank ) * image_size;
+	  for (int j = 0; j < index.number_of_b_values; j++)
+	    if ( ! output_file[j].write_at ( buffer, image_size, position ) )
+	      {
+		cout << "ERROR writing output " << j << "." << endl;
+		exit (1);
+	      }
+	  break;
+	case direction_image:
+	  position = b0_size + ( static_cast<streamoff> ( image.component ) * index.number_of_slices + image.slice_rank ) * image_size;
+	  if ( ! output_file[image.b_rank].write_at ( buffer, image_size, position ) )
+	    {
+	      cout << "ERROR writing output " << image.b_rank << "." << endl;
+	      exit (1);
+	    }
+	  break;
+	case trace_image:
+	  position = ( ( static_cast<streamoff> ( image.component ) * index.number_of_b_values + image.b_rank ) * index.number_of_slices + image.slice_rank ) * image_size;
+	  if ( ! traces_file.write_at ( buffer, image_size, position ) )
+	    {
+	      cout << "ERROR writing traces_file." << endl;
+	      exit (1);
+	    }
+	  break;
+	}
+    }
+  delete[] buffer;
+  input_file.close ();
+
+  // verify output file sizes on the open descriptors
+  for (int i = 0; i < index.number_of_b_values; i++)
+    {
+      stringstream label;
+
+      label << "output " << i << " file";
+      check_size ( label.str (), output_file[i].size (), output_file_size );
+      if ( ! output_file[i].close () )
+	cout << "ERROR closing output " << i << "." << endl;
+    }
+  if ( ! check_size ( "traces file", traces_file.size (), traces_file_size ) )
+    exit (1);
+  if ( ! traces_file.close () )
+    {
+      cout << "ERROR closing traces_file." << endl;
+      exit (1);
+    }
+
+  delete[] output_file;
+  return 0;
+}
@@ -19,43 +19,62 @@
 */
 
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstdlib>
 #include <sstream>
 
+#include "block_io.hpp"
+#include "block_queue.hpp"
+
 using namespace std;
 
+// The input is read sequentially, in chunks, by the main thread and
+// each chunk is handed to the writer thread of its b-value through a
+// bounded queue, so reading and writing overlap and every output is
+// written by one thread only.
+#define SPLIT_CHUNK_SIZE  ( 2 * 1024 * 1024 )
+#define SPLIT_QUEUE_DEPTH 4
+
+typedef struct
+{
+  block_queue*  queue;
+  block_writer* output;
+  bool          ok;
+} writer_job;
+
+void* writer_thread ( void* argument );
+
 int main (int argc, char** argv)
 {
-  char         buffer[128];
-  fstream      output_file[256];
-  ifstream     input_file;
-  int          b_value_block_size;      // in bytes
-  int          direction_block_size;    // in bytes
-  int          file_size;               // in bytes
-  int          input_file_size;
-  int          length;
-  int          number_of_b_values;
-  int          number_of_directions;
-  int          number_of_slices;
-  int          offset;
-  int          offset_beg;
-  int          offset_end;
-  int          output_file_size;        // in bytes
-  int          pixel_size;              // in bytes
-  int          size_x_dimension;        // in pixels
-  int          size_y_dimension;        // in pixels
-  string       file_name;
-  string       input_file_name;
-  string       output_file_name_prefix;
-  stringstream streambuf;
+  block_queue** queue;
+  block_writer* output_file;
+  data_block    chunk;
+  pthread_t*    writer;
+  writer_job*   job;
+  bool          ok;
+  block_reader  input_file;
+  bool          direct;
+  streamoff     b_value_block_size;      // in bytes
+  streamoff     direction_block_size;    // in bytes
+  streamoff     input_file_size;
+  int           number_of_b_values;
+  int           number_of_directions;
+  int           number_of_slices;
+  streamoff     remaining;
+  streamoff     output_file_size;        // in bytes
+  int           pixel_size;              // in bytes
+  int           size_x_dimension;        // in pixels
+  int           size_y_dimension;        // in pixels
+  string        file_name;
+  string        input_file_name;
+  string        output_file_name_prefix;
+  stringstream  streambuf;
     
   // sanity
   if ( argc < 9 )
     {
       cout << "ERROR" << endl;
-      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions number_of_slices pixel_size(in bytes) size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name_prefix" << endl;
+      cout << "USAGE: " << argv[0] << " input_file_name number_of_b_values number_of_directions number_of_slices pixel_size(in bytes) size_x_dimension(in pixels) size_y_dimension(in pixels) output_file_name_prefix [-direct] [-byte_order little|big]" << endl;
       exit (1);
     }
 
@@ -68,35 +87,35 @@ int main (int argc, char** argv)
   size_x_dimension         = atoi ( argv[6] );
   size_y_dimension         = atoi ( argv[7] );
   output_file_name_prefix  =        argv[8];
-  if ( number_of_b_values >= 256 )
+  direct                   = direct_requested ( argc, argv, 9 );
+  if ( number_of_b_values < 1 )
     {
-      cout << "ERROR: maximum of 256 b-values." << endl;
+      cout << "ERROR: at least one b-value is needed." << endl;
       exit (1);
     }
 
   // compute file sizes
-  b_value_block_size   = number_of_slices * pixel_size * size_x_dimension * size_y_dimension;
+  b_value_block_size   = static_cast<streamoff> ( number_of_slices ) * pixel_size * size_x_dimension * size_y_dimension;
   direction_block_size = b_value_block_size   * number_of_b_values;
   output_file_size     = b_value_block_size   * number_of_directions;
   input_file_size      = direction_block_size * number_of_directions;
 
   // check input size
-  input_file.open ( input_file_name.c_str() );
-  input_file.seekg (0, ios::end);
-  file_size = input_file.tellg ();
-
-  cout << "Expected input file size: " << input_file_size << endl;
-  cout << "Input file size:          " << file_size << " ";
-  if ( input_file_size != file_size )
+  if ( ! input_file.open ( input_file_name, direct ) )
     {
-      cout << "FAIL" << endl;
-      input_file.close ();
+      cout << "ERROR opening input_file." << endl;
       exit (1);
     }
-  else
-    cout << "OK" << endl;
+  if ( ! input_file.set_byte_order ( byte_order_requested ( argc, argv, 9 ), pixel_size ) )
+    {
+      cout << "ERROR: unknown byte order." << endl;
+      exit (1);
+    }
+  if ( ! check_size ( "input file", input_file.size (), input_file_size ) )
+    exit (1);
 
   // sanity
+  output_file = new block_writer[number_of_b_values];
   for (int i=0; i < number_of_b_values; i++)
     {
       streambuf.seekp (0);
@@ -106,47 +125,96 @@ int main (int argc, char** argv)
       file_name = output_file_name_prefix;
       file_name += streambuf.str ();
       file_name += ".raw";
-      output_file[i].open (file_name.c_str (), fstream::binary | fstream::trunc | fstream::in | fstream::out );
+      if ( ! output_file[i].open ( file_name, direct, output_file_size ) )
+	{
+	  cout << "ERROR opening " << file_name << "." << endl;
+	  exit (1);
+	}
+    }
+
+  // one writer thread per output
+  queue  = new block_queue*[number_of_b_values];
+  writer = new pthread_t[number_of_b_values];
+  job    = new writer_job[number_of_b_values];
+  for (int i = 0; i < number_of_b_values; i++)
+    {
+      queue[i]      = new block_queue ( SPLIT_QUEUE_DEPTH );
+      job[i].queue  = queue[i];
+      job[i].output = &( output_file[i] );
+      job[i].ok     = true;
+      if ( pthread_create ( &( writer[i] ), NULL, writer_thread, &( job[i] ) ) != 0 )
+	{
+	  cout << "ERROR creating writer thread." << endl;
+	  exit (1);
+	}
     }
 
-  // for each direction...
-  for (int i = 0; i < number_of_directions; i++)
+  // for each direction get each b-value and send it to the right
+  // file; the blocks are contiguous, so the input is read in one sweep.
+  ok = true;
+  for (int i = 0; ok && i < number_of_directions; i++)
     {
       cout << "Direction " << i << ":";
-      offset = direction_block_size * i;
-      // get each b-value...
-      for (int j = 0; j < number_of_b_values; j++)
+      for (int j = 0; ok && j < number_of_b_values; j++)
 	{
 	  cout << " b-value " << j;
-	  offset_beg = offset + b_value_block_size * j;
-	  offset_end = offset_beg + b_value_block_size;
-	  input_file.seekg(offset_beg, ios::beg);
-	  // and save it in the right file.
-	  while (input_file.tellg () < offset_end)
+	  for ( remaining = b_value_block_size; ok && remaining > 0; remaining -= chunk.length )
 	    {
-	      length = 2;
-	      input_file.read (buffer, length);
-	      output_file[j].write (buffer, length);
+	      chunk.length = remaining < SPLIT_CHUNK_SIZE ? remaining : SPLIT_CHUNK_SIZE;
+	      chunk.data   = new char[chunk.length];
+	      ok = input_file.read ( chunk.data, chunk.length );
+	      if ( ok )
+		queue[j]->push ( chunk );
+	      else
+		delete[] chunk.data;
 	    }
 	}
       cout << endl;
     }
-
   input_file.close ();
 
+  for (int i = 0; i < number_of_b_values; i++)
+    {
+      queue[i]->close ();
+      pthread_join ( writer[i], NULL );
+      ok = ok && job[i].ok;
+      delete queue[i];
+    }
+  delete[] queue;
+  delete[] writer;
+  delete[] job;
+  if ( ! ok )
+    {
+      cout << "ERROR copying the b-value blocks." << endl;
+      exit (1);
+    }
+
   // verify output file size
   for ( int i = 0; i < number_of_b_values; i++ )
     {
-      output_file[i].seekg ( 0, ios::end );
-      file_size = output_file[i].tellg ();
-      output_file[i].close ();
-      cout << "Expected output " << i << " file size: " << output_file_size << endl;
-      cout << "Output " << i << " file size:          " << file_size << " ";
-      if ( file_size != output_file_size )
-	cout << "FAIL" << endl;
-      else
-	cout << "OK" << endl;
+      stringstream label;
+
+      label << "output " << i << " file";
+      check_size ( label.str (), output_file[i].size (), output_file_size );
+      if ( ! output_file[i].close () )
+	cout << "ERROR closing output " << i << "." << endl;
     }
+  delete[] output_file;
 
   return 0;
 }
+
+void* writer_thread ( void* argument )
+{
+  writer_job* job = static_cast<writer_job*> ( argument );
+  data_block  block;
+
+  // keep draining after an error, so that the reader never blocks
+  while ( job->queue->pop ( &block ) )
+    {
+      if ( job->ok )
+	job->ok = job->output->write ( block.data, block.length );
+      delete[] block.data;
+    }
+  return NULL;
+}